@@ -89,7 +89,12 @@ std::tuple<std::string, std::string, VideoParameters, std::string, bool> parseAr
     bool video_device_set = false;
     bool audio_device_set = false;
     bool video_size_set = false;
+    bool output_size_set = false;
+    int output_width = 0;
+    int output_height = 0;
     bool framerate_set = false;
+    bool capture_interval_set = false;
+    int capture_interval = 0;
     bool output_set = false;
     bool verbose = false;
     std::string wrong_args_msg("Wrong arguments");
@@ -109,10 +114,21 @@ std::tuple<std::string, std::string, VideoParameters, std::string, bool> parseAr
             if (video_size_set || ++it == args.end()) throw std::runtime_error(wrong_args_msg);
             video_params = parseVideoSize(*it);
             video_size_set = true;
+        } else if (*it == "-output_size") {
+            if (output_size_set || ++it == args.end()) throw std::runtime_error(wrong_args_msg);
+            auto delim_pos = it->find('x');
+            if (delim_pos == std::string::npos) throw std::runtime_error("Wrong output-size format");
+            output_width = std::stoi(it->substr(0, delim_pos));
+            output_height = std::stoi(it->substr(delim_pos + 1));
+            output_size_set = true;
         } else if (*it == "-framerate") {
             if (framerate_set || ++it == args.end()) throw std::runtime_error(wrong_args_msg);
             framerate = std::stoi(*it);
             framerate_set = true;
+        } else if (*it == "-timelapse") {
+            if (capture_interval_set || ++it == args.end()) throw std::runtime_error(wrong_args_msg);
+            capture_interval = std::stoi(*it);
+            capture_interval_set = true;
         } else if (*it == "-o") {
             if (output_set || ++it == args.end()) throw std::runtime_error(wrong_args_msg);
             output_file = *it;
@@ -125,6 +141,8 @@ std::tuple<std::string, std::string, VideoParameters, std::string, bool> parseAr
     }
 
     video_params.setFramerate(framerate);
+    video_params.setOutputSize(output_width, output_height);
+    video_params.setCaptureInterval(capture_interval);
 
     if (!output_set) {
         output_file = "output.mp4";
@@ -150,6 +168,12 @@ std::tuple<std::string, std::string, VideoParameters, std::string, bool> parseAr
             std::cout << "Parsed video size: " << width << "x" << height << std::endl;
             std::cout << "Parsed video offset: " << offset_x << "," << offset_y << std::endl;
         }
+        if (output_size_set) {
+            std::cout << "Parsed output size: " << output_width << "x" << output_height << std::endl;
+        }
+        if (capture_interval_set) {
+            std::cout << "Parsed time-lapse capture interval: " << capture_interval << " ms" << std::endl;
+        }
         if (output_set) {
             std::cout << "Parsed output file: " << output_file << std::endl;
         }
@@ -196,7 +220,9 @@ int main(int argc, char **argv) {
         std::cerr << "\t[-video_device <device_name>]" << std::endl;
         std::cerr << "\t[-audio_device <device_name>]" << std::endl;
         std::cerr << "\t[-video_size <width>x<height>:<offset_x>,<offset_y>]" << std::endl;
+        std::cerr << "\t[-output_size <width>x<height>]" << std::endl;
         std::cerr << "\t[-framerate <framerate>]" << std::endl;
+        std::cerr << "\t[-timelapse <capture_interval_ms>]" << std::endl;
         std::cerr << "\t[-o <output_file>]" << std::endl;
         std::cerr << "\t[-v]" << std::endl;
         return 1;
@@ -1,21 +1,75 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "encoder_parameters.h"
+#include "rendition.h"
+#include "thread_parameters.h"
 #include "video_parameters.h"
 
 class Demuxer;
+class EncoderProcess;
 class Pipeline;
+class TraceWriter;
 
 class Capturer {
     /* Whether the recorder should be verbose or not */
     bool verbose_;
+    /* Whether the input devices and the pipeline should be kept open after stopping a recording */
+    bool session_mode_{};
+    /* Whether the recordings should be spooled with a fast codec and compressed after stopping them */
+    bool compress_later_{};
+    /* Whether the current pipeline is writing to a spool file */
+    bool spooling_{};
+    /* The output file of the current recording */
+    std::string output_file_;
+    /* The interval between two grabbed frames in time-lapse mode (0 if disabled), in milliseconds */
+    int capture_interval_{};
+    /* The framerate at which the grabbed frames are played back */
+    int playback_framerate_{};
+    /* The options of the H.264 encoder of the final output (of the transcoding, in compress-later mode) */
+    std::map<std::string, std::string> h264_enc_options_;
+    /* The placement and scheduling of the recording threads */
+    ThreadParameters thread_params_;
+    /* The interleaving limits of the output streams (if max_interleave_bytes_ is 0, the defaults are used) */
+    int max_interleave_delay_{};
+    size_t max_interleave_bytes_{};
+    /* Called after writing each packet to the output, with its type and capture timestamp */
+    std::function<void(bool, int64_t)> write_callback_;
+    /* The background transcodings of the spooled recordings, performed one at a time */
+    std::vector<std::shared_future<void>> transcodings_;
+
+    /* An additional track, recorded from its own device together with the main video [and audio] ones */
+    struct Track {
+        bool audio;
+        std::string device;
+        VideoParameters video_params;
+        /* whether the audio is mixed into the main audio track, with the given gain */
+        bool mixed = false;
+        float gain = 1.0f;
+    };
+    std::vector<Track> extra_tracks_;
+    /* The gain of the main audio device, when other devices are mixed with it */
+    float audio_gain_ = 1.0f;
+    /* How long the audio must be silent before its encoding is skipped, in ms (0 if the silence isn't detected) */
+    int silence_hold_time_{};
+    /* The level below which the audio is silent, in dBFS */
+    float silence_threshold_ = -60.0f;
+    /* The duration of the HLS segments, in seconds (0 if the output is not segmented) */
+    int segment_duration_{};
+    /* The renditions of the main video track (if empty, it's encoded once at the output size) */
+    std::vector<Rendition> renditions_;
 
     /* Synchronization variables */
 
@@ -25,21 +79,90 @@ class Capturer {
     std::condition_variable cv_;
     std::thread capturer_;
 
+    /* An input device together with the state used to keep its timestamps continuous across pauses */
+    struct Source {
+        std::unique_ptr<Demuxer> demuxer;
+        int64_t last_pts = 0;
+        int64_t pts_offset = 0;
+        bool adjust_pts_offset = false;
+        /* time-lapse mode only: the number of frames sampled so far and when the next one is due (in time and pts) */
+        int64_t samples = 0;
+        int64_t next_sample_pts = 0;
+        std::chrono::steady_clock::time_point next_sample_time;
+        /* the pipeline streams fed with the video/audio packets of the source (-1 if not recorded) */
+        int video_stream = -1;
+        int audio_stream = -1;
+    };
+
+    /* The input sources (the main one, or separate video and audio ones on Linux, plus the extra tracks ones) */
+    std::vector<Source> sources_;
+
     /* The pipeline used for audio/video processing */
     std::unique_ptr<Pipeline> pipeline_;
 
+    /* The executable of the encoder process (if empty, the processing runs in the capturer process) */
+    std::string encoder_executable_;
+    /* The encoder process the packets are passed to, instead of the pipeline (two-process mode only) */
+    std::unique_ptr<EncoderProcess> encoder_process_;
+
+    /* The name of the shared-memory ring the video frames are exported to (if empty, they aren't exported) */
+    std::string frame_export_;
+
+    /* The file to which the packets fed to the pipeline are dumped (if empty, they aren't traced) */
+    std::string trace_file_;
+    std::unique_ptr<TraceWriter> trace_writer_;
+    /* The file to which the flow of the packets through the processing stages is dumped (if empty, it isn't) */
+    std::string flow_trace_file_;
+
+    /**
+     * Open a new input source
+     * @param video_device  the name of the video device (if empty, only audio will be captured)
+     * @param audio_device  the name of the audio device (if empty, only video will be captured)
+     * @param video_params  the parameters of the video to capture
+     * @return the index of the new source in sources_
+     */
+    size_t openSource(const std::string &video_device, const std::string &audio_device,
+                      const VideoParameters &video_params);
+
+    /**
+     * Create the processing pipeline of the opened sources, with one chain (and output stream) for each track
+     * @param output_file       the name of the output file
+     * @param video_sources     the sources of the video tracks, with the parameters of their videos
+     * @param audio_sources     the sources of the audio tracks
+     * @param mixed_sources     the sources mixed into the main audio track, with their gains (if empty, no mix)
+     * @param video_enc_options the options of the video encoders
+     */
+    void initPipeline(const std::string &output_file, std::vector<std::pair<size_t, VideoParameters>> &video_sources,
+                      const std::vector<size_t> &audio_sources,
+                      const std::vector<std::pair<size_t, float>> &mixed_sources,
+                      const std::map<std::string, std::string> &video_enc_options);
+
     /**
-     * Read packets from a demuxer and pass them to the processing pipeline
-     * @param demuxer the demuxer to read the packets from
+     * Start the encoder process of the two-process mode, with the same streams the pipeline would have
+     * @see initPipeline()
      */
-    void capture(Demuxer &demuxer);
+    void initEncoderProcess(const std::string &output_file,
+                            const std::vector<std::pair<size_t, VideoParameters>> &video_sources,
+                            const std::vector<size_t> &audio_sources,
+                            const std::map<std::string, std::string> &video_enc_options);
 
     /**
-     * Read packets from two separate audio/video demuxers and pass them to the processing pipeline
-     * @param video_demuxer the video demuxer to read packets from
-     * @param audio_demuxer the audio demuxer to read packets from
+     * Read packets from the sources and pass them to the processing pipeline,
+     * using a separate thread for each source
      */
-    void capture(Demuxer &video_demuxer, Demuxer &audio_demuxer);
+    void capture();
+
+    /**
+     * Read packets from a source and pass them to the processing pipeline
+     * @param source the source to read the packets from
+     */
+    void capture(Source &source);
+
+    /**
+     * Launch the capturer thread on the already initialized sources and pipeline
+     * @return a future that can be used to check for exceptions occurring in the recording thread
+     */
+    std::future<void> startCapture();
 
     /**
      * Stop the capturing
@@ -73,16 +196,227 @@ public:
      * @param output_file       the name of the output file to use to save the recording (must be non-empty)
      * @param video_params      the video dimensions (NOTE: if the width/height is set to 0, the whole display dimension
      * will be considered)
+     * @param encoder_params    the settings of the video encoder (GOP, B-frames, lookahead, rate control, tuning).
+     * In compress-later mode they apply to the final transcoding, not to the spooled recording
      * @return a future that can be used to check for exceptions occurring in the recording thread
      */
     std::future<void> start(const std::string &video_device, const std::string &audio_device,
-                            const std::string &output_file, VideoParameters video_params);
+                            const std::string &output_file, VideoParameters video_params,
+                            const EncoderParameters &encoder_params = EncoderParameters());
+
+    /**
+     * Make the video encoders emit a keyframe from the next captured frame (e.g. to let a new viewer join a
+     * live stream without waiting for the end of the GOP). It can be called from any thread while recording,
+     * otherwise an exception will be thrown
+     */
+    void requestKeyframe();
+
+    /**
+     * Record an additional video track in the next recordings, captured from its own device (e.g. a second
+     * monitor or another region of the same one) and stored as a separate stream of the output file,
+     * synchronized with the main ones. Not supported in compress-later mode
+     * @param video_device  the name of the video device to use
+     * @param video_params  the parameters of the additional video track
+     */
+    void addVideoTrack(const std::string &video_device, VideoParameters video_params);
+
+    /**
+     * Record an additional audio track in the next recordings, captured from its own device (e.g. the system
+     * audio besides the microphone) and stored as a separate stream of the output file, synchronized with the
+     * main ones. Not supported in compress-later and time-lapse modes
+     * @param audio_device the name of the audio device to use
+     */
+    void addAudioTrack(const std::string &audio_device);
+
+    /**
+     * Mix the audio of an additional device into the main audio track of the next recordings (e.g. the system
+     * audio with the microphone), instead of recording it as a separate stream. The devices are aligned on their
+     * timestamps and mixed with their gains before the encoding, clamping the sum to the full scale. Not supported
+     * in compress-later, time-lapse, two-process and trace modes
+     * @param audio_device  the name of the audio device to mix
+     * @param gain          the gain of the device in the mix (1 to keep its level)
+     */
+    void addMixedAudio(const std::string &audio_device, float gain = 1.0f);
+
+    /**
+     * Set the gain of the main audio device when other devices are mixed with it (see addMixedAudio()), taking
+     * effect from the next call to start()
+     * @param gain the gain of the main audio device in the mix (1 to keep its level, the default)
+     */
+    void setAudioGain(float gain);
+
+    /**
+     * Skip the encoding of the silent stretches of the audio tracks of the next recordings: once the audio stays
+     * below the threshold for the hold time, its frames are replaced by a silent AAC frame encoded in advance,
+     * until the level rises again (saving the CPU of the encoder in the long silences, e.g. a muted microphone).
+     * Not supported in compress-later (ignored) and two-process modes
+     * @param hold_time how long the audio must be silent before its encoding is skipped, in ms (0 to disable it)
+     * @param threshold the level below which the audio is silent, in dBFS
+     */
+    void setSilenceDetection(int hold_time, float threshold = -60.0f);
+
+    /**
+     * Remove the additional tracks added with addVideoTrack(), addAudioTrack() and addMixedAudio() (taking effect
+     * from the next call to start())
+     */
+    void clearExtraTracks();
+
+    /**
+     * Encode the main video track as an adaptive-bitrate ladder in the next recordings: the frames are grabbed and
+     * decoded once, and then scaled and encoded in parallel for each rendition, with aligned keyframes.
+     * Not supported in compress-later mode, nor in session mode if some renditions have their own output file
+     * @param renditions the renditions to encode (if empty, the ladder mode is disabled)
+     */
+    void setRenditions(std::vector<Rendition> renditions);
+
+    /**
+     * Enable or disable the segmented output for HTTP Live Streaming (disabled by default), taking effect from the
+     * next call to start(). When enabled, the output file passed to start() is the (.m3u8) playlist, and the
+     * recording is written to MPEG-TS segments of about segment_duration seconds in the same directory, listed in
+     * the playlist as soon as they're complete, so that it can be watched while it's still in progress.
+     * The keyframe interval is set to the segment duration, and each segment starts with a forced keyframe (hence
+     * it's at most a frame longer than segment_duration). Not supported in compress-later mode
+     * @param segment_duration the duration of the segments, in seconds (if 0, the segmented output is disabled)
+     */
+    void setSegmentDuration(int segment_duration);
+
+    /**
+     * Set the cores and the priorities of the recording threads. The processing cores are applied immediately
+     * (to the worker threads shared by the whole process), the other settings from the next call to start()
+     * @param thread_params the placement and scheduling of the threads
+     */
+    void setThreadParameters(ThreadParameters thread_params);
+
+    /**
+     * Set the limits of the interleaving of the recorded streams, taking effect from the next call to start().
+     * The packets are written in timestamp order, but one waits for the other streams at most max_delay and as
+     * long as the queued ones take less than max_queued_bytes, so that a stalled device can't hold back the others.
+     * Lower limits reduce the latency of live (e.g. segmented) outputs at the cost of a looser interleaving
+     * @param max_delay         the maximum interleaving delay, in milliseconds (default 1000)
+     * @param max_queued_bytes  the maximum size of the packets waiting to be interleaved (default 64 MB)
+     */
+    void setInterleaving(int max_delay, size_t max_queued_bytes);
+
+    /**
+     * Enable or disable the two-process mode (disabled by default), taking effect from the next call to start().
+     * In this mode the capture threads only publish the raw packets to a shared-memory ring, and the processing
+     * pipeline runs in a separate encoder process (libcapture-encoder, built with the library), so that a crash or
+     * a stall of the encoding can't take down the capture. If the encoder process dies, it's restarted on a new
+     * output file ("<name>.<n>.<ext>") while the capture goes on (if it keeps failing, the capture goes on without
+     * encoding and stop() throws an exception). Not supported on Windows, nor in compress-later
+     * and session modes, nor with renditions, segmented output, or write callbacks. The additional video tracks
+     * are encoded at their full size
+     * @param executable the path of the encoder executable, or its name to look it up in PATH (if empty, the
+     * two-process mode is disabled)
+     */
+    void setEncoderProcess(std::string executable);
+
+    /**
+     * Enable or disable the export of the video frames (disabled by default), taking effect from the next call to
+     * start(). The frames are published, as passed to the video encoders, to a named shared-memory ring which any
+     * number of other processes of the host can read with FrameReader, so that one screen grab serves them all.
+     * The readers never slow down the recording: the ones lagging behind skip frames. Not supported on Windows
+     * @param name the name of the ring, which must be unique on the host (if empty, the export is disabled)
+     */
+    void setFrameExport(std::string name);
+
+    /**
+     * Set a function to call every time a packet has been written to the output file, taking effect from the next
+     * call to start(), e.g. to measure the latency from the capture to the file (see tools/latency)
+     * @param callback  the function, receiving whether the packet is a video one and the timestamp given by the
+     * capture device to the grabbed frame (or samples) it was encoded from, in microseconds on the clock of the
+     * device (e.g. the system clock for the X11 grabber), shifted by the time spent in pause, if any. It's called
+     * by a background thread, so it must be thread-safe and fast (if empty, no function is called)
+     */
+    void setWriteCallback(std::function<void(bool video, int64_t timestamp)> callback);
+
+    /**
+     * Enable or disable the trace mode (disabled by default), taking effect from the next call to start().
+     * In this mode the raw packets grabbed from the devices are also dumped, with their timestamps and the
+     * parameters of their streams, to a trace file which can be replayed with replayTrace() to reproduce the
+     * processing of the same input without the devices. The packets are written by a background thread, dropping
+     * them if the disk can't keep up. Not supported in session mode.
+     * WARNING: the raw video requires a high disk bandwidth
+     * @param trace_file the name of the trace file (if empty, the trace mode is disabled)
+     */
+    void setTraceFile(std::string trace_file);
+
+    /**
+     * Enable or disable the flow tracing (disabled by default), taking effect from the next call to start().
+     * While enabled, the time spent by each packet and frame in each processing stage (reading, decoding,
+     * conversion, encoding, muxing) is recorded, and dumped on stop() as a Chrome/Perfetto trace, which can be
+     * opened in https://ui.perfetto.dev or chrome://tracing. The stages of all the recordings of the process are
+     * traced, and at most 32768 events are kept for each thread
+     * @param flow_trace_file the name of the JSON trace file (if empty, the flow tracing is disabled)
+     */
+    void setFlowTraceFile(std::string flow_trace_file);
+
+    /**
+     * Dump the flow trace recorded so far (see setFlowTraceFile()), e.g. while the recording is in progress
+     * @param file the name of the JSON trace file
+     */
+    void dumpFlowTrace(const std::string &file) const;
+
+    /**
+     * Process the packets of a trace recorded in trace mode as done while recording them (H.264/AAC, with the same
+     * stream order), and return once the output file is complete. The first video stream is processed with the
+     * given parameters, the other ones (if any) at their full size.
+     * If there is a recording in progress, calling this function will throw an exception
+     * @param trace_file        the name of the trace file
+     * @param output_file       the name of the output file
+     * @param video_params      the parameters used for the recording
+     * @param encoder_params    the settings of the video encoder
+     * @param paced             true to feed the packets at the pace they were grabbed (dropping the video frames
+     * that can't be processed in time, as while recording), false to process all of them as fast as possible
+     */
+    void replayTrace(const std::string &trace_file, const std::string &output_file, VideoParameters video_params,
+                     const EncoderParameters &encoder_params = EncoderParameters(), bool paced = false);
 
     /**
      * Stop the recording (if the recording is already stopped, an exception will be thrown).
+     * In session mode, the input devices and the processing pipeline are kept open, so that the next
+     * recording can be started quickly with restart()
      */
     void stop();
 
+    /**
+     * Start a new recording with the same devices and parameters of the last one, reusing the input devices,
+     * decoders, converters and encoders kept open by the session mode. Only the output file is replaced.
+     * If there is a recording in progress or there is no open session, calling this function will throw an exception.
+     * @param output_file the name of the output file to use to save the recording (must be non-empty and
+     * of a format compatible with the one used by the session)
+     * @return a future that can be used to check for exceptions occurring in the recording thread
+     */
+    std::future<void> restart(const std::string &output_file);
+
+    /**
+     * Enable or disable the session mode (disabled by default). When disabling it while no recording is
+     * in progress, the open session (if any) is closed
+     * @param session_mode true to keep the input devices and the pipeline open after stopping a recording
+     */
+    void setSessionMode(bool session_mode);
+
+    /**
+     * Enable or disable the compress-later mode (disabled by default), taking effect from the next call to start().
+     * In this mode the recording is spooled to "<output_file>.spool.mkv" with a cheap intra-only codec (FFV1
+     * and PCM audio), and it's transcoded to the usual H.264/AAC output file in background, with idle priority,
+     * after stopping it. This trades disk bandwidth for a smoother capture on loaded machines.
+     * @param compress_later true to spool the recordings and compress them after stopping them
+     */
+    void setCompressLater(bool compress_later);
+
+    /**
+     * Wait for the background transcodings of the recordings made in compress-later mode to complete
+     * (if any exception occurred during a transcoding, it will be re-thrown here)
+     */
+    void waitTranscoding();
+
+    /**
+     * Close the open session (if any), releasing the input devices and the processing pipeline.
+     * If there is a recording in progress, an exception will be thrown
+     */
+    void closeSession();
+
     /**
      * Pause the recording (if the recording is already paused/stopped, an exception will be thrown)
      */
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+/**
+ * The settings of the video encoder (H.264). The settings left unset keep the encoder defaults
+ * (or the ones chosen by the recorder, e.g. the "ultrafast" preset)
+ */
+class EncoderParameters {
+public:
+    /* How the encoder splits the work among its threads */
+    enum class Threading {
+        Auto,   // the encoder default (frame threads for x264)
+        Frame,  // several frames encoded in parallel: higher throughput, but each thread adds a frame of latency
+        Slice   // each frame split in slices encoded in parallel: no added latency, slightly lower compression
+    };
+
+private:
+    std::string preset_;
+    std::string tune_;
+    int gop_size_ = -1;
+    int keyint_min_ = -1;
+    int b_frames_ = -1;
+    int rc_lookahead_ = -1;
+    int crf_ = -1;
+    int64_t bitrate_ = 0;
+    int64_t max_bitrate_ = 0;
+    int64_t buffer_size_ = 0;
+    Threading threading_ = Threading::Auto;
+    int threads_ = -1;
+
+    /**
+     * Check if the value is greater or equal to the lower bound.
+     * If this is not the case, throw an exception
+     * @param name  the name of the attribute to check
+     * @param val   the value of the attribute
+     * @param bound the lower bound for the attribute
+     */
+    static void checkGE(const std::string &name, const int64_t val, const int64_t bound) {
+        if (val < bound) throw std::invalid_argument(name + " must be >= " + std::to_string(bound));
+    }
+
+public:
+    /**
+     * Set the x264 preset, trading encoding speed for compression (e.g. "ultrafast", "veryfast", "medium")
+     * @param preset the name of the preset
+     */
+    void setPreset(std::string preset) { preset_ = std::move(preset); }
+
+    /**
+     * Set the x264 tuning (e.g. "zerolatency" to disable the frame-delaying features, "stillimage")
+     * @param tune the name of the tuning
+     */
+    void setTune(std::string tune) { tune_ = std::move(tune); }
+
+    /**
+     * Set the maximum distance between two keyframes (GOP length)
+     * @param gop_size the GOP length, in frames
+     */
+    void setGopSize(int gop_size) {
+        checkGE("GOP size", gop_size, 1);
+        gop_size_ = gop_size;
+    }
+
+    /**
+     * Set the minimum distance between two keyframes
+     * @param keyint_min the minimum distance, in frames
+     */
+    void setKeyintMin(int keyint_min) {
+        checkGE("minimum keyframe interval", keyint_min, 1);
+        keyint_min_ = keyint_min;
+    }
+
+    /**
+     * Set the maximum number of consecutive B-frames (0 to disable them, reducing the latency)
+     * @param b_frames the number of B-frames
+     */
+    void setBFrames(int b_frames) {
+        checkGE("B-frames", b_frames, 0);
+        b_frames_ = b_frames;
+    }
+
+    /**
+     * Set the number of frames the rate control looks ahead (each one adds a frame of latency)
+     * @param rc_lookahead the number of frames
+     */
+    void setRcLookahead(int rc_lookahead) {
+        checkGE("rate control lookahead", rc_lookahead, 0);
+        rc_lookahead_ = rc_lookahead;
+    }
+
+    /**
+     * Use the constant quality rate control (lower values give higher quality, 23 is the x264 default)
+     * @param crf the constant rate factor, in [0, 51]
+     */
+    void setCrf(int crf) {
+        checkGE("CRF", crf, 0);
+        if (crf > 51) throw std::invalid_argument("CRF must be <= 51");
+        crf_ = crf;
+    }
+
+    /**
+     * Set the target average bitrate
+     * @param bitrate the bitrate, in bits/s
+     */
+    void setBitrate(int64_t bitrate) {
+        checkGE("bitrate", bitrate, 1);
+        bitrate_ = bitrate;
+    }
+
+    /**
+     * Constrain the bitrate with a VBV buffer
+     * @param max_bitrate   the maximum bitrate, in bits/s
+     * @param buffer_size   the size of the VBV buffer, in bits
+     */
+    void setVbv(int64_t max_bitrate, int64_t buffer_size) {
+        checkGE("maximum bitrate", max_bitrate, 1);
+        checkGE("VBV buffer size", buffer_size, 1);
+        max_bitrate_ = max_bitrate;
+        buffer_size_ = buffer_size;
+    }
+
+    /**
+     * Set the threading profile of the encoder
+     * @param threading the threading mode
+     * @param threads   the number of threads (if 0, chosen by the encoder according to the available cores)
+     */
+    void setThreading(Threading threading, int threads = 0) {
+        checkGE("threads", threads, 0);
+        threading_ = threading;
+        threads_ = threads;
+    }
+
+    [[nodiscard]] const std::string &getPreset() const { return preset_; }
+
+    [[nodiscard]] const std::string &getTune() const { return tune_; }
+
+    [[nodiscard]] int getGopSize() const { return gop_size_; }
+
+    [[nodiscard]] int getKeyintMin() const { return keyint_min_; }
+
+    [[nodiscard]] int getBFrames() const { return b_frames_; }
+
+    [[nodiscard]] int getRcLookahead() const { return rc_lookahead_; }
+
+    [[nodiscard]] int getCrf() const { return crf_; }
+
+    [[nodiscard]] int64_t getBitrate() const { return bitrate_; }
+
+    [[nodiscard]] std::pair<int64_t, int64_t> getVbv() const { return std::make_pair(max_bitrate_, buffer_size_); }
+
+    [[nodiscard]] Threading getThreading() const { return threading_; }
+
+    [[nodiscard]] int getThreads() const { return threads_; }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class FrameRing;
+
+/**
+ * Reader of the video frames exported by a recording through a shared-memory ring (see
+ * Capturer::setFrameExport()), for the other tools of the host which need the captured frames without grabbing
+ * the screen again. Any number of readers can read the same ring, without locks and without slowing down the
+ * recording: a reader lagging behind skips the frames overwritten in the meantime. POSIX only
+ */
+class FrameReader {
+    std::unique_ptr<FrameRing> ring_;
+
+public:
+    /* A video frame copied out of the ring */
+    struct Frame {
+        /* the index of the exported video track (0 for the main one) */
+        int stream = -1;
+        /* the pixel format of the frame, as named by FFmpeg (e.g. "yuv420p") */
+        std::string pixel_format;
+        int width = 0;
+        int height = 0;
+        /* the timestamp of the frame from the start of the recording, in microseconds */
+        int64_t timestamp = 0;
+        /* the sequence number of the frame in the ring (the skipped frames leave gaps) */
+        uint64_t sequence = 0;
+        /* the planes of the frame, one after the other without padding */
+        std::vector<uint8_t> data;
+    };
+
+    /**
+     * Open the ring of a recording, starting from the last frame exported
+     * @param name the name of the ring, as passed to Capturer::setFrameExport()
+     */
+    explicit FrameReader(const std::string &name);
+
+    FrameReader(const FrameReader &) = delete;
+
+    ~FrameReader();
+
+    FrameReader &operator=(const FrameReader &) = delete;
+
+    /**
+     * Read the next frame exported, without waiting for it
+     * @param frame filled with the frame (its buffer is reused across calls)
+     * @return true if a frame has been read, false if no new frame is available
+     */
+    bool read(Frame &frame);
+
+    /**
+     * Whether the recording ended and all its frames have been read
+     * @return true if no more frames will be available
+     */
+    [[nodiscard]] bool isClosed() const;
+
+    /**
+     * Get the number of frames skipped so far, because they had been overwritten before they could be read
+     * @return the number of skipped frames
+     */
+    [[nodiscard]] uint64_t getSkippedFrames() const;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/**
+ * A rendition of an adaptive-bitrate ladder: the captured video scaled to a given size and encoded
+ * with a given bitrate
+ */
+class Rendition {
+    int width_ = 0;
+    int height_ = 0;
+    int64_t bitrate_ = 0;
+    std::string output_file_;
+
+public:
+    /**
+     * Create a new rendition
+     * @param width         the width of the rendition (must be positive and even)
+     * @param height        the height of the rendition (must be positive and even)
+     * @param bitrate       the target bitrate of the rendition, in bits/s (must be positive)
+     * @param output_file   the file to which write the rendition (if empty, it will be written as a separate
+     * stream of the main output file)
+     */
+    Rendition(int width, int height, int64_t bitrate, std::string output_file = "")
+        : width_(width), height_(height), bitrate_(bitrate), output_file_(std::move(output_file)) {
+        if (width_ <= 0 || height_ <= 0) throw std::invalid_argument("rendition size must be positive");
+        if (width_ % 2 || height_ % 2) throw std::invalid_argument("rendition size must be divisible by 2");
+        if (bitrate_ <= 0) throw std::invalid_argument("rendition bitrate must be positive");
+    }
+
+    [[nodiscard]] std::pair<int, int> getSize() const { return std::make_pair(width_, height_); }
+
+    [[nodiscard]] int64_t getBitrate() const { return bitrate_; }
+
+    [[nodiscard]] const std::string &getOutputFile() const { return output_file_; }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class ThreadPriority { Normal, High, RealTime };
+
+/**
+ * The placement and scheduling of the recording threads. By default the threads run with the default priority
+ * and float across all the cores
+ */
+class ThreadParameters {
+    std::vector<int> video_capture_cores_;
+    std::vector<int> audio_capture_cores_;
+    std::vector<int> processing_cores_;
+    std::vector<int> encoder_cores_;
+    ThreadPriority capture_priority_ = ThreadPriority::Normal;
+
+    /**
+     * Check that the cores indices are valid.
+     * If this is not the case, throw an exception
+     * @param name  the name of the attribute to check
+     * @param cores the indices of the cores
+     */
+    static void checkCores(const std::string &name, const std::vector<int> &cores) {
+        for (int core : cores) {
+            if (core < 0) throw std::invalid_argument(name + " cores must be >= 0");
+        }
+    }
+
+public:
+    /**
+     * Set the cores on which the threads grabbing the video frames run (not supported on macOS)
+     * @param cores the indices of the cores (if empty, all the cores)
+     */
+    void setVideoCaptureCores(std::vector<int> cores) {
+        checkCores("video capture", cores);
+        video_capture_cores_ = std::move(cores);
+    }
+
+    /**
+     * Set the cores on which the threads grabbing the audio samples run (not supported on macOS).
+     * On Windows and macOS the main audio is grabbed by the same thread of the main video
+     * @param cores the indices of the cores (if empty, all the cores)
+     */
+    void setAudioCaptureCores(std::vector<int> cores) {
+        checkCores("audio capture", cores);
+        audio_capture_cores_ = std::move(cores);
+    }
+
+    /**
+     * Set the cores on which the decoding and the conversion run (not supported on macOS).
+     * WARNING: they're performed by the worker threads shared by all the recorders of the process
+     * @param cores the indices of the cores (if empty, all the cores)
+     */
+    void setProcessingCores(std::vector<int> cores) {
+        checkCores("processing", cores);
+        processing_cores_ = std::move(cores);
+    }
+
+    /**
+     * Set the cores on which the internal threads of the video encoders run (not supported on macOS)
+     * @param cores the indices of the cores (if empty, all the cores)
+     */
+    void setEncoderCores(std::vector<int> cores) {
+        checkCores("encoder", cores);
+        encoder_cores_ = std::move(cores);
+    }
+
+    /**
+     * Set the scheduling priority of the capture threads, so that the grabbing isn't delayed by the other
+     * processes of a loaded machine. Raising it usually requires some privileges (e.g. CAP_SYS_NICE on Linux),
+     * if missing the threads keep the default priority
+     * @param capture_priority the priority (High lowers the nice value, RealTime uses the FIFO scheduling)
+     */
+    void setCapturePriority(ThreadPriority capture_priority) { capture_priority_ = capture_priority; }
+
+    [[nodiscard]] const std::vector<int> &getVideoCaptureCores() const { return video_capture_cores_; }
+
+    [[nodiscard]] const std::vector<int> &getAudioCaptureCores() const { return audio_capture_cores_; }
+
+    [[nodiscard]] const std::vector<int> &getProcessingCores() const { return processing_cores_; }
+
+    [[nodiscard]] const std::vector<int> &getEncoderCores() const { return encoder_cores_; }
+
+    [[nodiscard]] ThreadPriority getCapturePriority() const { return capture_priority_; }
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "encoder_parameters.h"
+#include "video_parameters.h"
+
+class Transcoder {
+    std::string input_file_;
+    std::string output_file_;
+    VideoParameters video_params_;
+    EncoderParameters encoder_params_;
+    size_t read_ahead_ = 8;
+    bool verbose_;
+
+public:
+    /* The throughput of a transcoding */
+    struct Stats {
+        int64_t video_frames = 0;
+        int64_t audio_frames = 0;
+        double seconds = 0;  // wall-clock time, including opening and closing the files
+
+        [[nodiscard]] double getFramesPerSecond() const { return seconds > 0 ? video_frames / seconds : 0; }
+    };
+
+    /**
+     * Create a new transcoder from a media file (e.g. a spooled recording) to an H.264/AAC output file, running
+     * the same processing chain of the recordings as fast as the CPU allows
+     * @param input_file    the name of the media file to read
+     * @param output_file   the name of the output file
+     * @param verbose       true to print informations about the processing
+     */
+    Transcoder(std::string input_file, std::string output_file, bool verbose = false);
+
+    /**
+     * Set the parameters of the output video (cropping, scaling, conversion)
+     * @param video_params the video parameters (the framerate and the capture interval are ignored)
+     */
+    void setVideoParameters(VideoParameters video_params);
+
+    /**
+     * Set the settings of the video encoder (if not set, the "medium" preset is used)
+     * @param encoder_params the settings of the video encoder
+     */
+    void setEncoderParameters(EncoderParameters encoder_params);
+
+    /**
+     * Set how many packets of each stream are read ahead of the processing, so that the reading, decoding,
+     * conversion and encoding stages are all kept busy
+     * @param read_ahead the number of packets (at least 1)
+     */
+    void setReadAhead(size_t read_ahead);
+
+    /**
+     * Transcode the whole input file, returning once the output file is complete
+     * @return the number of processed frames and the time it took
+     */
+    Stats run() const;
+};
@@ -1,13 +1,27 @@
 #pragma once
 
+#include <stdexcept>
 #include <string>
 
+/**
+ * The algorithms that can be used to scale the video, from the fastest to the slowest
+ * (Area is usually the best choice for strong downscaling)
+ */
+enum class ScalingAlgorithm { FastBilinear, Bilinear, Area, Bicubic };
+
 class VideoParameters {
     int width_ = 0;
     int height_ = 0;
     int offset_x_ = 0;
     int offset_y_ = 0;
     int framerate_ = 0;
+    int capture_interval_ = 0;
+    int output_width_ = 0;
+    int output_height_ = 0;
+    ScalingAlgorithm scaling_algorithm_ = ScalingAlgorithm::FastBilinear;
+    int conversion_slices_ = 0;
+    bool roi_encoding_ = false;
+    bool scene_adaptive_encoding_ = false;
 
     /**
      * Check if the value is greater or equal to the lower bound.
@@ -60,9 +74,80 @@ public:
         framerate_ = framerate;
     }
 
+    /**
+     * Enable the time-lapse mode: a single frame will be grabbed every capture_interval milliseconds,
+     * and the frames will be played back at the framerate set with setFramerate()
+     * @param capture_interval  the interval between two grabbed frames, in milliseconds (if 0, the time-lapse mode
+     * is disabled)
+     */
+    void setCaptureInterval(int capture_interval) {
+        checkGE("capture interval", capture_interval, 0);
+        capture_interval_ = capture_interval;
+    }
+
+    /**
+     * Set the size of the output video. If different from the captured one, the frames will be scaled.
+     * If the width/height is set to 0, the captured one will be used
+     * @param width     the width of the output video
+     * @param height    the height of the output video
+     */
+    void setOutputSize(int width, int height) {
+        checkGE("output width", width, 0);
+        checkGE("output height", height, 0);
+        checkEven("output width", width);
+        checkEven("output height", height);
+        output_width_ = width;
+        output_height_ = height;
+    }
+
+    /**
+     * Set the algorithm to use when scaling the video (FastBilinear by default)
+     * @param scaling_algorithm the algorithm to use
+     */
+    void setScalingAlgorithm(ScalingAlgorithm scaling_algorithm) { scaling_algorithm_ = scaling_algorithm; }
+
+    /**
+     * Set the number of horizontal slices converted in parallel when the frames are not scaled
+     * @param conversion_slices the number of slices (if 0, the number of available cores, if 1 the conversion is
+     * performed by a single thread)
+     */
+    void setConversionSlices(int conversion_slices) {
+        checkGE("conversion slices", conversion_slices, 0);
+        conversion_slices_ = conversion_slices;
+    }
+
+    /**
+     * Enable or disable the region-of-interest encoding (disabled by default, supported by H.264 only): the
+     * macroblocks changed since the previous frame are encoded with a higher quality than the static ones,
+     * lowering the bitrate of mostly static screen content at the same perceived quality
+     * @param roi_encoding true to drive the encoder quality with the screen activity
+     */
+    void setRoiEncoding(bool roi_encoding) { roi_encoding_ = roi_encoding; }
+
+    /**
+     * Enable or disable the content-adaptive encoding (disabled by default, supported by H.264 with constant
+     * quality rate control only): the frames are classified as idle desktop, text or video, and the CRF is
+     * raised for the idle and video scenes, switching it together with a forced keyframe (with renditions, all of
+     * them switch at the same frame, encoded with a CRF capped at their bitrate instead of the average bitrate)
+     * @param scene_adaptive_encoding true to adapt the encoder to the recorded content
+     */
+    void setSceneAdaptiveEncoding(bool scene_adaptive_encoding) { scene_adaptive_encoding_ = scene_adaptive_encoding; }
+
     [[nodiscard]] std::pair<int, int> getVideoSize() const { return std::make_pair(width_, height_); }
 
     [[nodiscard]] std::pair<int, int> getVideoOffset() const { return std::make_pair(offset_x_, offset_y_); }
 
     [[nodiscard]] int getFramerate() const { return framerate_; }
+
+    [[nodiscard]] int getCaptureInterval() const { return capture_interval_; }
+
+    [[nodiscard]] std::pair<int, int> getOutputSize() const { return std::make_pair(output_width_, output_height_); }
+
+    [[nodiscard]] ScalingAlgorithm getScalingAlgorithm() const { return scaling_algorithm_; }
+
+    [[nodiscard]] int getConversionSlices() const { return conversion_slices_; }
+
+    [[nodiscard]] bool getRoiEncoding() const { return roi_encoding_; }
+
+    [[nodiscard]] bool getSceneAdaptiveEncoding() const { return scene_adaptive_encoding_; }
 };
\ No newline at end of file
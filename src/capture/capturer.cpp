@@ -8,14 +8,20 @@
 #include <chrono>
 #include <cstdlib>
 #include <iostream>
-#include <optional>
 #include <sstream>
 #include <stdexcept>
 
+#include "encoder_process.h"
 #include "format/demuxer.h"
+#include "format/trace_reader.h"
+#include "format/trace_writer.h"
+#include "pipeline/encoder_options.h"
 #include "pipeline/pipeline.h"
+#include "pipeline/spool_transcoder.h"
+#include "utils/executor.h"
+#include "utils/flow_tracer.h"
 #include "utils/log_level_setter.h"
-#include "utils/thread_guard.h"
+#include "utils/thread_priority.h"
 
 #define THROW_TEST_EXCEPTION 0  // TO-DO: remove
 
@@ -46,8 +52,9 @@ static std::string generateInputDeviceName(const std::string &video_device, cons
                                            const VideoParameters &video_params) {
     std::stringstream device_name_ss;
 #if defined(WINDOWS)
-    if (!audio_device.empty()) device_name_ss << "audio=" << audio_device << ":";
-    device_name_ss << "video=" << video_device;
+    if (!audio_device.empty()) device_name_ss << "audio=" << audio_device;
+    if (!audio_device.empty() && !video_device.empty()) device_name_ss << ":";
+    if (!video_device.empty()) device_name_ss << "video=" << video_device;
 #elif defined(LINUX)
     if (!video_device.empty()) {
         device_name_ss << video_device;
@@ -99,13 +106,19 @@ static void setDisplayResolution(int framerate) {
 
 static std::map<std::string, std::string> generateDemuxerOptions(const VideoParameters &video_params) {
     std::map<std::string, std::string> demuxer_options;
+    const int capture_interval = video_params.getCaptureInterval();
 #ifdef WINDOWS
-    setDisplayResolution(video_params.getFramerate());
+    /* in time-lapse mode, grab at the lowest rate supported (the extra frames will be dropped by the capturer) */
+    setDisplayResolution(capture_interval ? 1 : video_params.getFramerate());
     demuxer_options.insert({"rtbufsize", "1024M"});
 #else
     {
         std::stringstream framerate_ss;
-        framerate_ss << video_params.getFramerate();
+        if (capture_interval) {  // in time-lapse mode, grab at the sampling rate
+            framerate_ss << 1000 << "/" << capture_interval;
+        } else {
+            framerate_ss << video_params.getFramerate();
+        }
         demuxer_options.insert({"framerate", framerate_ss.str()});
     }
 #ifdef LINUX
@@ -124,6 +137,20 @@ static std::map<std::string, std::string> generateDemuxerOptions(const VideoPara
     return demuxer_options;
 }
 
+static std::map<std::string, std::string> getSpoolEncoderOptions() {
+    std::map<std::string, std::string> enc_options;
+    /* FFV1 version 3: intra-only (every frame is a keyframe) and slice-threaded, with the cheapest coder */
+    enc_options.insert({"level", "3"});
+    enc_options.insert({"g", "1"});
+    enc_options.insert({"slices", "16"});
+    enc_options.insert({"coder", "0"});
+    enc_options.insert({"context", "0"});
+    enc_options.insert({"threads", "0"});
+    return enc_options;
+}
+
+static std::string getSpoolFileName(const std::string &output_file) { return output_file + ".spool.mkv"; }
+
 Capturer::Capturer(const bool verbose) : verbose_(verbose) {
     makeAvVerbose(verbose_);
     avdevice_register_all();
@@ -141,110 +168,486 @@ void Capturer::stopCapture() {
 }
 
 std::future<void> Capturer::start(const std::string &video_device, const std::string &audio_device,
-                                  const std::string &output_file, VideoParameters video_params) {
+                                  const std::string &output_file, VideoParameters video_params,
+                                  const EncoderParameters &encoder_params) {
     if (!stopped_) throw std::runtime_error("Recording already in progress");
 
     if (video_device.empty()) throw std::runtime_error("Video device not specified");
     if (output_file.empty()) throw std::runtime_error("Output file not specified");
 
-    bool capture_audio = !audio_device.empty();
+    /* a session left open by a previous recording may use different devices */
+    closeSession();
 
-    AVPixelFormat video_pix_fmt = AV_PIX_FMT_YUV420P;
-    AVCodecID video_codec_id = AV_CODEC_ID_H264;
-    AVCodecID audio_codec_id = AV_CODEC_ID_AAC;
+    bool capture_audio = !audio_device.empty();
+    if (capture_audio && video_params.getCaptureInterval())
+        throw std::runtime_error("Audio cannot be recorded in time-lapse mode");
+
+    spooling_ = compress_later_;
+    capture_interval_ = video_params.getCaptureInterval();
+    playback_framerate_ = video_params.getFramerate();
+    output_file_ = output_file;
+
+    if (spooling_ && !extra_tracks_.empty())
+        throw std::runtime_error("Extra tracks cannot be recorded in compress-later mode");
+    if (spooling_ && !renditions_.empty())
+        throw std::runtime_error("Renditions cannot be encoded in compress-later mode");
+    if (spooling_ && segment_duration_)
+        throw std::runtime_error("The segmented output is not supported in compress-later mode");
+    bool mix_audio = false;
+    for (const auto &track : extra_tracks_) {
+        if (track.audio && capture_interval_) throw std::runtime_error("Audio cannot be recorded in time-lapse mode");
+        mix_audio = mix_audio || track.mixed;
+    }
+    if (mix_audio && !encoder_executable_.empty())
+        throw std::runtime_error("Mixed audio is not supported by the encoder process");
+    if (mix_audio && !trace_file_.empty()) throw std::runtime_error("Mixed audio is not supported in trace mode");
+    if (session_mode_ && !trace_file_.empty())
+        throw std::runtime_error("The trace mode is not supported in session mode");
+    for (const auto &rendition : renditions_) {
+        if (session_mode_ && !rendition.getOutputFile().empty())
+            throw std::runtime_error("Renditions with their own output file are not supported in session mode");
+    }
+    if (silence_hold_time_ && !encoder_executable_.empty())
+        throw std::runtime_error("The silence detection is not supported by the encoder process");
+    if (!encoder_executable_.empty()) {
+        if (spooling_) throw std::runtime_error("The encoder process is not supported in compress-later mode");
+        if (session_mode_) throw std::runtime_error("The encoder process is not supported in session mode");
+        if (!renditions_.empty()) throw std::runtime_error("Renditions cannot be encoded by the encoder process");
+        if (segment_duration_)
+            throw std::runtime_error("The segmented output is not supported by the encoder process");
+        if (write_callback_) throw std::runtime_error("The write callback is not supported by the encoder process");
+    }
 
-    Demuxer demuxer;
-    std::optional<Demuxer> audio_demuxer;  // Linux only
+    h264_enc_options_ = getH264EncoderOptions(encoder_params);
+    if (segment_duration_ && encoder_params.getGopSize() < 0) {  // each segment must start with a keyframe
+        const int framerate = video_params.getFramerate() ? video_params.getFramerate() : 30;
+        h264_enc_options_["g"] = std::to_string(segment_duration_ * framerate);
+    }
 
-    { /* init Demuxer */
-        std::string device_name = generateInputDeviceName(video_device, audio_device, video_params);
-        std::map<std::string, std::string> demuxer_options = generateDemuxerOptions(video_params);
-        demuxer = Demuxer(getInputFormatName(), std::move(device_name), std::move(demuxer_options));
-        demuxer.openInput();
+    std::map<std::string, std::string> video_enc_options;
+    if (spooling_) {
+        video_enc_options = getSpoolEncoderOptions();
+    } else {
+        video_enc_options = h264_enc_options_;
+        /*
+         * Possible presets from fastest (and worst quality) to slowest (and best quality):
+         * ultrafast -> superfast -> veryfast -> faster -> fast -> medium
+         */
+        video_enc_options.insert({"preset", "ultrafast"});
     }
 
-    { /* init Pipeline */
-        bool async;
+    try {
+        /* the sources providing the video and audio tracks, with the parameters of their videos */
+        std::vector<std::pair<size_t, VideoParameters>> video_sources;
+        std::vector<size_t> audio_sources;
+        /* the sources mixed into the main audio track (including its own source), with their gains */
+        std::vector<std::pair<size_t, float>> mixed_sources;
+
+        { /* init Demuxers */
 #ifdef LINUX
-        video_params.setVideoOffset(0, 0);  // No cropping is performed on Linux
-        async = false;
+            /* the audio is captured by a separate (ALSA) device */
+            video_sources.emplace_back(openSource(video_device, "", video_params), video_params);
+            if (capture_audio) audio_sources.push_back(openSource("", audio_device, video_params));
 #else
-        async = capture_audio;
+            size_t main_source = openSource(video_device, audio_device, video_params);
+            video_sources.emplace_back(main_source, video_params);
+            if (capture_audio) audio_sources.push_back(main_source);
 #endif
-        /* init Pipeline */
-        pipeline_ = std::make_unique<Pipeline>(output_file, async);
+            if (mix_audio && capture_audio) {
+                mixed_sources.emplace_back(audio_sources.front(), audio_gain_);
+                audio_sources.erase(audio_sources.begin());
+            }
+            for (const auto &track : extra_tracks_) {
+                if (track.mixed) {
+                    mixed_sources.emplace_back(openSource("", track.device, track.video_params), track.gain);
+                } else if (track.audio) {
+                    audio_sources.push_back(openSource("", track.device, track.video_params));
+                } else {
+                    video_sources.emplace_back(openSource(track.device, "", track.video_params), track.video_params);
+                }
+            }
+        }
+
+        if (encoder_executable_.empty()) {
+            initPipeline(output_file, video_sources, audio_sources, mixed_sources, video_enc_options);
+        } else {
+            initEncoderProcess(output_file, video_sources, audio_sources, video_enc_options);
+        }
+
+        if (!trace_file_.empty()) {
+            /* the streams of the trace are the ones of the pipeline, in the same order */
+            std::vector<TraceWriter::Stream> trace_streams;
+            for (auto &[index, params] : video_sources) {
+                const Demuxer &demuxer = *sources_[index].demuxer;
+                trace_streams.push_back({demuxer.getStreamParams(av::MediaType::Video),
+                                         demuxer.getStreamTimeBase(av::MediaType::Video)});
+            }
+            for (auto index : audio_sources) {
+                const Demuxer &demuxer = *sources_[index].demuxer;
+                trace_streams.push_back({demuxer.getStreamParams(av::MediaType::Audio),
+                                         demuxer.getStreamTimeBase(av::MediaType::Audio)});
+            }
+            trace_writer_ = std::make_unique<TraceWriter>(trace_file_, trace_streams);
+        }
+        if (!flow_trace_file_.empty()) FlowTracer::start();
+    } catch (...) {
+        pipeline_.reset();
+        encoder_process_.reset();
+        sources_.clear();
+        trace_writer_.reset();
+        throw;
+    }
+
+    /* Print info about structures (if verbose) */
+    if (verbose_) {
+        std::cout << std::endl;
+        for (int i = 0; i < sources_.size(); i++) sources_[i].demuxer->printInfo(i);
+        if (pipeline_) pipeline_->printInfo();
+        std::cout << std::endl;
     }
 
-    pipeline_->initVideo(demuxer, video_codec_id, video_pix_fmt, video_params);
+    return startCapture();
+}
 
-    /* init audio structures, if necessary */
-    if (capture_audio) {
+void Capturer::initPipeline(const std::string &output_file,
+                            std::vector<std::pair<size_t, VideoParameters>> &video_sources,
+                            const std::vector<size_t> &audio_sources,
+                            const std::vector<std::pair<size_t, float>> &mixed_sources,
+                            const std::map<std::string, std::string> &video_enc_options) {
+    AVPixelFormat video_pix_fmt = AV_PIX_FMT_YUV420P;
+    AVCodecID video_codec_id = spooling_ ? AV_CODEC_ID_FFV1 : AV_CODEC_ID_H264;
+    AVCodecID audio_codec_id = spooling_ ? AV_CODEC_ID_PCM_S16LE : AV_CODEC_ID_AAC;
+
+    /* the capture threads only read packets (blocking on the devices), while the processing runs on the
+     * executor shared by all the capturers of the process, so that it doesn't oversubscribe the cores */
+    pipeline_ = std::make_unique<Pipeline>(spooling_ ? getSpoolFileName(output_file) : output_file, true,
+                                           segment_duration_);
+    /* the spooled PCM audio is cheap to encode, and compressed later */
+    if (silence_hold_time_ && !spooling_)
+        pipeline_->setSilenceDetection(silence_threshold_, static_cast<int64_t>(silence_hold_time_) * 1000);
+
+    /* one processing chain (and output stream) for each track, the video ones first */
+    {
+        /* the threads of the video encoders are started while opening them, inheriting the affinity */
+        ScopedThreadAffinity encoder_affinity(thread_params_.getEncoderCores());
+        for (auto &[index, params] : video_sources) {
 #ifdef LINUX
-        /* init audio demuxer and pipeline */
-        std::string audio_device_name = generateInputDeviceName("", audio_device, video_params);
-        audio_demuxer =
-            Demuxer(getInputFormatName(true), std::move(audio_device_name), std::map<std::string, std::string>());
-        audio_demuxer->openInput();
-        pipeline_->initAudio(*audio_demuxer, audio_codec_id);
-#else
-        pipeline_->initAudio(demuxer, audio_codec_id);
+            params.setVideoOffset(0, 0);  // No cropping is performed on Linux
 #endif
+            if (index == video_sources.front().first && !renditions_.empty()) {
+                sources_[index].video_stream =
+                    pipeline_->initVideoLadder(*sources_[index].demuxer, video_codec_id, video_pix_fmt, params,
+                                               renditions_, video_enc_options);
+            } else {
+                sources_[index].video_stream = pipeline_->initVideo(*sources_[index].demuxer, video_codec_id,
+                                                                    video_pix_fmt, params, video_enc_options);
+            }
+        }
+    }
+    if (!mixed_sources.empty()) {
+        /* the mix takes the place of the main audio track */
+        std::vector<Pipeline::AudioInput> inputs;
+        for (auto [index, gain] : mixed_sources) {
+            const Demuxer &demuxer = *sources_[index].demuxer;
+            inputs.push_back({demuxer.getStreamParams(av::MediaType::Audio),
+                              demuxer.getStreamTimeBase(av::MediaType::Audio), gain});
+        }
+        const std::vector<int> streams =
+            pipeline_->initAudioMix(inputs, audio_codec_id, std::map<std::string, std::string>());
+        for (size_t i = 0; i < mixed_sources.size(); i++) sources_[mixed_sources[i].first].audio_stream = streams[i];
+    }
+    for (auto index : audio_sources) {
+        sources_[index].audio_stream = pipeline_->initAudio(*sources_[index].demuxer, audio_codec_id,
+                                                            std::map<std::string, std::string>());
     }
 
+    if (max_interleave_bytes_)
+        pipeline_->setInterleaving(static_cast<int64_t>(max_interleave_delay_) * 1000, max_interleave_bytes_);
+    if (write_callback_) {
+        pipeline_->setWriteCallback([callback = write_callback_](const av::MediaType type, const int64_t pts) {
+            callback(type == av::MediaType::Video, pts);
+        });
+    }
+    if (!frame_export_.empty()) pipeline_->setFrameExport(frame_export_);
     pipeline_->initOutput();
+}
 
-    /* Print info about structures (if verbose) */
-    if (verbose_) {
-        std::cout << std::endl;
-        demuxer.printInfo();
+void Capturer::initEncoderProcess(const std::string &output_file,
+                                  const std::vector<std::pair<size_t, VideoParameters>> &video_sources,
+                                  const std::vector<size_t> &audio_sources,
+                                  const std::map<std::string, std::string> &video_enc_options) {
+    /* the streams of the ring are the ones of the output, in the same order as the pipeline ones */
+    std::vector<FrameRing::Stream> streams;
+    for (auto &[index, params] : video_sources) {
+        const Demuxer &demuxer = *sources_[index].demuxer;
+        sources_[index].video_stream = static_cast<int>(streams.size());
+        streams.push_back(
+            {demuxer.getStreamParams(av::MediaType::Video), demuxer.getStreamTimeBase(av::MediaType::Video)});
+    }
+    for (auto index : audio_sources) {
+        const Demuxer &demuxer = *sources_[index].demuxer;
+        sources_[index].audio_stream = static_cast<int>(streams.size());
+        streams.push_back(
+            {demuxer.getStreamParams(av::MediaType::Audio), demuxer.getStreamTimeBase(av::MediaType::Audio)});
+    }
+
+    VideoParameters video_params = video_sources.front().second;
 #ifdef LINUX
-        if (capture_audio) audio_demuxer.value().printInfo(1);
+    video_params.setVideoOffset(0, 0);  // No cropping is performed on Linux
 #endif
+    encoder_process_ = std::make_unique<EncoderProcess>(encoder_executable_, output_file, streams, video_params,
+                                                        video_enc_options,
+                                                        static_cast<int64_t>(max_interleave_delay_) * 1000,
+                                                        max_interleave_bytes_, frame_export_, verbose_);
+}
+
+size_t Capturer::openSource(const std::string &video_device, const std::string &audio_device,
+                             const VideoParameters &video_params) {
+    std::string device_name = generateInputDeviceName(video_device, audio_device, video_params);
+    std::map<std::string, std::string> demuxer_options;
+    if (!video_device.empty()) demuxer_options = generateDemuxerOptions(video_params);
+
+    sources_.emplace_back();
+    sources_.back().demuxer =
+        std::make_unique<Demuxer>(getInputFormatName(video_device.empty()), std::move(device_name),
+                                  std::move(demuxer_options));
+    sources_.back().demuxer->openInput();
+    return sources_.size() - 1;
+}
+
+void Capturer::addVideoTrack(const std::string &video_device, VideoParameters video_params) {
+    if (video_device.empty()) throw std::runtime_error("Video device not specified");
+    extra_tracks_.push_back({false, video_device, std::move(video_params)});
+}
+
+void Capturer::addAudioTrack(const std::string &audio_device) {
+    if (audio_device.empty()) throw std::runtime_error("Audio device not specified");
+    extra_tracks_.push_back({true, audio_device, VideoParameters()});
+}
+
+void Capturer::requestKeyframe() {
+    /* stop() can't close the session until the recording is marked as stopped, which requires the lock */
+    std::lock_guard lg(m_);
+    if (stopped_) throw std::runtime_error("Failed to request a keyframe: capturer is stopped");
+    if (!pipeline_) throw std::runtime_error("Failed to request a keyframe: not supported by the encoder process");
+    pipeline_->requestKeyframe();
+}
+
+void Capturer::addMixedAudio(const std::string &audio_device, const float gain) {
+    if (audio_device.empty()) throw std::runtime_error("Audio device not specified");
+    if (gain < 0) throw std::runtime_error("The audio gain can't be negative");
+    extra_tracks_.push_back({true, audio_device, VideoParameters(), true, gain});
+}
+
+void Capturer::setAudioGain(const float gain) {
+    if (gain < 0) throw std::runtime_error("The audio gain can't be negative");
+    audio_gain_ = gain;
+}
+
+void Capturer::setSilenceDetection(const int hold_time, const float threshold) {
+    if (hold_time < 0) throw std::runtime_error("The silence hold time can't be negative");
+    if (threshold > 0) throw std::runtime_error("The silence threshold can't be above 0 dBFS");
+    silence_hold_time_ = hold_time;
+    silence_threshold_ = threshold;
+}
+
+void Capturer::clearExtraTracks() { extra_tracks_.clear(); }
+
+void Capturer::setRenditions(std::vector<Rendition> renditions) { renditions_ = std::move(renditions); }
+
+void Capturer::setThreadParameters(ThreadParameters thread_params) {
+    thread_params_ = std::move(thread_params);
+    Executor::shared().setAffinity(thread_params_.getProcessingCores());
+}
+
+void Capturer::setInterleaving(const int max_delay, const size_t max_queued_bytes) {
+    if (max_delay < 0) throw std::runtime_error("The maximum interleaving delay can't be negative");
+    if (!max_queued_bytes) throw std::runtime_error("The maximum interleaving size must be > 0");
+    max_interleave_delay_ = max_delay;
+    max_interleave_bytes_ = max_queued_bytes;
+}
+
+void Capturer::setEncoderProcess(std::string executable) { encoder_executable_ = std::move(executable); }
+
+void Capturer::setFrameExport(std::string name) { frame_export_ = std::move(name); }
+
+void Capturer::setWriteCallback(std::function<void(bool, int64_t)> callback) {
+    write_callback_ = std::move(callback);
+}
+
+void Capturer::setTraceFile(std::string trace_file) { trace_file_ = std::move(trace_file); }
+
+void Capturer::setFlowTraceFile(std::string flow_trace_file) { flow_trace_file_ = std::move(flow_trace_file); }
+
+void Capturer::dumpFlowTrace(const std::string &file) const { FlowTracer::dump(file); }
+
+void Capturer::replayTrace(const std::string &trace_file, const std::string &output_file,
+                           VideoParameters video_params, const EncoderParameters &encoder_params, const bool paced) {
+    if (!stopped_) throw std::runtime_error("Recording already in progress");
+    if (output_file.empty()) throw std::runtime_error("Output file not specified");
+
+    TraceReader reader(trace_file);
+
+    /* when paced, the pipeline drops the video frames it can't keep up with, as while recording */
+    Pipeline pipeline(output_file, paced);
+    std::map<std::string, std::string> video_enc_options = getH264EncoderOptions(encoder_params);
+    video_enc_options.insert({"preset", "ultrafast"});
+#ifdef LINUX
+    video_params.setVideoOffset(0, 0);  // the area has been cropped by the device
+#endif
+    bool first_video = true;
+    for (int stream = 0; stream < reader.getNumStreams(); stream++) {
+        const AVCodecParameters *params = reader.getStreamParams(stream);
+        const AVRational time_base = reader.getStreamTimeBase(stream);
+        if (params->codec_type == AVMEDIA_TYPE_VIDEO) {
+            pipeline.initVideo(params, time_base, AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P,
+                               first_video ? video_params : VideoParameters(), video_enc_options);
+            first_video = false;
+        } else {
+            pipeline.initAudio(params, time_base, AV_CODEC_ID_AAC, std::map<std::string, std::string>());
+        }
+    }
+    if (max_interleave_bytes_)
+        pipeline.setInterleaving(static_cast<int64_t>(max_interleave_delay_) * 1000, max_interleave_bytes_);
+    pipeline.initOutput();
+
+    if (verbose_) {
+        std::cout << std::endl;
+        pipeline.printInfo();
+        std::cout << std::endl;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    while (true) {
+        auto [packet, stream, time] = reader.readPacket();
+        if (!packet) break;
+        if (paced) std::this_thread::sleep_until(start + std::chrono::microseconds(time));
+        pipeline.feed(std::move(packet), stream);
+    }
+    pipeline.terminate();
+    if (verbose_) pipeline.printStats();
+}
+
+void Capturer::setSegmentDuration(const int segment_duration) {
+    if (segment_duration < 0) throw std::runtime_error("The segment duration can't be negative");
+    segment_duration_ = segment_duration;
+}
+
+std::future<void> Capturer::restart(const std::string &output_file) {
+    if (!stopped_) throw std::runtime_error("Recording already in progress");
+    if (!pipeline_) throw std::runtime_error("No open session to restart");
+    if (output_file.empty()) throw std::runtime_error("Output file not specified");
+    if (!trace_file_.empty()) throw std::runtime_error("The trace mode is not supported in session mode");
+
+    for (auto &source : sources_) {
+        /* drop the data buffered while idle (or re-open the device, if the last recording was stopped while paused) */
+        if (source.demuxer->isInputOpen()) {
+            source.demuxer->flush();
+        } else {
+            source.demuxer->openInput();
+        }
+        /* skip the idle time as if the recording had been paused */
+        source.adjust_pts_offset = true;
+    }
+
+    output_file_ = output_file;
+    pipeline_->restart(spooling_ ? getSpoolFileName(output_file) : output_file);
+
+    if (verbose_) {
+        std::cout << std::endl;
         pipeline_->printInfo();
         std::cout << std::endl;
     }
 
+    return startCapture();
+}
+
+std::future<void> Capturer::startCapture() {
     std::promise<void> p;
     auto f = p.get_future();
 
-    {
-        /*
-         * To avoid having the status variable "stopped_" set to false even if the capturer thread fails to start,
-         * update it only once the capturer has been completely and successfully initialized.
-         * To avoid an immediate return from capture(), a lock on the mutex m_ must be acquired
-         */
+    /*
+     * To avoid having the status variable "stopped_" set to false even if the capturer thread fails to start,
+     * update it only once the capturer has been completely and successfully initialized.
+     * To avoid an immediate return from capture(), a lock on the mutex m_ must be acquired
+     */
 
-        std::lock_guard lg(m_);
-
-        capturer_ = std::thread(
-            [this, demuxer = std::move(demuxer), audio_demuxer = std::move(audio_demuxer), p = std::move(p)]() mutable {
-                try {
-                    if (audio_demuxer) {
-                        capture(demuxer, *audio_demuxer);
-                    } else {
-                        capture(demuxer);
-                    }
-                    p.set_value();
-                } catch (...) {
-                    p.set_exception(std::current_exception());
-                }
-            });
-        /* note that if audio_demuxer was not empty, it still contains a (now "empty") demuxer here */
+    std::lock_guard lg(m_);
 
-        paused_ = false;
-        stopped_ = false;  // set stopped_ to false only when everything is properly set-up
+    capturer_ = std::thread([this, p = std::move(p)]() mutable {
+        try {
+            capture();
+            p.set_value();
+        } catch (...) {
+            p.set_exception(std::current_exception());
+        }
+    });
 
-    }  // release the mutex, now the capturer[s] will enter in the main loop inside capture()
+    paused_ = false;
+    stopped_ = false;  // set stopped_ to false only when everything is properly set-up
 
-    return f;
+    return f;  // release the mutex, now the capturer[s] will enter in the main loop inside capture()
 }
 
 void Capturer::stop() {
     if (stopped_) throw std::runtime_error("Failed to stop the recording: capturer already stopped");
     stopCapture();
     if (capturer_.joinable()) capturer_.join();
-    pipeline_->terminate();
+    if (encoder_process_) {
+        /* wait for the encoder process to complete the output file */
+        auto encoder_process = std::move(encoder_process_);
+        encoder_process->terminate();
+    } else {
+        pipeline_->terminate();
+        if (verbose_) pipeline_->printStats();
+    }
+
+    if (spooling_) {
+        /* wait for the previous transcoding (if any) to avoid running several ones concurrently */
+        std::shared_future<void> previous;
+        if (!transcodings_.empty()) previous = transcodings_.back();
+        transcodings_.push_back(std::async(std::launch::async, [previous, spool_file = getSpoolFileName(output_file_),
+                                                                output_file = output_file_,
+                                                                enc_options = h264_enc_options_]() {
+                                    if (previous.valid()) previous.wait();
+                                    SpoolTranscoder(spool_file, output_file, 0, enc_options).run();
+                                }).share());
+    }
+
+    if (!session_mode_) closeSession();
+
+    if (trace_writer_) {
+        auto trace_writer = std::move(trace_writer_);
+        trace_writer->close();
+        if (trace_writer->getDroppedPackets() && verbose_) {
+            std::cerr << "WARNING: " << trace_writer->getDroppedPackets()
+                      << " packets dropped from the trace (the disk couldn't keep up)" << std::endl;
+        }
+    }
+    if (!flow_trace_file_.empty() && FlowTracer::enabled()) {
+        FlowTracer::stop();
+        FlowTracer::dump(flow_trace_file_);
+    }
+}
+
+void Capturer::setCompressLater(const bool compress_later) { compress_later_ = compress_later; }
+
+void Capturer::waitTranscoding() {
+    auto transcodings = std::move(transcodings_);
+    transcodings_.clear();
+    for (auto &transcoding : transcodings) transcoding.get();
+}
+
+void Capturer::setSessionMode(const bool session_mode) {
+    session_mode_ = session_mode;
+    if (!session_mode_ && stopped_) closeSession();
+}
+
+void Capturer::closeSession() {
+    if (!stopped_) throw std::runtime_error("Failed to close the session: recording in progress");
     pipeline_.reset();
+    encoder_process_.reset();
+    sources_.clear();
 }
 
 void Capturer::pause() {
@@ -263,41 +666,55 @@ void Capturer::resume() {
     cv_.notify_all();
 }
 
-void Capturer::capture(Demuxer &video_demuxer, Demuxer &audio_demuxer) {
-    std::thread audio_capturer;
-    std::exception_ptr e_ptr;
+void Capturer::capture() {
+    /* the first source is captured by this thread, each other one by its own thread */
+    std::vector<std::thread> capturers;
+    std::vector<std::exception_ptr> e_ptrs(sources_.size());
 
-    {
-        ThreadGuard tg(audio_capturer);
-
-        audio_capturer = std::thread(
-            [this, &e_ptr](Demuxer &audio_demuxer) {
+    try {
+        for (size_t i = 1; i < sources_.size(); i++) {
+            capturers.emplace_back([this, i, &e_ptrs]() {
                 try {
-                    capture(audio_demuxer);
+                    capture(sources_[i]);
                 } catch (...) {
                     stopCapture();
-                    e_ptr = std::current_exception();
+                    e_ptrs[i] = std::current_exception();
                 }
-            },
-            std::ref(audio_demuxer));
-
-        try {
-            capture(video_demuxer);
-        } catch (...) {
-            stopCapture();
-            throw;
+            });
         }
-    }  // join audio_capturer in any case
+        capture(sources_[0]);
+    } catch (...) {
+        stopCapture();
+        e_ptrs[0] = std::current_exception();
+    }
+
+    for (auto &capturer : capturers) capturer.join();  // join the other capturers in any case
 
-    if (e_ptr) std::rethrow_exception(e_ptr);
+    for (auto &e_ptr : e_ptrs) {
+        if (e_ptr) std::rethrow_exception(e_ptr);
+    }
 }
 
-void Capturer::capture(Demuxer &demuxer) {
+void Capturer::capture(Source &source) {
+    Demuxer &demuxer = *source.demuxer;
+    FlowTracer::setThreadName(source.video_stream >= 0 ? "capture video" : "capture audio");
+
+    /* the main audio is grabbed together with the video, except on Linux */
+    setThreadAffinity(source.video_stream >= 0 ? thread_params_.getVideoCaptureCores()
+                                               : thread_params_.getAudioCaptureCores());
+    if (thread_params_.getCapturePriority() != ThreadPriority::Normal &&
+        !setHighPriority(thread_params_.getCapturePriority() == ThreadPriority::RealTime) && verbose_)
+        std::cerr << "Failed to raise the priority of the capture thread, keeping the default one" << std::endl;
     bool after_pause;
-    int64_t last_pts = 0;
-    int64_t pts_offset = 0;
-    bool adjust_pts_offset = false;
     std::chrono::milliseconds sleep_interval(1);
+    /* in two-process mode the packets are only published to the encoder process, without waiting for it */
+    auto feed = [this](av::PacketUPtr packet, const int stream) {
+        if (encoder_process_) {
+            encoder_process_->feed(packet.get(), stream);
+        } else {
+            pipeline_->feed(std::move(packet), stream);
+        }
+    };
 
 #if THROW_TEST_EXCEPTION
     int counter = 0;
@@ -312,10 +729,14 @@ void Capturer::capture(Demuxer &demuxer) {
 #endif
             cv_.wait(ul, [this]() { return (!paused_ || stopped_); });
             if (stopped_) break;
+            /* in time-lapse mode, don't grab anything until the next sample is due (unless paused/stopped) */
+            if (capture_interval_ && !after_pause &&
+                cv_.wait_until(ul, source.next_sample_time, [this]() { return (paused_ || stopped_); }))
+                continue;
         }
 
         if (after_pause) {
-            adjust_pts_offset = true;
+            source.adjust_pts_offset = true;
 #ifdef MACOS
             demuxer.flush();
 #else
@@ -329,14 +750,43 @@ void Capturer::capture(Demuxer &demuxer) {
             continue;
         }
         if (!av::validMediaType(packet_type)) throw std::runtime_error("Invalid packet type received from demuxer");
+        const int stream = (packet_type == av::MediaType::Video) ? source.video_stream : source.audio_stream;
+        if (stream < 0) continue;  // the packet belongs to a track which isn't recorded
+
+        if (capture_interval_ && packet_type == av::MediaType::Video) {
+            const AVRational time_base = demuxer.getStreamTimeBase(packet_type);
+            /*
+             * drop the frames buffered by devices that can't grab at the sampling rate: the samples are taken on a
+             * grid of the sampling interval (with half an interval of tolerance for the jitter of the timestamps),
+             * so that the sampled position advances with the wall time instead of falling behind the buffered ones
+             */
+            int64_t interval = av_rescale_q(capture_interval_, av_make_q(1, 1000), time_base);
+            if (source.samples && packet->pts < source.next_sample_pts - interval / 2) continue;
+            /* start the grid from the first sample, or move it after a gap in the input (e.g. a pause) */
+            if (!source.samples || packet->pts - source.next_sample_pts > interval)
+                source.next_sample_pts = packet->pts;
+            source.next_sample_pts += interval;
+            /* synthesize the timestamps, so that each sample lasts a single frame at the playback framerate */
+            packet->pts = av_rescale_q(source.samples++, av_make_q(1, playback_framerate_), time_base);
+            packet->dts = packet->pts;
+            if (trace_writer_) trace_writer_->writePacket(packet.get(), stream);
+            feed(std::move(packet), stream);
+
+            auto now = std::chrono::steady_clock::now();
+            source.next_sample_time += std::chrono::milliseconds(capture_interval_);
+            if (source.next_sample_time < now)
+                source.next_sample_time = now + std::chrono::milliseconds(capture_interval_);
+            continue;
+        }
 
-        if (adjust_pts_offset) pts_offset += (packet->pts - last_pts);
-        last_pts = packet->pts;
-        if (adjust_pts_offset) {
-            adjust_pts_offset = false;
+        if (source.adjust_pts_offset) source.pts_offset += (packet->pts - source.last_pts);
+        source.last_pts = packet->pts;
+        if (source.adjust_pts_offset) {
+            source.adjust_pts_offset = false;
         } else {
-            packet->pts -= pts_offset;
-            pipeline_->feed(std::move(packet), packet_type);
+            packet->pts -= source.pts_offset;
+            if (trace_writer_) trace_writer_->writePacket(packet.get(), stream);
+            feed(std::move(packet), stream);
         }
 
 #if THROW_TEST_EXCEPTION
@@ -0,0 +1,153 @@
+/*
+ * The encoder process of the two-process mode (see Capturer::setEncoderProcess(), POSIX only): it attaches to the
+ * shared-memory ring inherited from the capture process, and runs the processing pipeline on the raw packets
+ * published in it until the capture closes the ring (or terminates).
+ * It's started by the capture process, with the options of the recording:
+ *
+ *     libcapture-encoder -f <ring_fd> -o <output_file> [-s <w>x<h>] [-p <x>,<y>] [-r <framerate>]
+ *                        [-z <output_w>x<output_h>] [-a <scaling>] [-l <slices>] [-i] [-c]
+ *                        [-d <interleave_delay_us> -b <interleave_bytes>] [-e <key>=<value>]... [-x <export_ring>]
+ *                        [-v]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "format/frame_ring.h"
+#include "pipeline/pipeline.h"
+#include "video_parameters.h"
+
+struct Options {
+    int ring_fd = -1;
+    std::string output_file;
+    VideoParameters video_params;
+    int64_t max_interleave_delay = 0;
+    size_t max_interleave_bytes = 0;
+    std::map<std::string, std::string> enc_options;
+    std::string frame_export;
+    bool verbose = false;
+};
+
+static std::pair<int, int> parsePair(const std::string &value, const char separator) {
+    const size_t pos = value.find(separator);
+    if (pos == std::string::npos) throw std::runtime_error("Wrong value: " + value);
+    return {std::stoi(value.substr(0, pos)), std::stoi(value.substr(pos + 1))};
+}
+
+static Options parseArgs(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-i") {
+            options.video_params.setRoiEncoding(true);
+            continue;
+        } else if (arg == "-c") {
+            options.video_params.setSceneAdaptiveEncoding(true);
+            continue;
+        } else if (arg == "-v") {
+            options.verbose = true;
+            continue;
+        }
+        if (i + 1 == argc) throw std::runtime_error("Wrong arguments");
+        std::string value(argv[++i]);
+        if (arg == "-f") {
+            options.ring_fd = std::stoi(value);
+        } else if (arg == "-o") {
+            options.output_file = value;
+        } else if (arg == "-s") {
+            auto [width, height] = parsePair(value, 'x');
+            options.video_params.setVideoSize(width, height);
+        } else if (arg == "-p") {
+            auto [offset_x, offset_y] = parsePair(value, ',');
+            options.video_params.setVideoOffset(offset_x, offset_y);
+        } else if (arg == "-r") {
+            options.video_params.setFramerate(std::stoi(value));
+        } else if (arg == "-z") {
+            auto [width, height] = parsePair(value, 'x');
+            options.video_params.setOutputSize(width, height);
+        } else if (arg == "-a") {
+            options.video_params.setScalingAlgorithm(static_cast<ScalingAlgorithm>(std::stoi(value)));
+        } else if (arg == "-l") {
+            options.video_params.setConversionSlices(std::stoi(value));
+        } else if (arg == "-d") {
+            options.max_interleave_delay = std::stoll(value);
+        } else if (arg == "-b") {
+            options.max_interleave_bytes = std::stoull(value);
+        } else if (arg == "-e") {
+            const size_t pos = value.find('=');
+            if (pos == std::string::npos) throw std::runtime_error("Wrong encoder option: " + value);
+            options.enc_options[value.substr(0, pos)] = value.substr(pos + 1);
+        } else if (arg == "-x") {
+            options.frame_export = value;
+        } else {
+            throw std::runtime_error("Unknown arg: " + arg);
+        }
+    }
+    if (options.ring_fd < 0 || options.output_file.empty()) throw std::runtime_error("Wrong arguments");
+    return options;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parseArgs(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << " -f <ring_fd> -o <output_file> [options]" << std::endl;
+        std::cerr << "(it's meant to be started by the capture process)" << std::endl;
+        return 1;
+    }
+
+    try {
+        av_log_set_level(options.verbose ? AV_LOG_VERBOSE : AV_LOG_ERROR);
+
+        /* declared before the pipeline, since the packets in process reference the slots of the ring */
+        FrameRing ring(options.ring_fd);
+        ring.attach();
+
+        /* real-time, as in the capture process: the video packets are dropped if the processing is late */
+        Pipeline pipeline(options.output_file, true);
+        bool first_video = true;
+        for (int stream = 0; stream < ring.getNumStreams(); stream++) {
+            const AVCodecParameters *params = ring.getStreamParams(stream);
+            const AVRational time_base = ring.getStreamTimeBase(stream);
+            if (params->codec_type == AVMEDIA_TYPE_VIDEO) {
+                pipeline.initVideo(params, time_base, AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P,
+                                   first_video ? options.video_params : VideoParameters(), options.enc_options);
+                first_video = false;
+            } else {
+                pipeline.initAudio(params, time_base, AV_CODEC_ID_AAC, std::map<std::string, std::string>());
+            }
+        }
+        if (options.max_interleave_bytes)
+            pipeline.setInterleaving(options.max_interleave_delay, options.max_interleave_bytes);
+        if (!options.frame_export.empty()) pipeline.setFrameExport(options.frame_export);
+        pipeline.initOutput();
+        if (options.verbose) pipeline.printInfo();
+
+        /* if the capture process dies without closing the ring, the output file is completed anyway */
+        const pid_t parent = getppid();
+        const std::chrono::milliseconds poll_interval(1);
+        while (true) {
+            auto [packet, stream] = ring.acquire();
+            if (packet) {
+                pipeline.feed(std::move(packet), stream);
+                continue;
+            }
+            if (ring.isClosed() || getppid() != parent) break;
+            std::this_thread::sleep_for(poll_interval);
+        }
+        pipeline.terminate();
+        if (options.verbose) pipeline.printStats();
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
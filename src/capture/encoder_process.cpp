@@ -0,0 +1,189 @@
+#include "encoder_process.h"
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef WINDOWS
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+static std::string errMsg(const std::string &msg) { return ("EncoderProcess: " + msg); }
+
+/* The file descriptor of the ring in the encoder process */
+static constexpr int ring_fd = 3;
+/* The number of raw packets the ring can hold (the consumer holds a few of them while processing them) */
+static constexpr uint32_t ring_slots = 16;
+/* How often the capture threads check whether the encoder process is still running */
+static constexpr std::chrono::milliseconds check_interval(100);
+/* How many times the encoder process is restarted before giving up (e.g. because of wrong options) */
+static constexpr int max_restarts = 5;
+/* How long the encoder process can take to complete the output file, once the ring is closed */
+static constexpr std::chrono::seconds terminate_timeout(30);
+/* How long the encoder process can take to exit once asked to, before being killed */
+static constexpr std::chrono::seconds kill_timeout(2);
+/* How often the exit of the encoder process is polled while waiting for it */
+static constexpr std::chrono::milliseconds wait_interval(10);
+
+/* The output file of the n-th restart of the encoder process, e.g. "rec.mp4" -> "rec.1.mp4" */
+static std::string getRestartFile(const std::string &output_file, const int restart) {
+    std::filesystem::path path(output_file);
+    path.replace_extension("." + std::to_string(restart) + path.extension().string());
+    return path.string();
+}
+
+#ifndef WINDOWS
+/**
+ * Wait for a child process to exit, without waiting longer than a timeout
+ * @param pid       the ID of the process
+ * @param status    the exit status of the process (if it exited)
+ * @param timeout   the maximum time to wait for the process
+ * @return true if the process exited, false if the timeout expired
+ */
+static bool waitProcess(const pid_t pid, int &status, const std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        const pid_t ret = waitpid(pid, &status, WNOHANG);
+        if (ret == pid) return true;
+        if (ret < 0) throw std::runtime_error(errMsg("failed to wait for the encoder process"));
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(wait_interval);
+    }
+}
+
+/**
+ * Stop a child process with SIGTERM, or SIGKILL if it doesn't exit in time, and reap it
+ * @param pid   the ID of the process
+ */
+static void killProcess(const pid_t pid) {
+    int status;
+    kill(pid, SIGTERM);
+    if (waitProcess(pid, status, kill_timeout)) return;
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);  // SIGKILL can't be ignored
+}
+#endif
+
+EncoderProcess::EncoderProcess(std::string executable, std::string output_file,
+                               const std::vector<FrameRing::Stream> &streams, const VideoParameters &video_params,
+                               const std::map<std::string, std::string> &video_enc_options,
+                               const int64_t max_interleave_delay, const size_t max_interleave_bytes,
+                               const std::string &frame_export, const bool verbose)
+    : executable_(std::move(executable)), output_file_(std::move(output_file)), verbose_(verbose) {
+#if defined(WINDOWS)
+    throw std::runtime_error(errMsg("the encoder process is not supported on Windows"));
+#else
+    ring_ = std::make_unique<FrameRing>("", streams, ring_slots);
+
+    args_ = {executable_, "-f", std::to_string(ring_fd)};
+    auto [width, height] = video_params.getVideoSize();
+    if (width && height) args_.insert(args_.end(), {"-s", std::to_string(width) + "x" + std::to_string(height)});
+    auto [offset_x, offset_y] = video_params.getVideoOffset();
+    if (offset_x || offset_y)
+        args_.insert(args_.end(), {"-p", std::to_string(offset_x) + "," + std::to_string(offset_y)});
+    if (video_params.getFramerate()) args_.insert(args_.end(), {"-r", std::to_string(video_params.getFramerate())});
+    auto [output_width, output_height] = video_params.getOutputSize();
+    if (output_width && output_height)
+        args_.insert(args_.end(), {"-z", std::to_string(output_width) + "x" + std::to_string(output_height)});
+    args_.insert(args_.end(), {"-a", std::to_string(static_cast<int>(video_params.getScalingAlgorithm()))});
+    args_.insert(args_.end(), {"-l", std::to_string(video_params.getConversionSlices())});
+    if (video_params.getRoiEncoding()) args_.emplace_back("-i");
+    if (video_params.getSceneAdaptiveEncoding()) args_.emplace_back("-c");
+    if (max_interleave_bytes) {
+        args_.insert(args_.end(), {"-d", std::to_string(max_interleave_delay)});
+        args_.insert(args_.end(), {"-b", std::to_string(max_interleave_bytes)});
+    }
+    for (const auto &[key, value] : video_enc_options) args_.insert(args_.end(), {"-e", key + "=" + value});
+    if (!frame_export.empty()) args_.insert(args_.end(), {"-x", frame_export});
+    if (verbose_) args_.emplace_back("-v");
+
+    spawn(output_file_);
+    next_check_ = std::chrono::steady_clock::now() + check_interval;
+#endif
+}
+
+EncoderProcess::~EncoderProcess() {
+#ifndef WINDOWS
+    if (pid_ > 0) killProcess(pid_);
+#endif
+}
+
+void EncoderProcess::spawn(const std::string &output_file) {
+#ifndef WINDOWS
+    std::vector<std::string> args = args_;
+    args.insert(args.end(), {"-o", output_file});
+    std::vector<char *> argv;
+    for (auto &arg : args) argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    /* the ring is passed at a well-known descriptor (dup2 clears the close-on-exec flag of the copy only) */
+    const int fd = fcntl(ring_->getFd(), F_DUPFD_CLOEXEC, ring_fd + 1);
+    if (fd < 0) throw std::runtime_error(errMsg("failed to duplicate the ring descriptor"));
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, ring_fd);
+    const int ret = posix_spawnp(&pid_, executable_.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fd);
+    if (ret) {
+        pid_ = -1;
+        throw std::runtime_error(errMsg("failed to start " + executable_));
+    }
+#endif
+}
+
+void EncoderProcess::checkProcess() {
+#ifndef WINDOWS
+    std::unique_lock ul(m_, std::try_to_lock);
+    if (!ul) return;  // already being checked by another capture thread
+    const auto now = std::chrono::steady_clock::now();
+    if (now < next_check_) return;
+    next_check_ = now + check_interval;
+
+    int status;
+    if (pid_ < 0 || waitpid(pid_, &status, WNOHANG) != pid_) return;
+    pid_ = -1;
+    if (restarts_ == max_restarts) {
+        /* the capture goes on without the encoder, the failure is reported by terminate() */
+        std::cerr << "The encoder process keeps failing, dropping the captured packets" << std::endl;
+        failed_ = true;
+        return;
+    }
+    /* the ring is taken over by the new process, without interrupting the capture */
+    const std::string output_file = getRestartFile(output_file_, ++restarts_);
+    std::cerr << "The encoder process terminated unexpectedly, restarting it on " << output_file << std::endl;
+    spawn(output_file);
+#endif
+}
+
+void EncoderProcess::feed(const AVPacket *packet, const int stream) {
+    if (failed_) return;
+    checkProcess();
+    ring_->write(packet, stream);  // dropped if the encoder is late, the capture never waits for it
+}
+
+void EncoderProcess::terminate() {
+#ifndef WINDOWS
+    std::lock_guard lg(m_);
+    ring_->close();
+    if (failed_) throw std::runtime_error(errMsg("the encoder process kept failing"));
+    if (pid_ < 0) throw std::runtime_error(errMsg("the encoder process is not running"));
+    int status;
+    const pid_t pid = pid_;
+    pid_ = -1;
+    if (!waitProcess(pid, status, terminate_timeout)) {
+        killProcess(pid);
+        throw std::runtime_error(errMsg("the encoder process did not complete the output file in time"));
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) throw std::runtime_error(errMsg("the encoder process failed"));
+    if (verbose_ && ring_->getDroppedPackets())
+        std::cout << "Packets dropped while the encoder was late: " << ring_->getDroppedPackets() << std::endl;
+#endif
+}
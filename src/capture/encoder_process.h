@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "format/frame_ring.h"
+#include "video_parameters.h"
+
+#ifndef WINDOWS
+#include <sys/types.h>
+#else
+using pid_t = int;
+#endif
+
+/**
+ * The encoder of the two-process mode: a child process (libcapture-encoder) running the processing pipeline on the
+ * raw packets published by the capture in a shared-memory ring, so that a crash or a stall of the encoding can't
+ * take down the capture. If the encoder process dies, it's restarted on a new output file, while the capture goes
+ * on (the packets captured in the meantime are dropped). If it keeps failing, the capture goes on without publishing
+ * the packets, and the failure is reported by terminate(). POSIX only
+ */
+class EncoderProcess {
+    std::string executable_;
+    std::string output_file_;
+    /* the arguments of the encoder process, except its output file */
+    std::vector<std::string> args_;
+    std::unique_ptr<FrameRing> ring_;
+    pid_t pid_ = -1;
+    int restarts_ = 0;
+    /* Whether the encoder process failed too many times, so that the packets are no longer published */
+    std::atomic<bool> failed_ = false;
+    bool verbose_;
+
+    /* Guards the checks of the encoder process, performed by the capture threads */
+    std::mutex m_;
+    std::chrono::steady_clock::time_point next_check_;
+
+    void spawn(const std::string &output_file);
+
+    /* Restart the encoder process on a new output file if it died */
+    void checkProcess();
+
+public:
+    /**
+     * Create the ring of the packets and start the encoder process
+     * @param executable        the path of the encoder executable (looked up in PATH if it's just a name)
+     * @param output_file       the output file of the encoder process
+     * @param streams           the captured streams, in the order of the output ones
+     * @param video_params      the parameters of the first video stream (the other ones are encoded at full size)
+     * @param video_enc_options the options of the video encoders
+     * @param max_interleave_delay  the maximum interleaving delay, in microseconds (if 0, the default is used)
+     * @param max_interleave_bytes  the maximum size of the packets waiting to be interleaved (if 0, the default)
+     * @param frame_export      the name of the ring the encoder process exports the video frames to (if empty,
+     * they aren't exported)
+     * @param verbose           true to make the encoder process verbose
+     */
+    EncoderProcess(std::string executable, std::string output_file, const std::vector<FrameRing::Stream> &streams,
+                   const VideoParameters &video_params, const std::map<std::string, std::string> &video_enc_options,
+                   int64_t max_interleave_delay, size_t max_interleave_bytes, const std::string &frame_export,
+                   bool verbose);
+
+    EncoderProcess(const EncoderProcess &) = delete;
+
+    /**
+     * Kill the encoder process, if terminate() has not been called
+     */
+    ~EncoderProcess();
+
+    EncoderProcess &operator=(const EncoderProcess &) = delete;
+
+    /**
+     * Pass a packet to the encoder process, without ever waiting for it (the packet is dropped if the encoder is
+     * late). Thread-safe, the packets of different streams can be fed by different threads
+     * @param packet    the packet to encode
+     * @param stream    the index of the stream of the packet
+     */
+    void feed(const AVPacket *packet, int stream);
+
+    /**
+     * Wait for the encoder process to encode the packets fed so far and to complete the output file (killing it
+     * if it takes longer than 30 seconds). If the encoder process failed, an exception will be thrown
+     */
+    void terminate();
+};
@@ -9,7 +9,10 @@ extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/time.h>
+#include <libswscale/swscale.h>
 }
 
 #include <array>
@@ -46,9 +49,11 @@ using FrameUPtr = std::unique_ptr<AVFrame, DeleterPP<av_frame_free>>;
 using InFormatContextUPtr = std::unique_ptr<AVFormatContext, DeleterPP<avformat_close_input>>;
 using FormatContextUPtr = std::unique_ptr<AVFormatContext, DeleterP<avformat_free_context>>;
 using CodecContextUPtr = std::unique_ptr<AVCodecContext, DeleterPP<avcodec_free_context>>;
+using CodecParametersUPtr = std::unique_ptr<AVCodecParameters, DeleterPP<avcodec_parameters_free>>;
 using FilterGraphUPtr = std::unique_ptr<AVFilterGraph, DeleterPP<avfilter_graph_free>>;
 using FilterInOutUPtr = std::unique_ptr<AVFilterInOut, DeleterPP<avfilter_inout_free>>;
 using DictionaryUPtr = std::unique_ptr<AVDictionary, DeleterPP<av_dict_free>>;
+using SwsContextUPtr = std::unique_ptr<SwsContext, DeleterP<sws_freeContext>>;
 
 inline DictionaryUPtr map2dict(const std::map<std::string, std::string> &map) {
     AVDictionary *dict = nullptr;
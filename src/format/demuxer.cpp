@@ -3,6 +3,8 @@
 #include <iostream>
 #include <stdexcept>
 
+#include "utils/flow_tracer.h"
+
 #define VERBOSE 0  // TO-DO: improve
 
 static std::string errMsg(const std::string &msg) { return ("Demuxer: " + msg); }
@@ -15,6 +17,7 @@ void swap(Demuxer &lhs, Demuxer &rhs) {
     std::swap(lhs.streams_[av::MediaType::Audio], rhs.streams_[av::MediaType::Audio]);
     std::swap(lhs.streams_[av::MediaType::Video], rhs.streams_[av::MediaType::Video]);
     std::swap(lhs.packet_, rhs.packet_);
+    std::swap(lhs.eof_, rhs.eof_);
 }
 
 Demuxer::Demuxer(const std::string &fmt_name, std::string device_name, std::map<std::string, std::string> options)
@@ -22,6 +25,10 @@ Demuxer::Demuxer(const std::string &fmt_name, std::string device_name, std::map<
     if (!fmt_) throw std::logic_error(errMsg("cannot find the input format '" + fmt_name + "'"));
 }
 
+Demuxer::Demuxer(std::string file_name) : device_name_(std::move(file_name)) {
+    if (device_name_.empty()) throw std::invalid_argument(errMsg("file name is empty"));
+}
+
 Demuxer::Demuxer(Demuxer &&other) noexcept { swap(*this, other); }
 
 Demuxer &Demuxer::operator=(Demuxer other) {
@@ -31,7 +38,8 @@ Demuxer &Demuxer::operator=(Demuxer other) {
 
 void Demuxer::openInput(const bool listing_devices) {
     if (fmt_ctx_) throw std::logic_error(errMsg("failed to open input device (input is already open)"));
-    if (!fmt_) throw std::logic_error(errMsg("input format is not set"));  // if the Demuxer was default-constructed
+    /* if the Demuxer was default-constructed (files have no format, but they always have a name) */
+    if (!fmt_ && device_name_.empty()) throw std::logic_error(errMsg("input format is not set"));
 
     {
         AVFormatContext *fmt_ctx = nullptr;
@@ -55,14 +63,14 @@ void Demuxer::openInput(const bool listing_devices) {
     if (avformat_find_stream_info(fmt_ctx_.get(), nullptr) < 0)
         throw std::runtime_error(errMsg("failed to find the input streams informations"));
 
-    for (int i = 0; i < fmt_ctx_->nb_streams; i++) {
-        const AVStream *stream = fmt_ctx_->streams[i];
-        if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            streams_[av::MediaType::Video] = stream;
-        } else if (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            streams_[av::MediaType::Audio] = stream;
-        }
-    }
+    /* the files may have several streams of a type, the packets of the other ones are skipped by readPacket() */
+    int video_index = av_find_best_stream(fmt_ctx_.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    /* a cover picture (e.g. of an audio file) is a single image, not a video */
+    if (video_index >= 0 && (fmt_ctx_->streams[video_index]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        video_index = -1;
+    if (video_index >= 0) streams_[av::MediaType::Video] = fmt_ctx_->streams[video_index];
+    int audio_index = av_find_best_stream(fmt_ctx_.get(), AVMEDIA_TYPE_AUDIO, -1, video_index, nullptr, 0);
+    if (audio_index >= 0) streams_[av::MediaType::Audio] = fmt_ctx_->streams[audio_index];
 }
 
 void Demuxer::closeInput() {
@@ -70,6 +78,7 @@ void Demuxer::closeInput() {
     fmt_ctx_.reset();
     streams_[av::MediaType::Video] = nullptr;
     streams_[av::MediaType::Audio] = nullptr;
+    eof_ = false;
 }
 
 void Demuxer::flush() {
@@ -80,6 +89,26 @@ void Demuxer::flush() {
 
 bool Demuxer::isInputOpen() const { return (fmt_ctx_ != nullptr); }
 
+void Demuxer::seek(const int64_t timestamp) {
+    if (!fmt_ctx_) throw std::logic_error(errMsg("failed to seek (input is not open)"));
+    if (av_seek_frame(fmt_ctx_.get(), -1, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+        throw std::runtime_error(errMsg("failed to seek the input"));
+    eof_ = false;
+}
+
+int64_t Demuxer::getDuration() const {
+    if (!fmt_ctx_) throw std::logic_error(errMsg("failed to get duration (input is not open)"));
+    return fmt_ctx_->duration;
+}
+
+bool Demuxer::reachedEof() const { return eof_; }
+
+bool Demuxer::hasStream(const av::MediaType stream_type) const {
+    if (!fmt_ctx_) throw std::logic_error(errMsg("failed to acess stream (input is not open)"));
+    if (!av::validMediaType(stream_type)) throw std::logic_error(errMsg("invalid stream_type received"));
+    return (streams_[stream_type] != nullptr);
+}
+
 const AVCodecParameters *Demuxer::getStreamParams(const av::MediaType stream_type) const {
     if (!fmt_ctx_) throw std::logic_error(errMsg("failed to acess stream (input is not open)"));
     if (!av::validMediaType(stream_type)) throw std::logic_error(errMsg("invalid stream_type received"));
@@ -104,17 +133,31 @@ std::pair<av::PacketUPtr, av::MediaType> Demuxer::readPacket() {
 
     auto packet_type = av::MediaType::None;
 
-    int ret = av_read_frame(fmt_ctx_.get(), packet_.get());
-    if (ret == AVERROR(EAGAIN)) return std::make_pair(nullptr, packet_type);
-    if (ret < 0) throw std::runtime_error(errMsg("failed to read a packet"));
+    FlowTracer::Scope scope("read");
+    while (packet_type == av::MediaType::None) {
+        int ret = av_read_frame(fmt_ctx_.get(), packet_.get());
+        if (ret == AVERROR(EAGAIN)) {
+            scope.cancel();
+            return std::make_pair(nullptr, packet_type);
+        }
+        if (ret == AVERROR_EOF) {
+            scope.cancel();
+            eof_ = true;
+            return std::make_pair(nullptr, packet_type);
+        }
+        if (ret < 0) throw std::runtime_error(errMsg("failed to read a packet"));
 
-    for (auto type : av::validMediaTypes) {
-        if (streams_[type] && packet_->stream_index == streams_[type]->index) {
-            packet_type = type;
-            break;
+        for (auto type : av::validMediaTypes) {
+            if (streams_[type] && packet_->stream_index == streams_[type]->index) {
+                packet_type = type;
+                break;
+            }
         }
+        /* skip the packets of the streams which aren't read (e.g. subtitles, timecodes or other audio tracks) */
+        if (packet_type == av::MediaType::None) av_packet_unref(packet_.get());
     }
-    if (packet_type == av::MediaType::None) throw std::runtime_error(errMsg("unknown packet stream index"));
+    scope.setData(packet_type == av::MediaType::Video ? "video" : "audio", packet_->stream_index, packet_->pts,
+                  packet_->size);
 
     return std::make_pair(std::move(packet_), packet_type);
 }
@@ -17,6 +17,7 @@ class Demuxer {
     std::map<std::string, std::string> options_;
     std::array<const AVStream *, av::MediaType::NumTypes> streams_{};
     av::PacketUPtr packet_;
+    bool eof_{};
 
     friend void swap(Demuxer &lhs, Demuxer &rhs);
 
@@ -31,6 +32,13 @@ public:
      */
     Demuxer(const std::string &fmt_name, std::string device_name, std::map<std::string, std::string> options);
 
+    /**
+     * Create a new demuxer reading from a media file, whose format will be probed when opening it
+     * (the input will be in a "closed" state)
+     * @param file_name the name of the file to open
+     */
+    explicit Demuxer(std::string file_name);
+
     Demuxer(const Demuxer &) = delete;
 
     Demuxer(Demuxer &&other) noexcept;
@@ -65,6 +73,31 @@ public:
      */
     [[nodiscard]] bool isInputOpen() const;
 
+    /**
+     * Seek the input to the last keyframe before the given timestamp (only meaningful for media files)
+     * @param timestamp the timestamp to seek to, in AV_TIME_BASE units
+     */
+    void seek(int64_t timestamp);
+
+    /**
+     * Get the duration of the input (only meaningful for media files)
+     * @return the duration of the input in AV_TIME_BASE units, AV_NOPTS_VALUE if unknown
+     */
+    [[nodiscard]] int64_t getDuration() const;
+
+    /**
+     * Whether the end of the input has been reached (only possible for media files)
+     * @return true if the last call to readPacket() reached the end of the input, false otherwise
+     */
+    [[nodiscard]] bool reachedEof() const;
+
+    /**
+     * Check whether the input contains a stream of the given type
+     * @param stream_type the type of data of the stream
+     * @return true if the stream is present, false otherwise
+     */
+    [[nodiscard]] bool hasStream(av::MediaType stream_type) const;
+
     /**
      * Access the stream parameters
      * @param stream_type the type of data of the stream
@@ -80,9 +113,10 @@ public:
     [[nodiscard]] AVRational getStreamTimeBase(av::MediaType stream_type) const;
 
     /**
-     * Read a packet from the input device and return it together with its type
+     * Read a packet from the input device and return it together with its type (only the best video and audio
+     * streams are read, the packets of the other ones are skipped)
      * @return a packet and its type if it was possible to read it, nullptr and a random meaningless type
-     * if there was nothing to read
+     * if there was nothing to read (or the end of the input has been reached)
      */
     std::pair<av::PacketUPtr, av::MediaType> readPacket();
 
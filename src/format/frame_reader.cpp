@@ -0,0 +1,28 @@
+#include "frame_reader.h"
+
+#include "format/frame_ring.h"
+
+FrameReader::FrameReader(const std::string &name) : ring_(std::make_unique<FrameRing>(name)) {}
+
+FrameReader::~FrameReader() = default;
+
+bool FrameReader::read(Frame &frame) {
+    FrameRing::SlotInfo info{};
+    if (!ring_->read(info, frame.data)) return false;
+
+    const AVCodecParameters *params = ring_->getStreamParams(info.stream);
+    const char *pixel_format = av_get_pix_fmt_name(static_cast<AVPixelFormat>(params->format));
+    frame.stream = info.stream;
+    frame.pixel_format = pixel_format ? pixel_format : "";
+    frame.width = params->width;
+    frame.height = params->height;
+    frame.timestamp = info.pts == AV_NOPTS_VALUE
+                          ? 0
+                          : av_rescale_q(info.pts, ring_->getStreamTimeBase(info.stream), AV_TIME_BASE_Q);
+    frame.sequence = info.seq;
+    return true;
+}
+
+bool FrameReader::isClosed() const { return ring_->isClosed(); }
+
+uint64_t FrameReader::getSkippedFrames() const { return ring_->getSkippedPackets(); }
@@ -0,0 +1,374 @@
+#include "frame_ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#ifndef WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::string errMsg(const std::string &msg) { return ("FrameRing: " + msg); }
+
+/* The minimum size of the packets a slot can hold (enough for the packets of the audio devices) */
+static constexpr size_t min_packet_size = 1024 * 1024;
+
+static size_t getMaxPacketSize(const std::vector<FrameRing::Stream> &streams) {
+    size_t max_packet_size = min_packet_size;
+    for (const auto &[params, time_base] : streams) {
+        if (params->codec_type != AVMEDIA_TYPE_VIDEO) continue;
+        /* the raw frames of the devices may have padded lines, the largest padding of the common formats is used */
+        const int size = av_image_get_buffer_size(static_cast<AVPixelFormat>(params->format), params->width,
+                                                  params->height, ring::slot_alignment);
+        if (size < 0) throw std::invalid_argument(errMsg("unsupported video stream (not a raw video?)"));
+        max_packet_size = std::max(max_packet_size, static_cast<size_t>(size));
+    }
+    return max_packet_size;
+}
+
+FrameRing::FrameRing(const std::string &name, const std::vector<Stream> &streams, const uint32_t num_slots)
+    : producer_(true) {
+    if (streams.empty()) throw std::invalid_argument(errMsg("no streams specified"));
+    if (!num_slots) throw std::invalid_argument(errMsg("the number of slots must be > 0"));
+    for (const auto &[params, time_base] : streams) {
+        if (!params) throw std::invalid_argument(errMsg("stream parameters not specified"));
+    }
+
+    const size_t max_packet_size = getMaxPacketSize(streams);
+    const uint64_t slot_data = ring::align(sizeof(ring::SlotHeader));
+    const uint64_t slot_size = ring::align(slot_data + max_packet_size + AV_INPUT_BUFFER_PADDING_SIZE);
+    const uint64_t slots_offset = ring::align(sizeof(ring::RingHeader) + streams.size() * sizeof(trace::StreamHeader));
+    const uint64_t total_size = slots_offset + num_slots * slot_size;
+
+#if defined(WINDOWS)
+    throw std::runtime_error(errMsg("shared-memory rings are not supported on Windows"));
+#else
+    if (!name.empty()) {
+        /* a ring left by a crashed producer is replaced (its observers keep their mapping of the old one) */
+        name_ = "/" + name;
+        shm_unlink(name_.c_str());
+        fd_ = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    } else {
+#if defined(LINUX)
+        fd_ = memfd_create("libcapture-ring", MFD_CLOEXEC);
+#else
+        /* no memfd: create a POSIX shared memory object with a unique name, and unlink it immediately */
+        static std::atomic<unsigned> counter{0};
+        const std::string tmp_name = "/libcapture-ring-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+        fd_ = shm_open(tmp_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd_ >= 0) shm_unlink(tmp_name.c_str());
+#endif
+    }
+    if (fd_ < 0) throw std::runtime_error(errMsg("failed to create the shared memory"));
+    if (ftruncate(fd_, static_cast<off_t>(total_size))) {
+        ::close(fd_);
+        if (!name_.empty()) shm_unlink(name_.c_str());
+        throw std::runtime_error(errMsg("failed to allocate the shared memory"));
+    }
+    map(total_size, true);
+#endif
+
+    /* the new memory is zero-filled, the atomics are initialized by constructing the headers in place */
+    header_ = new (data_) ring::RingHeader{};
+    std::memcpy(header_->magic, ring::magic, sizeof(header_->magic));
+    header_->version = ring::version;
+    header_->num_streams = static_cast<uint32_t>(streams.size());
+    header_->num_slots = num_slots;
+    header_->slot_size = slot_size;
+    header_->slot_data = slot_data;
+    header_->slots_offset = slots_offset;
+    header_->total_size = total_size;
+    auto *stream_headers = reinterpret_cast<trace::StreamHeader *>(data_ + sizeof(ring::RingHeader));
+    for (size_t i = 0; i < streams.size(); i++) {
+        stream_headers[i] = trace::toStreamHeader(streams[i].params, streams[i].time_base);
+        stream_headers[i].extradata_size = 0;  // raw streams have no extradata
+    }
+    for (uint32_t i = 0; i < num_slots; i++) new (data_ + slots_offset + i * slot_size) ring::SlotHeader{};
+
+    readStreams();
+}
+
+FrameRing::FrameRing(const int fd) : fd_(fd), producer_(false) {
+#if defined(WINDOWS)
+    throw std::runtime_error(errMsg("shared-memory rings are not supported on Windows"));
+#else
+    struct stat st {};
+    if (fstat(fd_, &st) || static_cast<size_t>(st.st_size) < sizeof(ring::RingHeader)) {
+        ::close(fd_);
+        throw std::runtime_error(errMsg("invalid ring file descriptor"));
+    }
+    map(static_cast<size_t>(st.st_size), true);
+    validate();
+#endif
+}
+
+FrameRing::FrameRing(const std::string &name) : producer_(false) {
+#if defined(WINDOWS)
+    throw std::runtime_error(errMsg("shared-memory rings are not supported on Windows"));
+#else
+    /* the observers only read the ring, they can't disturb the producer */
+    fd_ = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd_ < 0) throw std::runtime_error(errMsg("failed to open the ring " + name));
+    struct stat st {};
+    if (fstat(fd_, &st) || static_cast<size_t>(st.st_size) < sizeof(ring::RingHeader)) {
+        ::close(fd_);
+        throw std::runtime_error(errMsg("invalid ring " + name));
+    }
+    map(static_cast<size_t>(st.st_size), false);
+    validate();
+    /* start from the last packet published */
+    const uint64_t write_seq = header_->write_seq.load(std::memory_order_acquire);
+    next_seq_ = write_seq ? write_seq - 1 : 0;
+#endif
+}
+
+FrameRing::~FrameRing() {
+    /* let the producer reuse all the slots, instead of waiting for a consumer that is gone */
+    if (consumer_) header_->consumer_attached.store(0, std::memory_order_release);
+    if (producer_ && header_) header_->closed.store(1, std::memory_order_release);
+#ifndef WINDOWS
+    if (producer_ && !name_.empty()) shm_unlink(name_.c_str());
+#endif
+    unmap();
+}
+
+void FrameRing::map(const size_t size, const bool writable) {
+#ifndef WINDOWS
+    void *data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error(errMsg("failed to map the shared memory"));
+    }
+    data_ = static_cast<uint8_t *>(data);
+    size_ = size;
+#endif
+}
+
+void FrameRing::unmap() {
+#ifndef WINDOWS
+    if (data_) munmap(data_, size_);
+    if (fd_ >= 0) ::close(fd_);
+#endif
+    data_ = nullptr;
+    fd_ = -1;
+}
+
+void FrameRing::validate() {
+    header_ = reinterpret_cast<ring::RingHeader *>(data_);
+    if (std::memcmp(header_->magic, ring::magic, sizeof(header_->magic)) != 0 || header_->version != ring::version ||
+        header_->total_size != size_ || !header_->num_streams || !header_->num_slots ||
+        header_->slots_offset < sizeof(ring::RingHeader) + header_->num_streams * sizeof(trace::StreamHeader) ||
+        header_->slots_offset + header_->num_slots * header_->slot_size > size_) {
+        unmap();
+        throw std::runtime_error(errMsg("not a frame ring, or created by an incompatible version"));
+    }
+    readStreams();
+}
+
+void FrameRing::readStreams() {
+    const auto *stream_headers = reinterpret_cast<const trace::StreamHeader *>(data_ + sizeof(ring::RingHeader));
+    for (uint32_t i = 0; i < header_->num_streams; i++) {
+        params_.push_back(trace::fromStreamHeader(stream_headers[i], nullptr));
+        time_bases_.push_back(av_make_q(stream_headers[i].time_base_num, stream_headers[i].time_base_den));
+    }
+    max_packet_size_ = header_->slot_size - header_->slot_data - AV_INPUT_BUFFER_PADDING_SIZE;
+    released_.assign(header_->num_slots, false);
+}
+
+ring::SlotHeader *FrameRing::getSlot(const uint64_t seq) const {
+    return reinterpret_cast<ring::SlotHeader *>(data_ + header_->slots_offset +
+                                                (seq % header_->num_slots) * header_->slot_size);
+}
+
+int FrameRing::getNumStreams() const { return static_cast<int>(params_.size()); }
+
+const AVCodecParameters *FrameRing::getStreamParams(const int stream) const {
+    if (stream < 0 || stream >= params_.size()) throw std::out_of_range(errMsg("invalid stream index"));
+    return params_[stream].get();
+}
+
+AVRational FrameRing::getStreamTimeBase(const int stream) const {
+    if (stream < 0 || stream >= time_bases_.size()) throw std::out_of_range(errMsg("invalid stream index"));
+    return time_bases_[stream];
+}
+
+uint64_t FrameRing::getDroppedPackets() const { return header_->dropped.load(std::memory_order_relaxed); }
+
+ring::SlotHeader *FrameRing::beginWrite(const uint64_t seq, const int stream) {
+    if (header_->consumer_attached.load(std::memory_order_acquire) &&
+        seq - header_->read_seq.load(std::memory_order_acquire) >= header_->num_slots) {
+        header_->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    /* the sequence counter is odd while the slot is being written */
+    ring::SlotHeader *slot = getSlot(seq);
+    slot->seq.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->stream = static_cast<uint32_t>(stream);
+    return slot;
+}
+
+void FrameRing::endWrite(ring::SlotHeader *slot, const uint64_t seq) {
+    uint8_t *data = reinterpret_cast<uint8_t *>(slot) + header_->slot_data;
+    std::memset(data + slot->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    slot->seq.store(2 * (seq + 1), std::memory_order_release);
+    header_->write_seq.store(seq + 1, std::memory_order_release);
+}
+
+bool FrameRing::write(const AVPacket *packet, const int stream) {
+    if (!producer_) throw std::logic_error(errMsg("only the producer can write to the ring"));
+    if (!packet) throw std::invalid_argument(errMsg("packet not specified"));
+    if (stream < 0 || stream >= params_.size()) throw std::invalid_argument(errMsg("invalid stream index"));
+    if (packet->size > max_packet_size_) throw std::runtime_error(errMsg("packet larger than the ring slots"));
+
+    std::lock_guard lg(write_m_);
+    const uint64_t seq = header_->write_seq.load(std::memory_order_relaxed);
+    ring::SlotHeader *slot = beginWrite(seq, stream);
+    if (!slot) return false;
+    slot->size = static_cast<uint32_t>(packet->size);
+    slot->pts = packet->pts;
+    slot->dts = packet->dts;
+    slot->duration = packet->duration;
+    slot->flags = packet->flags;
+    std::memcpy(reinterpret_cast<uint8_t *>(slot) + header_->slot_data, packet->data, packet->size);
+    endWrite(slot, seq);
+    return true;
+}
+
+bool FrameRing::writeFrame(const AVFrame *frame, const int stream) {
+    if (!producer_) throw std::logic_error(errMsg("only the producer can write to the ring"));
+    if (!frame) throw std::invalid_argument(errMsg("frame not specified"));
+    if (stream < 0 || stream >= params_.size()) throw std::invalid_argument(errMsg("invalid stream index"));
+    const AVCodecParameters *params = params_[stream].get();
+    if (frame->format != params->format || frame->width != params->width || frame->height != params->height)
+        throw std::invalid_argument(errMsg("the frame doesn't match the format of its stream"));
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+    const int size = av_image_get_buffer_size(format, frame->width, frame->height, 1);
+    if (size < 0 || size > max_packet_size_) throw std::runtime_error(errMsg("frame larger than the ring slots"));
+
+    std::lock_guard lg(write_m_);
+    const uint64_t seq = header_->write_seq.load(std::memory_order_relaxed);
+    ring::SlotHeader *slot = beginWrite(seq, stream);
+    if (!slot) return false;
+    slot->size = static_cast<uint32_t>(size);
+    slot->pts = frame->pts;
+    slot->dts = frame->pts;
+    slot->duration = 0;
+    slot->flags = 0;
+    if (av_image_copy_to_buffer(reinterpret_cast<uint8_t *>(slot) + header_->slot_data, size, frame->data,
+                                frame->linesize, format, frame->width, frame->height, 1) < 0)
+        slot->size = 0;  // still published, to keep the sequence of the slots
+    endWrite(slot, seq);
+    return true;
+}
+
+void FrameRing::close() {
+    if (!producer_) throw std::logic_error(errMsg("only the producer can close the ring"));
+    header_->closed.store(1, std::memory_order_release);
+}
+
+void FrameRing::attach() {
+    if (producer_) throw std::logic_error(errMsg("the producer can't consume its own packets"));
+    std::lock_guard lg(consume_m_);
+    next_seq_ = header_->write_seq.load(std::memory_order_acquire);
+    header_->read_seq.store(next_seq_, std::memory_order_release);
+    header_->consumer_attached.store(1, std::memory_order_release);
+    released_.assign(header_->num_slots, false);
+    consumer_ = true;
+}
+
+std::pair<av::PacketUPtr, int> FrameRing::acquire() {
+    if (!consumer_) throw std::logic_error(errMsg("not attached to the ring"));
+
+    std::lock_guard lg(consume_m_);
+    if (next_seq_ == header_->write_seq.load(std::memory_order_acquire)) return {nullptr, -1};
+    const uint64_t seq = next_seq_++;
+    ring::SlotHeader *slot = getSlot(seq);
+    /* while a consumer is attached, the producer doesn't overwrite the slots it hasn't released */
+    if (slot->seq.load(std::memory_order_acquire) != 2 * (seq + 1) || slot->stream >= params_.size() ||
+        slot->size > max_packet_size_)
+        throw std::runtime_error(errMsg("corrupted slot"));
+
+    av::PacketUPtr packet(av_packet_alloc());
+    if (!packet) throw std::runtime_error(errMsg("failed to allocate a packet"));
+    uint8_t *data = reinterpret_cast<uint8_t *>(slot) + header_->slot_data;
+    /* the packet references the slot, which is released (in any thread) once the last reference is dropped */
+    packet->buf = av_buffer_create(data, static_cast<int>(slot->size) + AV_INPUT_BUFFER_PADDING_SIZE,
+                                   &FrameRing::releaseSlot, this, AV_BUFFER_FLAG_READONLY);
+    if (!packet->buf) throw std::runtime_error(errMsg("failed to reference a slot"));
+    packet->data = data;
+    packet->size = static_cast<int>(slot->size);
+    packet->pts = slot->pts;
+    packet->dts = slot->dts;
+    packet->duration = slot->duration;
+    packet->flags = slot->flags;
+    return {std::move(packet), static_cast<int>(slot->stream)};
+}
+
+void FrameRing::releaseSlot(void *opaque, uint8_t *data) {
+    auto *ring = static_cast<FrameRing *>(opaque);
+    const ring::RingHeader *header = ring->header_;
+    const auto slot = static_cast<size_t>((data - ring->data_ - header->slots_offset) / header->slot_size);
+
+    std::lock_guard lg(ring->consume_m_);
+    ring->released_[slot] = true;
+    /* the slots can be released out of order (e.g. audio before video), the producer gets them back in order */
+    uint64_t read_seq = ring->header_->read_seq.load(std::memory_order_relaxed);
+    while (read_seq < ring->next_seq_ && ring->released_[read_seq % header->num_slots]) {
+        ring->released_[read_seq % header->num_slots] = false;
+        read_seq++;
+    }
+    ring->header_->read_seq.store(read_seq, std::memory_order_release);
+}
+
+bool FrameRing::isClosed() const {
+    /* the packets are published before closing the ring, hence the check must be done in this order */
+    if (!header_->closed.load(std::memory_order_acquire)) return false;
+    std::lock_guard lg(consume_m_);
+    return next_seq_ == header_->write_seq.load(std::memory_order_acquire);
+}
+
+bool FrameRing::read(SlotInfo &info, std::vector<uint8_t> &data) {
+    if (producer_ || consumer_) throw std::logic_error(errMsg("only the observers can read the ring"));
+
+    while (true) {
+        const uint64_t write_seq = header_->write_seq.load(std::memory_order_acquire);
+        if (next_seq_ >= write_seq) return false;
+        /* the slots older than the capacity of the ring have been overwritten, skip to the last one */
+        if (write_seq - next_seq_ >= header_->num_slots) {
+            skipped_ += write_seq - 1 - next_seq_;
+            next_seq_ = write_seq - 1;
+        }
+        const uint64_t seq = next_seq_++;
+
+        /* seqlock read: the copy is valid only if the slot hasn't been rewritten meanwhile */
+        const ring::SlotHeader *slot = getSlot(seq);
+        if (slot->seq.load(std::memory_order_acquire) != 2 * (seq + 1)) {
+            skipped_++;
+            continue;
+        }
+        info.stream = static_cast<int>(slot->stream);
+        info.pts = slot->pts;
+        info.dts = slot->dts;
+        info.duration = slot->duration;
+        info.flags = slot->flags;
+        info.seq = seq;
+        const size_t size = std::min<size_t>(slot->size, max_packet_size_);
+        data.resize(size);
+        std::memcpy(data.data(), reinterpret_cast<const uint8_t *>(slot) + header_->slot_data, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) != 2 * (seq + 1) || info.stream >= params_.size()) {
+            skipped_++;
+            continue;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/common.h"
+#include "frame_ring_format.h"
+
+/**
+ * Lock-free ring of raw packets or frames in shared memory, published by a single producer process:
+ *  - to a consumer process (e.g. the encoder of the capture), without copying them again on the consumer side:
+ *    the packets it acquires reference the slots of the ring, which are released when the last reference is dropped
+ *  - to any number of observer processes (e.g. other tools of the host reading the captured frames), which copy
+ *    the packets out of the ring, skipping the ones overwritten before they could read them
+ * The producer never waits for the readers: if all the slots are still in use by the consumer the packet is
+ * dropped, and while no consumer is attached the oldest slots are overwritten. POSIX only (the anonymous rings are
+ * memfds on Linux, the named ones POSIX shared memory objects)
+ */
+class FrameRing {
+    int fd_ = -1;
+    uint8_t *data_{};
+    size_t size_{};
+    ring::RingHeader *header_{};
+    /* the name of the shared memory object, unlinked by the producer (empty if anonymous) */
+    std::string name_;
+    bool producer_;
+    bool consumer_{};
+    std::vector<av::CodecParametersUPtr> params_;
+    std::vector<AVRational> time_bases_;
+    size_t max_packet_size_{};
+
+    /* Serializes the producer threads (e.g. the video and audio capture ones) */
+    std::mutex write_m_;
+
+    /* The state of the consumer, guarded by consume_m_ (the slots are released by the processing threads) */
+    mutable std::mutex consume_m_;
+    uint64_t next_seq_{};
+    std::vector<bool> released_;
+
+    /* The packets skipped by an observer, because they were overwritten before it could read them */
+    uint64_t skipped_{};
+
+    void map(size_t size, bool writable);
+
+    void validate();
+
+    void unmap();
+
+    void readStreams();
+
+    [[nodiscard]] ring::SlotHeader *getSlot(uint64_t seq) const;
+
+    /* Start writing the next slot, with write_m_ held (nullptr if it's still in use by the consumer) */
+    ring::SlotHeader *beginWrite(uint64_t seq, int stream);
+
+    /* Publish the slot written after beginWrite() */
+    void endWrite(ring::SlotHeader *slot, uint64_t seq);
+
+    static void releaseSlot(void *opaque, uint8_t *data);
+
+public:
+    /* The parameters of a stream of the ring */
+    struct Stream {
+        const AVCodecParameters *params;
+        AVRational time_base;
+    };
+
+    /* The description of a packet copied out of the ring by an observer */
+    struct SlotInfo {
+        int stream;
+        int64_t pts;
+        int64_t dts;
+        int64_t duration;
+        int flags;
+        /* the sequence number of the packet (the packets skipped by the observer leave gaps) */
+        uint64_t seq;
+    };
+
+    /**
+     * Create a new ring, either anonymous (its file descriptor can be inherited by the consumer process) or named,
+     * so that other processes can open it by name (replacing a previous ring with the same name, if any).
+     * The slots are big enough for the raw frames of the video streams and for the audio packets
+     * @param name      the name of the ring (if empty, the ring is anonymous)
+     * @param streams   the streams whose packets will be passed through the ring
+     * @param num_slots the number of packets the ring can hold
+     */
+    FrameRing(const std::string &name, const std::vector<Stream> &streams, uint32_t num_slots);
+
+    /**
+     * Open a ring created by another process, as its consumer
+     * @param fd the file descriptor of the ring, which will be owned by this object
+     */
+    explicit FrameRing(int fd);
+
+    /**
+     * Open a named ring created by another process, as an observer
+     * @param name the name of the ring
+     */
+    explicit FrameRing(const std::string &name);
+
+    FrameRing(const FrameRing &) = delete;
+
+    /**
+     * Unmap the ring (closing it and unlinking its name, for the producer).
+     * WARNING: the packets acquired from the ring must be released before destroying it
+     */
+    ~FrameRing();
+
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    [[nodiscard]] int getFd() const { return fd_; }
+
+    [[nodiscard]] int getNumStreams() const;
+
+    [[nodiscard]] const AVCodecParameters *getStreamParams(int stream) const;
+
+    [[nodiscard]] AVRational getStreamTimeBase(int stream) const;
+
+    /**
+     * Get the number of packets dropped by the producer so far, because the consumer wasn't keeping up
+     * @return the number of dropped packets
+     */
+    [[nodiscard]] uint64_t getDroppedPackets() const;
+
+    /**
+     * Publish a packet (producer only). Thread-safe, the packets of different streams can be written by
+     * different threads
+     * @param packet    the packet to publish
+     * @param stream    the index of the stream of the packet
+     * @return true if the packet has been published, false if it's been dropped because the consumer is late
+     */
+    bool write(const AVPacket *packet, int stream);
+
+    /**
+     * Publish a video frame, with its planes packed one after the other without padding (producer only)
+     * @param frame     the frame to publish, whose format and size must be the ones of its stream
+     * @param stream    the index of the stream of the frame
+     * @return true if the frame has been published, false if it's been dropped because the consumer is late
+     * @see write()
+     */
+    bool writeFrame(const AVFrame *frame, int stream);
+
+    /**
+     * Tell the consumer that no more packets will be published (producer only)
+     */
+    void close();
+
+    /**
+     * Attach to the ring as its consumer, starting from the next packet published. A consumer attaching after a
+     * previous one died takes over its slots
+     */
+    void attach();
+
+    /**
+     * Get the next packet published, without copying it (consumer only)
+     * @return the packet, referencing the memory of its slot, and the index of its stream
+     * (nullptr and -1 if no packet is available)
+     */
+    std::pair<av::PacketUPtr, int> acquire();
+
+    /**
+     * Whether the producer closed the ring and all the packets have been acquired or read (consumer and observers)
+     * @return true if no more packets will be available
+     */
+    [[nodiscard]] bool isClosed() const;
+
+    /**
+     * Copy the next packet published out of the ring (observer only). If the observer lags more than the capacity
+     * of the ring behind the producer, it skips to the last packet published
+     * @param info  filled with the description of the packet
+     * @param data  filled with the data of the packet
+     * @return true if a packet has been read, false if no new packet is available
+     */
+    bool read(SlotInfo &info, std::vector<uint8_t> &data);
+
+    /**
+     * Get the number of packets skipped so far by the observer, because they had been overwritten
+     * @return the number of skipped packets
+     */
+    [[nodiscard]] uint64_t getSkippedPackets() const { return skipped_; }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "trace_format.h"
+
+/*
+ * Layout of the shared-memory frame rings, through which raw packets are passed between processes.
+ * The mapping is shared by processes built from the same sources, hence it's in native byte order.
+ *
+ *   RingHeader
+ *   StreamHeader, num_streams times (without extradata)
+ *   (padding to slot_alignment)
+ *   SlotHeader + data + padding, num_slots times (each slot_size bytes, starting at slots_offset)
+ *
+ * The packets are written by a single producer, the n-th one (from 0) into slot n % num_slots. Each slot is
+ * guarded by a sequence counter, which is odd while the slot is being written and 2 * (n + 1) once the n-th packet
+ * is published, so that readers can detect a slot overwritten while they're reading it.
+ */
+
+namespace ring {
+
+constexpr char magic[8] = {'L', 'C', 'R', 'I', 'N', 'G', '\0', '\0'};
+constexpr uint32_t version = 1;
+/* The alignment of the slots and of their data (a cache line, and enough for any SIMD load of the frames) */
+constexpr uint64_t slot_alignment = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the frame rings require lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the frame rings require lock-free 32-bit atomics");
+
+struct RingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_streams;
+    uint32_t num_slots;
+    uint32_t reserved;
+    uint64_t slot_size;     // the size of a slot, header included
+    uint64_t slot_data;     // the offset of the data within a slot
+    uint64_t slots_offset;  // the offset of the first slot from the start of the ring
+    uint64_t total_size;
+
+    /* the state of the producer, on its own cache line */
+    alignas(64) std::atomic<uint64_t> write_seq;  // the number of packets published so far
+    std::atomic<uint64_t> dropped;                // the packets dropped because the consumer wasn't keeping up
+    std::atomic<uint32_t> closed;                 // set once the producer won't publish any more packets
+
+    /* the state of the consumer (if any), on its own cache line */
+    alignas(64) std::atomic<uint64_t> read_seq;  // the packets before it have been consumed, their slots are free
+    std::atomic<uint32_t> consumer_attached;     // while set, the producer doesn't overwrite unconsumed slots
+};
+
+struct SlotHeader {
+    std::atomic<uint64_t> seq;
+    uint32_t stream;
+    uint32_t size;
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+    int32_t flags;
+    uint32_t reserved;
+};
+
+/* Round a size up to the alignment of the slots */
+constexpr uint64_t align(uint64_t size) { return (size + slot_alignment - 1) / slot_alignment * slot_alignment; }
+
+}  // namespace ring
@@ -0,0 +1,69 @@
+#include "interleaver.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static std::string errMsg(const std::string &msg) { return ("Interleaver: " + msg); }
+
+Interleaver::Interleaver(const int num_streams, const int64_t max_delta, const size_t max_bytes)
+    : queues_(num_streams), max_delta_(max_delta), max_bytes_(max_bytes) {
+    if (num_streams <= 0) throw std::invalid_argument(errMsg("number of streams must be > 0"));
+    if (max_delta_ < 0) throw std::invalid_argument(errMsg("maximum delta must be >= 0"));
+}
+
+void Interleaver::push(av::PacketUPtr packet, const int stream, int64_t ts) {
+    if (!packet) throw std::invalid_argument(errMsg("packet not specified"));
+    if (stream < 0 || stream >= static_cast<int>(queues_.size()))
+        throw std::invalid_argument(errMsg("invalid stream index"));
+
+    /* a packet without timestamps is written after the ones of its stream, as soon as possible */
+    if (ts == AV_NOPTS_VALUE) ts = queues_[stream].empty() ? newest_ts_ : queues_[stream].back().ts;
+    if (ts == AV_NOPTS_VALUE) ts = 0;
+    if (newest_ts_ == AV_NOPTS_VALUE || ts > newest_ts_) newest_ts_ = ts;
+
+    stats_.queued_packets++;
+    stats_.queued_bytes += packet->size;
+    stats_.max_queued_packets = std::max(stats_.max_queued_packets, stats_.queued_packets);
+    stats_.max_queued_bytes = std::max(stats_.max_queued_bytes, stats_.queued_bytes);
+    queues_[stream].push_back({std::move(packet), ts});
+}
+
+int Interleaver::getOldestStream() const {
+    int oldest = -1;
+    for (int i = 0; i < static_cast<int>(queues_.size()); i++) {
+        if (!queues_[i].empty() && (oldest < 0 || queues_[i].front().ts < queues_[oldest].front().ts)) oldest = i;
+    }
+    return oldest;
+}
+
+std::pair<av::PacketUPtr, int> Interleaver::take(const int stream) {
+    av::PacketUPtr packet = std::move(queues_[stream].front().packet);
+    queues_[stream].pop_front();
+    stats_.queued_packets--;
+    stats_.queued_bytes -= packet->size;
+    return {std::move(packet), stream};
+}
+
+std::pair<av::PacketUPtr, int> Interleaver::pop() {
+    const int oldest = getOldestStream();
+    if (oldest < 0) return {nullptr, -1};
+
+    const bool all_queued =
+        std::none_of(queues_.begin(), queues_.end(), [](const std::deque<Entry> &queue) { return queue.empty(); });
+    if (all_queued) return take(oldest);
+
+    /* a stream is late: wait for it only within the limits */
+    if (newest_ts_ - queues_[oldest].front().ts > max_delta_ || stats_.queued_bytes > max_bytes_) {
+        stats_.forced_packets++;
+        return take(oldest);
+    }
+    return {nullptr, -1};
+}
+
+std::pair<av::PacketUPtr, int> Interleaver::popOldest() {
+    const int oldest = getOldestStream();
+    if (oldest < 0) return {nullptr, -1};
+    return take(oldest);
+}
+
+const Interleaver::Stats &Interleaver::getStats() const { return stats_; }
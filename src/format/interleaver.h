@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "common/common.h"
+
+/*
+ * Interleaving of the packets of several streams by increasing timestamp, with bounded latency and memory:
+ * differently from av_interleaved_write_frame(), which waits for all the streams to advance, the queued packets
+ * are released when they get too old with respect to the newest one, or when they take too much memory, so
+ * that a stalled stream can't make the others pile up
+ */
+class Interleaver {
+public:
+    struct Stats {
+        size_t queued_packets = 0;
+        size_t queued_bytes = 0;
+        size_t max_queued_packets = 0;
+        size_t max_queued_bytes = 0;
+        /* the packets released before the other streams caught up with them */
+        int64_t forced_packets = 0;
+    };
+
+private:
+    struct Entry {
+        av::PacketUPtr packet;
+        int64_t ts;
+    };
+
+    std::vector<std::deque<Entry>> queues_;
+    int64_t max_delta_;
+    size_t max_bytes_;
+    /* The newest timestamp received, in AV_TIME_BASE units */
+    int64_t newest_ts_ = AV_NOPTS_VALUE;
+    Stats stats_;
+
+    /* Get the stream whose first queued packet is the oldest one (-1 if all the queues are empty) */
+    [[nodiscard]] int getOldestStream() const;
+
+    /* Remove the first queued packet of a stream */
+    std::pair<av::PacketUPtr, int> take(int stream);
+
+public:
+    /**
+     * Create a new interleaver
+     * @param num_streams   the number of streams
+     * @param max_delta     the maximum time a packet waits for the other streams, in AV_TIME_BASE units (measured
+     * on the timestamps, with respect to the newest packet received)
+     * @param max_bytes     the maximum size of the queued packets
+     */
+    Interleaver(int num_streams, int64_t max_delta, size_t max_bytes);
+
+    /**
+     * Queue a packet
+     * @param packet    the packet
+     * @param stream    the index of the stream of the packet
+     * @param ts        the decoding timestamp of the packet, in AV_TIME_BASE units (AV_NOPTS_VALUE if unknown)
+     */
+    void push(av::PacketUPtr packet, int stream, int64_t ts);
+
+    /**
+     * Get the next packet to write, if any is ready: the oldest one, once every stream has a queued packet or
+     * once the limits have been exceeded
+     * @return the packet and the index of its stream, nullptr if no packet is ready
+     */
+    std::pair<av::PacketUPtr, int> pop();
+
+    /**
+     * Get the oldest queued packet, regardless of the other streams (e.g. to drain the queues at the end)
+     * @return the packet and the index of its stream, nullptr if the queues are empty
+     */
+    std::pair<av::PacketUPtr, int> popOldest();
+
+    /**
+     * Get the current and maximum depth of the queues
+     * @return the queues statistics
+     */
+    [[nodiscard]] const Stats &getStats() const;
+};
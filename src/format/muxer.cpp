@@ -1,13 +1,29 @@
 #include "muxer.h"
 
+#include <filesystem>
 #include <stdexcept>
+#include <tuple>
+
+#include "utils/flow_tracer.h"
 
 static std::string errMsg(const std::string &msg) { return ("Muxer: " + msg); }
 
-Muxer::Muxer(std::string filename) : filename_(std::move(filename)) {
+/* The tolerance on the duration of the segments, for the rounding of the timestamps rescaled by the encoders */
+static constexpr int64_t segment_tolerance = AV_TIME_BASE / 1000;
+
+Muxer::Muxer(std::string filename, const int segment_duration)
+    : filename_(std::move(filename)), segment_duration_(segment_duration) {
+    if (segment_duration_ < 0) throw std::invalid_argument(errMsg("the segment duration can't be negative"));
+
     AVFormatContext *fmt_ctx = nullptr;
-    if (avformat_alloc_output_context2(&fmt_ctx, nullptr, nullptr, filename_.c_str()) < 0)
-        throw std::runtime_error(errMsg("failed to allocate output context for file '" + filename_ + "'"));
+    if (segment_duration_) {
+        std::string segment_file = (std::filesystem::path(filename_).parent_path() / getSegmentName(0)).string();
+        if (avformat_alloc_output_context2(&fmt_ctx, nullptr, "mpegts", segment_file.c_str()) < 0)
+            throw std::runtime_error(errMsg("failed to allocate output context for file '" + segment_file + "'"));
+    } else {
+        if (avformat_alloc_output_context2(&fmt_ctx, nullptr, nullptr, filename_.c_str()) < 0)
+            throw std::runtime_error(errMsg("failed to allocate output context for file '" + filename_ + "'"));
+    }
     fmt_ctx_ = av::FormatContextUPtr(fmt_ctx);
 }
 
@@ -19,69 +35,199 @@ Muxer::~Muxer() {
     }
 }
 
-void Muxer::addStream(const AVCodecContext *enc_ctx) {
-    if (!enc_ctx) throw std::invalid_argument(errMsg("received encoder context is NULL"));
-
-    av::MediaType type;
-    if (enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-        type = av::MediaType::Video;
-    } else if (enc_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-        type = av::MediaType::Audio;
-    } else {
-        throw std::invalid_argument(errMsg("received encoder context is of unknown media type"));
-    }
-
+AVStream *Muxer::newStream(const AVMediaType codec_type, const AVRational time_base) {
+    if (codec_type != AVMEDIA_TYPE_VIDEO && codec_type != AVMEDIA_TYPE_AUDIO)
+        throw std::invalid_argument(errMsg("received stream is of unknown media type"));
     if (file_inited_) throw std::logic_error(errMsg("cannot add a new stream, file has already been initialized"));
-    if (streams_[type]) throw std::logic_error(errMsg("stream of specified type already present"));
 
-    const AVStream *stream = avformat_new_stream(fmt_ctx_.get(), nullptr);
+    AVStream *stream = avformat_new_stream(fmt_ctx_.get(), nullptr);
     if (!stream) throw std::runtime_error(errMsg("failed to create a new stream"));
 
+    streams_.push_back(stream);
+    encoders_time_bases_.push_back(time_base);
+    return stream;
+}
+
+int Muxer::addStream(const AVCodecContext *enc_ctx) {
+    if (!enc_ctx) throw std::invalid_argument(errMsg("received encoder context is NULL"));
+
+    AVStream *stream = newStream(enc_ctx->codec_type, enc_ctx->time_base);
     if (avcodec_parameters_from_context(stream->codecpar, enc_ctx) < 0)
-        throw std::runtime_error(errMsg("failed to write video stream parameters"));
+        throw std::runtime_error(errMsg("failed to write stream parameters"));
+    return stream->index;
+}
+
+int Muxer::addStream(const AVCodecParameters *params, const AVRational time_base) {
+    if (!params) throw std::invalid_argument(errMsg("received stream parameters are NULL"));
 
-    streams_[type] = stream;
-    encoders_time_bases_[type] = enc_ctx->time_base;
+    AVStream *stream = newStream(params->codec_type, time_base);
+    if (avcodec_parameters_copy(stream->codecpar, params) < 0)
+        throw std::runtime_error(errMsg("failed to write stream parameters"));
+    /* the tag used by the source container may not be valid for the output one */
+    stream->codecpar->codec_tag = 0;
+    return stream->index;
 }
 
-void Muxer::initFile() {
-    if (file_inited_) throw std::logic_error(errMsg("cannot init file, file has already been initialized"));
-    if (fmt_ctx_->pb) throw std::logic_error(errMsg("cannot create file, file has already been created"));
+void Muxer::openFile() {
     /* create empty video file */
-    if (!(fmt_ctx_->flags & AVFMT_NOFILE)) {
-        if (avio_open(&fmt_ctx_->pb, filename_.c_str(), AVIO_FLAG_WRITE) < 0) {
+    if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&fmt_ctx_->pb, fmt_ctx_->url, AVIO_FLAG_WRITE) < 0) {
             throw std::runtime_error(errMsg("failed to create the output file"));
         }
     }
     if (avformat_write_header(fmt_ctx_.get(), nullptr) < 0)
         throw std::runtime_error(errMsg("Failed to write file header"));
+}
+
+std::string Muxer::getSegmentName(const int index) const {
+    std::string index_str = std::to_string(index);
+    if (index_str.size() < 5) index_str.insert(0, 5 - index_str.size(), '0');
+    return std::filesystem::path(filename_).stem().string() + "_" + index_str + ".ts";
+}
+
+void Muxer::startNextSegment() {
+    if (av_write_frame(fmt_ctx_.get(), nullptr) < 0)
+        throw std::runtime_error(errMsg("failed to write packet"));
+    if (av_write_trailer(fmt_ctx_.get()) < 0) throw std::runtime_error(errMsg("failed to write segment trailer"));
+    if (avio_closep(&fmt_ctx_->pb) < 0) throw std::runtime_error(errMsg("failed to close segment"));
+    playlist_writer_->addSegment({getSegmentName(segment_index_),
+                                  static_cast<double>(segment_end_ - segment_start_) / AV_TIME_BASE});
+
+    segment_index_++;
+    std::string segment_file =
+        (std::filesystem::path(filename_).parent_path() / getSegmentName(segment_index_)).string();
+    AVFormatContext *fmt_ctx = nullptr;
+    if (avformat_alloc_output_context2(&fmt_ctx, nullptr, "mpegts", segment_file.c_str()) < 0)
+        throw std::runtime_error(errMsg("failed to allocate output context for file '" + segment_file + "'"));
+    fmt_ctx_ = av::FormatContextUPtr(fmt_ctx);
+
+    for (size_t i = 0; i < stream_params_.size(); i++) {
+        AVStream *stream = avformat_new_stream(fmt_ctx_.get(), nullptr);
+        if (!stream) throw std::runtime_error(errMsg("failed to create a new stream"));
+        if (avcodec_parameters_copy(stream->codecpar, stream_params_[i].get()) < 0)
+            throw std::runtime_error(errMsg("failed to write stream parameters"));
+        stream->time_base = encoders_time_bases_[i];
+        streams_[i] = stream;
+    }
+    openFile();
+}
+
+void Muxer::initFile() {
+    if (file_inited_) throw std::logic_error(errMsg("cannot init file, file has already been initialized"));
+    if (fmt_ctx_->pb) throw std::logic_error(errMsg("cannot create file, file has already been created"));
+
+    if (segment_duration_) {
+        for (size_t i = 0; i < streams_.size(); i++) {
+            av::CodecParametersUPtr params(avcodec_parameters_alloc());
+            if (!params || avcodec_parameters_copy(params.get(), streams_[i]->codecpar) < 0)
+                throw std::runtime_error(errMsg("failed to copy stream parameters"));
+            stream_params_.push_back(std::move(params));
+            if (split_stream_ < 0 && streams_[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+                split_stream_ = static_cast<int>(i);
+        }
+        if (split_stream_ < 0) split_stream_ = 0;
+        /* the segments start at the first keyframe after the nominal duration, hence they're up to a frame longer */
+        playlist_writer_ = std::make_unique<PlaylistWriter>(filename_, segment_duration_ + 1);
+    }
+
+    openFile();
+    interleaver_ = std::make_unique<Interleaver>(static_cast<int>(streams_.size()), max_interleave_delta_,
+                                                 max_interleave_bytes_);
     file_inited_ = true;
 }
 
+void Muxer::setInterleaving(const int64_t max_delta, const size_t max_bytes) {
+    if (file_inited_) throw std::logic_error(errMsg("cannot set interleaving, file has already been initialized"));
+    if (max_delta < 0) throw std::invalid_argument(errMsg("the maximum interleaving delta can't be negative"));
+    max_interleave_delta_ = max_delta;
+    max_interleave_bytes_ = max_bytes;
+}
+
+void Muxer::setWriteCallback(std::function<void(int, int64_t)> callback) { write_callback_ = std::move(callback); }
+
+Interleaver::Stats Muxer::getInterleaverStats() const {
+    if (!interleaver_) throw std::logic_error(errMsg("cannot get interleaver stats, file has not been initialized"));
+    return interleaver_->getStats();
+}
+
 void Muxer::finalizeFile() {
     if (!file_inited_) throw std::logic_error(errMsg("cannot finalize file, file has not been initialized"));
     if (file_finalized_) throw std::logic_error(errMsg("cannot finalize file, file has already been finalized"));
+    drainInterleaver();
     if (av_write_trailer(fmt_ctx_.get()) < 0) throw std::runtime_error(errMsg("failed to write file trailer"));
     file_finalized_ = true;
     if (avio_closep(&fmt_ctx_->pb) < 0) throw std::runtime_error(errMsg("failed to close file"));
+
+    if (playlist_writer_) {
+        if (segment_start_ != AV_NOPTS_VALUE) {
+            playlist_writer_->addSegment({getSegmentName(segment_index_),
+                                          static_cast<double>(segment_end_ - segment_start_) / AV_TIME_BASE});
+        }
+        playlist_writer_->close();
+    }
 }
 
 bool Muxer::isInited() const { return file_inited_; }
 
-void Muxer::writePacket(const av::PacketUPtr packet, const av::MediaType packet_type) {
+void Muxer::writePacket(av::PacketUPtr packet, const int stream_index) {
     if (!file_inited_) throw std::logic_error(errMsg("cannot write packet, file has not been initialized"));
     if (file_finalized_) throw std::logic_error(errMsg("cannot write packet, file has already been finalized"));
 
-    if (packet) {
-        if (!av::validMediaType(packet_type)) throw std::invalid_argument(errMsg("received packet of unknown type"));
-        auto stream = streams_[packet_type];
-        if (!stream) throw std::logic_error(errMsg("stream of specified type not present"));
-        av_packet_rescale_ts(packet.get(), encoders_time_bases_[packet_type], stream->time_base);
-        packet->stream_index = stream->index;
+    if (!packet) {
+        drainInterleaver();
+        if (av_write_frame(fmt_ctx_.get(), nullptr) < 0) throw std::runtime_error(errMsg("failed to flush packets"));
+        return;
     }
 
-    if (av_interleaved_write_frame(fmt_ctx_.get(), packet.get()))
-        throw std::runtime_error(errMsg("failed to write packet"));
+    if (stream_index < 0 || stream_index >= static_cast<int>(streams_.size()))
+        throw std::invalid_argument(errMsg("received packet of unknown stream"));
+    FlowTracer::Scope scope("mux");
+    scope.setData(av_get_media_type_string(streams_[stream_index]->codecpar->codec_type), stream_index, packet->pts,
+                  packet->size);
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts != AV_NOPTS_VALUE) ts = av_rescale_q(ts, encoders_time_bases_[stream_index], AV_TIME_BASE_Q);
+    interleaver_->push(std::move(packet), stream_index, ts);
+
+    for (auto [next, index] = interleaver_->pop(); next; std::tie(next, index) = interleaver_->pop())
+        writeInterleavedPacket(std::move(next), index);
+}
+
+void Muxer::drainInterleaver() {
+    for (auto [next, index] = interleaver_->popOldest(); next; std::tie(next, index) = interleaver_->popOldest())
+        writeInterleavedPacket(std::move(next), index);
+}
+
+void Muxer::writeInterleavedPacket(const av::PacketUPtr packet, const int stream_index) {
+    FlowTracer::Scope scope("write");
+    scope.setData(av_get_media_type_string(streams_[stream_index]->codecpar->codec_type), stream_index, packet->pts,
+                  packet->size);
+    if (segment_duration_) {
+        int64_t ts = av_rescale_q(packet->pts, encoders_time_bases_[stream_index], AV_TIME_BASE_Q);
+        /* start a new segment at the first keyframe after the nominal duration (forced by the pipeline) */
+        if (stream_index == split_stream_ && (packet->flags & AV_PKT_FLAG_KEY)) {
+            if (segment_start_ == AV_NOPTS_VALUE) {
+                segment_start_ = ts;
+            } else if (ts - segment_start_ >=
+                       static_cast<int64_t>(segment_duration_) * AV_TIME_BASE - segment_tolerance) {
+                segment_end_ = ts;
+                startNextSegment();
+                segment_start_ = ts;
+            }
+        }
+        if (segment_start_ != AV_NOPTS_VALUE && stream_index == split_stream_) {
+            int64_t end = ts + av_rescale_q(packet->duration, encoders_time_bases_[stream_index], AV_TIME_BASE_Q);
+            if (segment_end_ == AV_NOPTS_VALUE || end > segment_end_) segment_end_ = end;
+        }
+    }
+
+    const int64_t pts = av_rescale_q(packet->pts, encoders_time_bases_[stream_index], AV_TIME_BASE_Q);
+    auto stream = streams_[stream_index];
+    av_packet_rescale_ts(packet.get(), encoders_time_bases_[stream_index], stream->time_base);
+    packet->stream_index = stream->index;
+
+    /* the packets are already interleaved, hence they are written directly */
+    if (av_write_frame(fmt_ctx_.get(), packet.get()) < 0) throw std::runtime_error(errMsg("failed to write packet"));
+    if (write_callback_) write_callback_(stream_index, pts);
 }
 
 void Muxer::printInfo() const { av_dump_format(fmt_ctx_.get(), 0, filename_.c_str(), 1); }
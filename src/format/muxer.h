@@ -1,25 +1,75 @@
 #pragma once
 
-#include <array>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "common/common.h"
+#include "interleaver.h"
+#include "playlist_writer.h"
 
 class Muxer {
     av::FormatContextUPtr fmt_ctx_;
     std::string filename_;
-    std::array<const AVStream *, av::MediaType::NumTypes> streams_{};
-    std::array<AVRational, av::MediaType::NumTypes> encoders_time_bases_{};
+    std::vector<const AVStream *> streams_;
+    std::vector<AVRational> encoders_time_bases_;
     bool file_inited_{};
     bool file_finalized_{};
 
+    /* Segmented output only: the nominal duration of the segments, in seconds (0 if disabled) */
+    int segment_duration_{};
+    /* The parameters of the streams, re-created in each segment */
+    std::vector<av::CodecParametersUPtr> stream_params_;
+    /* The stream whose keyframes start the new segments (the first video one, if any) */
+    int split_stream_ = -1;
+    int segment_index_{};
+    /* The timestamps of the first and last packets of the current segment, in AV_TIME_BASE units */
+    int64_t segment_start_ = AV_NOPTS_VALUE;
+    int64_t segment_end_ = AV_NOPTS_VALUE;
+    std::unique_ptr<PlaylistWriter> playlist_writer_;
+
+    /* The maximum time a packet waits for the other streams, in AV_TIME_BASE units, and the memory cap of the queues */
+    int64_t max_interleave_delta_ = AV_TIME_BASE;
+    size_t max_interleave_bytes_ = 64 * 1024 * 1024;
+    std::unique_ptr<Interleaver> interleaver_;
+    /* Called after writing each packet, with its stream and timestamp */
+    std::function<void(int, int64_t)> write_callback_;
+
+    /**
+     * Create a new stream of the given type, checking that it's possible to add it
+     * @param codec_type    the media type of the stream
+     * @param time_base     the time-base of the packets that will be sent for this stream
+     * @return the new stream (whose index is also the one to use when writing its packets)
+     */
+    AVStream *newStream(AVMediaType codec_type, AVRational time_base);
+
+    /* Open the output file (or the current segment) and write its header */
+    void openFile();
+
+    /* Get the name of a segment file, relative to the playlist one */
+    [[nodiscard]] std::string getSegmentName(int index) const;
+
+    /* Finalize the current segment, add it to the playlist and start the next one */
+    void startNextSegment();
+
+    /* Write a packet released by the interleaver, starting a new segment if needed */
+    void writeInterleavedPacket(av::PacketUPtr packet, int stream_index);
+
+    /* Write all the packets still queued in the interleaver */
+    void drainInterleaver();
+
 public:
     /**
      * Create a new muxer
-     * @param filename the name of the output file
+     * @param filename          the name of the output file
+     * @param segment_duration  if positive, the output is segmented for HTTP Live Streaming: "filename" is the
+     * name of the playlist, and the packets are written to MPEG-TS segments (named after the playlist) of about
+     * segment_duration seconds, each one starting with a keyframe. The playlist is updated in background every time
+     * a segment is completed, so that the recording can be played while it's still in progress
      */
-    explicit Muxer(std::string filename);
+    explicit Muxer(std::string filename, int segment_duration = 0);
 
     Muxer(const Muxer &) = delete;
 
@@ -28,12 +78,47 @@ public:
     Muxer &operator=(const Muxer &) = delete;
 
     /**
-     * Add a stream to the muxer. It's only possible to add a single audio stream and video stream:
-     * if this condition is violated, an exception will be thrown.
+     * Add a stream to the muxer. Any number of audio and video streams can be added, each one
+     * identified by the returned index.
      * WARNING: This function must be called before opening the file with initFile()
      * @param enc_ctx   the context of the encoder generating the packet stream
+     * @return the index of the new stream
+     */
+    int addStream(const AVCodecContext *enc_ctx);
+
+    /**
+     * Add a stream to the muxer, copying the parameters of an already encoded stream (e.g. to remux it)
+     * WARNING: This function must be called before opening the file with initFile()
+     * @param params    the parameters of the encoded stream
+     * @param time_base the time-base of the packets that will be sent for this stream
+     * @return the index of the new stream
+     */
+    int addStream(const AVCodecParameters *params, AVRational time_base);
+
+    /**
+     * Set the limits of the interleaving of the streams: the packets are written by increasing timestamp, waiting
+     * for the late streams at most max_delta (with respect to the newest packet received) and as long as the queued
+     * packets take less than max_bytes. Then the oldest ones are written anyway.
+     * WARNING: This function must be called before opening the file with initFile()
+     * @param max_delta the maximum interleaving delay, in AV_TIME_BASE units (0 to write the packets as soon as
+     * possible, when they can't be interleaved right away)
+     * @param max_bytes the maximum size of the packets waiting to be interleaved
+     */
+    void setInterleaving(int64_t max_delta, size_t max_bytes);
+
+    /**
+     * Get the current and maximum depth of the interleaving queues
+     * WARNING: the muxer must be initialized with initFile(), otherwise an exception will be thrown
+     * @return the statistics of the interleaving queues
+     */
+    [[nodiscard]] Interleaver::Stats getInterleaverStats() const;
+
+    /**
+     * Set a function to call every time a packet has been written to the output (e.g. to measure the latency)
+     * @param callback  the function, receiving the index of the stream of the packet and its presentation
+     * timestamp in AV_TIME_BASE units. It's called by the thread writing the packet, so it must be fast
      */
-    void addStream(const AVCodecContext *enc_ctx);
+    void setWriteCallback(std::function<void(int stream_index, int64_t pts)> callback);
 
     /**
      * Open the output file and write the header.
@@ -57,11 +142,12 @@ public:
      * Write a packet to the output file.
      * WARNING: the muxer must be initialized with init() in order to accept packets, otherwise
      * an exception will be thrown
-     * @param packet        the packet to write. If nullptr, the output queue will be flushed
-     * @param packet_type   the type of the packet (audio or video). If the packet is nullptr,
-     * this parameter is irrelevant
+     * The packet may be queued until the other streams have caught up with it (see setInterleaving())
+     * @param packet        the packet to write. If nullptr, the interleaving and output queues will be flushed
+     * @param stream_index  the index of the stream of the packet, as returned by addStream(). If the packet
+     * is nullptr, this parameter is irrelevant
      */
-    void writePacket(av::PacketUPtr packet, av::MediaType packet_type);
+    void writePacket(av::PacketUPtr packet, int stream_index);
 
     /**
      * Print informations about the streams
@@ -0,0 +1,93 @@
+#include "playlist_writer.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+static std::string errMsg(const std::string &msg) { return ("PlaylistWriter: " + msg); }
+
+PlaylistWriter::PlaylistWriter(std::string filename, const int target_duration)
+    : filename_(std::move(filename)), target_duration_(target_duration) {
+    if (filename_.empty()) throw std::invalid_argument(errMsg("playlist file not specified"));
+    if (target_duration_ <= 0) throw std::invalid_argument(errMsg("the target duration must be positive"));
+    writer_ = std::thread([this]() { run(); });
+}
+
+PlaylistWriter::~PlaylistWriter() {
+    {
+        std::lock_guard lg(m_);
+        closed_ = true;
+        dirty_ = false;
+        cv_.notify_all();
+    }
+    if (writer_.joinable()) writer_.join();
+}
+
+void PlaylistWriter::addSegment(Segment segment) {
+    std::lock_guard lg(m_);
+    if (closed_) throw std::logic_error(errMsg("the playlist has already been closed"));
+    segments_.push_back(std::move(segment));
+    dirty_ = true;
+    cv_.notify_all();
+}
+
+void PlaylistWriter::close() {
+    {
+        std::lock_guard lg(m_);
+        if (closed_) throw std::logic_error(errMsg("the playlist has already been closed"));
+        ended_ = true;
+        dirty_ = true;
+        closed_ = true;
+        cv_.notify_all();
+    }
+    writer_.join();
+    if (e_ptr_) std::rethrow_exception(e_ptr_);
+}
+
+void PlaylistWriter::run() {
+    try {
+        while (true) {
+            std::vector<Segment> segments;
+            bool ended;
+            {
+                std::unique_lock ul(m_);
+                cv_.wait(ul, [this]() { return (dirty_ || closed_); });
+                if (!dirty_) break;
+                /* coalesce the updates received while writing the previous version */
+                segments = segments_;
+                ended = ended_;
+                dirty_ = false;
+            }
+            write(segments, ended);
+            if (ended) break;
+        }
+    } catch (...) {
+        std::lock_guard lg(m_);
+        e_ptr_ = std::current_exception();
+    }
+}
+
+void PlaylistWriter::write(const std::vector<Segment> &segments, const bool ended) const {
+    const std::string tmp_filename = filename_ + ".tmp";
+    {
+        std::ofstream out(tmp_filename, std::ios::trunc);
+        if (!out) throw std::runtime_error(errMsg("failed to create '" + tmp_filename + "'"));
+        out << "#EXTM3U\n";
+        out << "#EXT-X-VERSION:3\n";
+        /* the target duration can't change while the playlist is being updated (RFC 8216, section 6.2.1) */
+        out << "#EXT-X-TARGETDURATION:" << target_duration_ << "\n";
+        out << "#EXT-X-MEDIA-SEQUENCE:0\n";
+        out << "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+        out << std::fixed << std::setprecision(3);
+        for (const auto &segment : segments) out << "#EXTINF:" << segment.duration << ",\n" << segment.uri << "\n";
+        if (ended) out << "#EXT-X-ENDLIST\n";
+        out.flush();
+        if (!out) throw std::runtime_error(errMsg("failed to write '" + tmp_filename + "'"));
+    }
+
+    /* the players polling the playlist never see a partially written file */
+    std::error_code ec;
+    std::filesystem::rename(tmp_filename, filename_, ec);
+    if (ec) throw std::runtime_error(errMsg("failed to replace '" + filename_ + "': " + ec.message()));
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PlaylistWriter {
+public:
+    /* A media segment listed in the playlist */
+    struct Segment {
+        std::string uri;  // relative to the playlist
+        double duration;  // in seconds
+    };
+
+private:
+    std::string filename_;
+    int target_duration_;
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::vector<Segment> segments_;
+    bool ended_{};
+    bool dirty_{};
+    bool closed_{};
+    std::exception_ptr e_ptr_;
+    std::thread writer_;
+
+    /* Write the playlist to a temporary file and atomically replace the old one with it */
+    void write(const std::vector<Segment> &segments, bool ended) const;
+
+    /* Main loop of the writer thread */
+    void run();
+
+public:
+    /**
+     * Create a new writer of an HLS media playlist, rewritten by a background thread every time it's updated
+     * @param filename          the name of the playlist file
+     * @param target_duration   the maximum duration of the segments, in seconds
+     */
+    PlaylistWriter(std::string filename, int target_duration);
+
+    PlaylistWriter(const PlaylistWriter &) = delete;
+
+    /* Stop the writer thread, without waiting for the pending update (if any) to be written */
+    ~PlaylistWriter();
+
+    PlaylistWriter &operator=(const PlaylistWriter &) = delete;
+
+    /**
+     * Append a segment to the playlist (the playlist file is updated asynchronously)
+     * @param segment the completed segment
+     */
+    void addSegment(Segment segment);
+
+    /**
+     * Mark the playlist as complete, wait for it to be written and stop the writer thread.
+     * If any error occurred while writing the playlist, it will be re-thrown here
+     */
+    void close();
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "common/common.h"
+
+/*
+ * Layout of the capture trace files: the raw packets fed to a pipeline, with the parameters of their streams,
+ * stored in native byte order so that they can be used in place from a memory mapping.
+ *
+ *   FileHeader
+ *   StreamHeader + extradata (padded to 8 bytes), num_streams times
+ *   PacketHeader + data (padded to 8 bytes), until the end of the file
+ */
+
+namespace trace {
+
+constexpr char magic[8] = {'L', 'C', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr uint32_t version = 1;
+constexpr uint32_t alignment = 8;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_streams;
+};
+
+struct StreamHeader {
+    int32_t codec_type;  // AVMediaType
+    int32_t codec_id;    // AVCodecID
+    uint32_t codec_tag;
+    int32_t format;  // AVPixelFormat or AVSampleFormat
+    int32_t width;
+    int32_t height;
+    int32_t sar_num;
+    int32_t sar_den;
+    int32_t sample_rate;
+    int32_t channels;
+    uint64_t channel_layout;
+    int32_t bits_per_coded_sample;
+    int32_t block_align;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    int64_t bit_rate;
+    uint32_t extradata_size;
+    uint32_t reserved;
+};
+
+struct PacketHeader {
+    uint32_t stream;
+    uint32_t size;
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+    int32_t flags;
+    uint32_t reserved;
+    int64_t time;  // the time at which the packet has been fed, since the start of the trace, in microseconds
+};
+
+/* Round a size up to the alignment of the records */
+constexpr uint64_t align(uint64_t size) { return (size + alignment - 1) / alignment * alignment; }
+
+/**
+ * Describe a stream with a StreamHeader (also used by the shared-memory frame rings)
+ * @param params    the parameters of the stream
+ * @param time_base the time-base of the stream
+ * @return the header of the stream, whose extradata (if any) must be stored separately
+ */
+inline StreamHeader toStreamHeader(const AVCodecParameters *params, const AVRational time_base) {
+    StreamHeader stream{};
+    stream.codec_type = params->codec_type;
+    stream.codec_id = params->codec_id;
+    stream.codec_tag = params->codec_tag;
+    stream.format = params->format;
+    stream.width = params->width;
+    stream.height = params->height;
+    stream.sar_num = params->sample_aspect_ratio.num;
+    stream.sar_den = params->sample_aspect_ratio.den;
+    stream.sample_rate = params->sample_rate;
+    stream.channels = params->channels;
+    stream.channel_layout = params->channel_layout;
+    stream.bits_per_coded_sample = params->bits_per_coded_sample;
+    stream.block_align = params->block_align;
+    stream.time_base_num = time_base.num;
+    stream.time_base_den = time_base.den;
+    stream.bit_rate = params->bit_rate;
+    stream.extradata_size = params->extradata ? params->extradata_size : 0;
+    return stream;
+}
+
+/**
+ * Rebuild the parameters of a stream from its StreamHeader
+ * @param stream    the header of the stream
+ * @param extradata the extradata of the stream, of stream.extradata_size bytes (nullptr if it has none)
+ * @return the parameters of the stream
+ */
+inline av::CodecParametersUPtr fromStreamHeader(const StreamHeader &stream, const uint8_t *extradata) {
+    av::CodecParametersUPtr params(avcodec_parameters_alloc());
+    if (!params) throw std::runtime_error("failed to allocate the stream parameters");
+    params->codec_type = static_cast<AVMediaType>(stream.codec_type);
+    params->codec_id = static_cast<AVCodecID>(stream.codec_id);
+    params->codec_tag = stream.codec_tag;
+    params->format = stream.format;
+    params->width = stream.width;
+    params->height = stream.height;
+    params->sample_aspect_ratio = av_make_q(stream.sar_num, stream.sar_den);
+    params->sample_rate = stream.sample_rate;
+    params->channels = stream.channels;
+    params->channel_layout = stream.channel_layout;
+    params->bits_per_coded_sample = stream.bits_per_coded_sample;
+    params->block_align = stream.block_align;
+    params->bit_rate = stream.bit_rate;
+    if (extradata && stream.extradata_size) {
+        params->extradata = static_cast<uint8_t *>(av_mallocz(stream.extradata_size + AV_INPUT_BUFFER_PADDING_SIZE));
+        if (!params->extradata) throw std::runtime_error("failed to allocate the stream extradata");
+        std::memcpy(params->extradata, extradata, stream.extradata_size);
+        params->extradata_size = static_cast<int>(stream.extradata_size);
+    }
+    return params;
+}
+
+}  // namespace trace
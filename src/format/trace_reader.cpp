@@ -0,0 +1,79 @@
+#include "trace_reader.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "trace_format.h"
+
+static std::string errMsg(const std::string &msg) { return ("TraceReader: " + msg); }
+
+TraceReader::TraceReader(const std::string &filename) : file_(filename) {
+    const uint8_t *data = file_.data();
+    const size_t size = file_.size();
+
+    trace::FileHeader header{};
+    if (size < sizeof(header)) throw std::runtime_error(errMsg("truncated trace file"));
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, trace::magic, sizeof(header.magic)) != 0)
+        throw std::runtime_error(errMsg(filename + " is not a trace file"));
+    if (header.version != trace::version) throw std::runtime_error(errMsg("unsupported trace version"));
+    size_t offset = sizeof(header);
+
+    for (uint32_t i = 0; i < header.num_streams; i++) {
+        trace::StreamHeader stream{};
+        if (size - offset < sizeof(stream)) throw std::runtime_error(errMsg("truncated trace file"));
+        std::memcpy(&stream, data + offset, sizeof(stream));
+        offset += sizeof(stream);
+
+        const uint8_t *extradata = nullptr;
+        if (stream.extradata_size) {
+            if (size - offset < trace::align(stream.extradata_size))
+                throw std::runtime_error(errMsg("truncated trace file"));
+            extradata = data + offset;
+            offset += trace::align(stream.extradata_size);
+        }
+        params_.push_back(trace::fromStreamHeader(stream, extradata));
+        time_bases_.push_back(av_make_q(stream.time_base_num, stream.time_base_den));
+    }
+
+    packets_offset_ = offset_ = offset;
+}
+
+int TraceReader::getNumStreams() const { return static_cast<int>(params_.size()); }
+
+const AVCodecParameters *TraceReader::getStreamParams(const int stream) const {
+    if (stream < 0 || stream >= params_.size()) throw std::out_of_range(errMsg("invalid stream index"));
+    return params_[stream].get();
+}
+
+AVRational TraceReader::getStreamTimeBase(const int stream) const {
+    if (stream < 0 || stream >= time_bases_.size()) throw std::out_of_range(errMsg("invalid stream index"));
+    return time_bases_[stream];
+}
+
+TraceReader::Packet TraceReader::readPacket() {
+    const size_t size = file_.size();
+    trace::PacketHeader header{};
+    /* a packet truncated by an interrupted recording is treated as the end of the trace */
+    if (size - offset_ < sizeof(header)) return {};
+    std::memcpy(&header, file_.data() + offset_, sizeof(header));
+    if (size - offset_ - sizeof(header) < header.size) return {};
+    if (header.stream >= params_.size()) throw std::runtime_error(errMsg("invalid stream index in the trace"));
+
+    Packet packet;
+    packet.packet = av::PacketUPtr(av_packet_alloc());
+    if (!packet.packet || av_new_packet(packet.packet.get(), static_cast<int>(header.size)) < 0)
+        throw std::runtime_error(errMsg("failed to allocate a packet"));
+    std::memcpy(packet.packet->data, file_.data() + offset_ + sizeof(header), header.size);
+    packet.packet->pts = header.pts;
+    packet.packet->dts = header.dts;
+    packet.packet->duration = header.duration;
+    packet.packet->flags = header.flags;
+    packet.stream = static_cast<int>(header.stream);
+    packet.time = header.time;
+
+    offset_ = std::min(size, offset_ + sizeof(header) + trace::align(header.size));
+    return packet;
+}
+
+void TraceReader::rewind() { offset_ = packets_offset_; }
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "utils/mapped_file.h"
+
+class TraceReader {
+    MappedFile file_;
+    std::vector<av::CodecParametersUPtr> params_;
+    std::vector<AVRational> time_bases_;
+    /* The offset of the first packet, and of the next one to read */
+    size_t packets_offset_{};
+    size_t offset_{};
+
+public:
+    /* A packet read from the trace */
+    struct Packet {
+        av::PacketUPtr packet;  // nullptr at the end of the trace
+        int stream = -1;
+        int64_t time = 0;  // the time at which the packet was fed, since the start of the trace, in microseconds
+    };
+
+    /**
+     * Open a trace file (mapping it in memory) and read the parameters of its streams
+     * @param filename the name of the trace file
+     */
+    explicit TraceReader(const std::string &filename);
+
+    TraceReader(const TraceReader &) = delete;
+
+    ~TraceReader() = default;
+
+    TraceReader &operator=(const TraceReader &) = delete;
+
+    /**
+     * Get the number of streams of the trace
+     * @return the number of streams
+     */
+    [[nodiscard]] int getNumStreams() const;
+
+    /**
+     * Access the parameters of a stream
+     * @param stream the index of the stream
+     * @return an observer pointer to access the stream parameters
+     */
+    [[nodiscard]] const AVCodecParameters *getStreamParams(int stream) const;
+
+    /**
+     * Get the time-base of a stream
+     * @param stream the index of the stream
+     * @return the stream time-base
+     */
+    [[nodiscard]] AVRational getStreamTimeBase(int stream) const;
+
+    /**
+     * Read the next packet of the trace (its data is copied, so it can outlive the reader)
+     * @return the packet, the index of its stream and the time at which it was fed
+     */
+    Packet readPacket();
+
+    /**
+     * Go back to the first packet of the trace
+     */
+    void rewind();
+};
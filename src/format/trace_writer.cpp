@@ -0,0 +1,135 @@
+#include "trace_writer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "trace_format.h"
+
+static std::string errMsg(const std::string &msg) { return ("TraceWriter: " + msg); }
+
+/* The raw video packets are big, write them with few large system calls */
+static constexpr size_t buffer_size = 4 * 1024 * 1024;
+/* The data queued for the writer thread beyond which the packets are dropped (about 2s of raw 1080p60) */
+static constexpr size_t max_queued_bytes = 1024 * 1024 * 1024;
+
+static void writePadding(std::ofstream &file, const uint64_t size) {
+    static const char zeros[trace::alignment] = {};
+    file.write(zeros, static_cast<std::streamsize>(trace::align(size) - size));
+}
+
+TraceWriter::TraceWriter(const std::string &filename, const std::vector<Stream> &streams)
+    : buffer_(buffer_size), num_streams_(streams.size()), start_time_(av_gettime_relative()) {
+    file_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    file_.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file_) throw std::runtime_error(errMsg("failed to open the trace file " + filename));
+
+    trace::FileHeader header{};
+    std::memcpy(header.magic, trace::magic, sizeof(header.magic));
+    header.version = trace::version;
+    header.num_streams = static_cast<uint32_t>(streams.size());
+    file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (const auto &[params, time_base] : streams) {
+        if (!params) throw std::invalid_argument(errMsg("stream parameters not specified"));
+        const trace::StreamHeader stream = trace::toStreamHeader(params, time_base);
+        file_.write(reinterpret_cast<const char *>(&stream), sizeof(stream));
+        if (stream.extradata_size) {
+            file_.write(reinterpret_cast<const char *>(params->extradata), stream.extradata_size);
+            writePadding(file_, stream.extradata_size);
+        }
+    }
+    if (!file_) throw std::runtime_error(errMsg("failed to write the trace header"));
+
+    writer_ = std::thread([this]() { run(); });
+}
+
+TraceWriter::~TraceWriter() {
+    {
+        std::lock_guard lg(m_);
+        closed_ = true;
+        discard_ = true;
+        cv_.notify_all();
+    }
+    if (writer_.joinable()) writer_.join();
+}
+
+void TraceWriter::writePacket(const AVPacket *packet, const int stream) {
+    if (!packet) throw std::invalid_argument(errMsg("packet not specified"));
+    if (stream < 0 || stream >= num_streams_) throw std::invalid_argument(errMsg("invalid stream index"));
+
+    /* a new reference to the data (copied only if the packet isn't reference-counted), out of the lock */
+    av::PacketUPtr ref(av_packet_clone(packet));
+    if (!ref) throw std::runtime_error(errMsg("failed to reference the packet"));
+
+    std::lock_guard lg(m_);
+    if (closed_) throw std::logic_error(errMsg("the trace has already been closed"));
+    const int64_t time = av_gettime_relative() - start_time_;  // under the lock, to keep the times sorted
+    /* the writer failed (the error is reported by close()) or is too far behind */
+    if (e_ptr_ || queued_bytes_ + ref->size > max_queued_bytes) {
+        dropped_packets_++;
+        return;
+    }
+    queued_bytes_ += ref->size;
+    queue_.push_back({std::move(ref), stream, time});
+    cv_.notify_all();
+}
+
+void TraceWriter::write(const QueuedPacket &queued) {
+    const AVPacket *packet = queued.packet.get();
+    trace::PacketHeader header{};
+    header.stream = static_cast<uint32_t>(queued.stream);
+    header.size = static_cast<uint32_t>(packet->size);
+    header.pts = packet->pts;
+    header.dts = packet->dts;
+    header.duration = packet->duration;
+    header.flags = packet->flags;
+    header.time = queued.time;
+
+    file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file_.write(reinterpret_cast<const char *>(packet->data), packet->size);
+    writePadding(file_, header.size);
+    if (!file_) throw std::runtime_error(errMsg("failed to write a packet to the trace"));
+}
+
+void TraceWriter::run() {
+    try {
+        while (true) {
+            std::deque<QueuedPacket> packets;
+            {
+                std::unique_lock ul(m_);
+                cv_.wait(ul, [this]() { return (!queue_.empty() || closed_); });
+                if (queue_.empty() || discard_) break;
+                /* write all the packets queued so far without the lock, so that the tracing threads never wait */
+                packets.swap(queue_);
+            }
+            size_t written_bytes = 0;
+            for (const auto &queued : packets) {
+                write(queued);
+                written_bytes += queued.packet->size;
+            }
+            std::lock_guard lg(m_);
+            queued_bytes_ -= written_bytes;
+        }
+    } catch (...) {
+        std::lock_guard lg(m_);
+        e_ptr_ = std::current_exception();
+    }
+}
+
+void TraceWriter::close() {
+    {
+        std::lock_guard lg(m_);
+        if (closed_) return;
+        closed_ = true;
+        cv_.notify_all();
+    }
+    writer_.join();
+    if (e_ptr_) std::rethrow_exception(e_ptr_);
+    file_.close();
+    if (!file_) throw std::runtime_error(errMsg("failed to close the trace file"));
+}
+
+uint64_t TraceWriter::getDroppedPackets() {
+    std::lock_guard lg(m_);
+    return dropped_packets_;
+}
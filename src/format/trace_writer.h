@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/common.h"
+
+class TraceWriter {
+    /* the buffer of the file, declared first so that it outlives it */
+    std::vector<char> buffer_;
+    std::ofstream file_;
+    size_t num_streams_;
+    int64_t start_time_;
+
+    /* A packet waiting to be written by the writer thread, with the time it was received */
+    struct QueuedPacket {
+        av::PacketUPtr packet;
+        int stream;
+        int64_t time;
+    };
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::deque<QueuedPacket> queue_;
+    size_t queued_bytes_{};
+    uint64_t dropped_packets_{};
+    bool closed_{};
+    bool discard_{};
+    std::exception_ptr e_ptr_;
+    std::thread writer_;
+
+    /* Write a packet to the file */
+    void write(const QueuedPacket &queued);
+
+    /* Main loop of the writer thread */
+    void run();
+
+public:
+    /* The parameters of a traced stream */
+    struct Stream {
+        const AVCodecParameters *params;
+        AVRational time_base;
+    };
+
+    /**
+     * Create a new trace file (overwriting it if it already exists) and write the parameters of its streams.
+     * The packets are written by a background thread, so that the disk never blocks the threads tracing them
+     * @param filename  the name of the trace file
+     * @param streams   the streams whose packets will be traced
+     */
+    TraceWriter(const std::string &filename, const std::vector<Stream> &streams);
+
+    TraceWriter(const TraceWriter &) = delete;
+
+    /* Stop the writer thread, discarding the packets not written yet */
+    ~TraceWriter();
+
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    /**
+     * Append a packet to the trace (asynchronously, referencing its data), together with the time elapsed since the
+     * creation of the trace. Thread-safe, the packets of different streams can be written by different threads.
+     * If the disk can't keep up and too much data is already queued, the packet is dropped
+     * @param packet    the packet to write
+     * @param stream    the index of the stream of the packet
+     */
+    void writePacket(const AVPacket *packet, int stream);
+
+    /**
+     * Wait for the queued packets to be written, stop the writer thread and close the file.
+     * If any error occurred while writing the trace, an exception will be thrown
+     */
+    void close();
+
+    /* Get the number of packets dropped so far because the disk couldn't keep up */
+    [[nodiscard]] uint64_t getDroppedPackets();
+};
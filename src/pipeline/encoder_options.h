@@ -0,0 +1,35 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "encoder_parameters.h"
+
+/**
+ * Convert the settings of the video encoder to the options of the libx264 encoder (the unset ones are omitted,
+ * leaving them to the encoder or to the caller)
+ * @param params the settings of the video encoder
+ * @return a map filled with the key-value options to use for the encoder
+ */
+inline std::map<std::string, std::string> getH264EncoderOptions(const EncoderParameters &params) {
+    std::map<std::string, std::string> enc_options;
+    if (!params.getPreset().empty()) enc_options.insert({"preset", params.getPreset()});
+    if (!params.getTune().empty()) enc_options.insert({"tune", params.getTune()});
+    if (params.getGopSize() > 0) enc_options.insert({"g", std::to_string(params.getGopSize())});
+    if (params.getKeyintMin() > 0) enc_options.insert({"keyint_min", std::to_string(params.getKeyintMin())});
+    if (params.getBFrames() >= 0) enc_options.insert({"bf", std::to_string(params.getBFrames())});
+    if (params.getRcLookahead() >= 0) enc_options.insert({"rc-lookahead", std::to_string(params.getRcLookahead())});
+    if (params.getCrf() >= 0) enc_options.insert({"crf", std::to_string(params.getCrf())});
+    if (params.getBitrate() > 0) enc_options.insert({"b", std::to_string(params.getBitrate())});
+    auto [max_bitrate, buffer_size] = params.getVbv();
+    if (max_bitrate > 0) {
+        enc_options.insert({"maxrate", std::to_string(max_bitrate)});
+        enc_options.insert({"bufsize", std::to_string(buffer_size)});
+    }
+    if (params.getThreads() >= 0) enc_options.insert({"threads", std::to_string(params.getThreads())});
+    if (params.getThreading() == EncoderParameters::Threading::Frame) enc_options.insert({"thread_type", "frame"});
+    if (params.getThreading() == EncoderParameters::Threading::Slice) enc_options.insert({"thread_type", "slice"});
+    /* the keyframes requested with requestKeyframe() must be IDR frames, so that a decoder can start from them */
+    enc_options.insert({"forced-idr", "1"});
+    return enc_options;
+}
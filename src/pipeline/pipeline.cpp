@@ -3,71 +3,90 @@
 #include <cassert>
 #include <iostream>
 #include <map>
+#include <tuple>
+#include <utility>
 
 static std::string errMsg(const std::string &msg) { return ("Pipeline: " + msg); }
 
-Pipeline::Pipeline(const std::string &output_file, const bool async) : muxer_(output_file), async_(async) {}
+/* The number of frames the frame export ring can hold (the readers lagging more than that skip frames) */
+static constexpr uint32_t frame_export_slots = 8;
+/* The size of the encoded packets queued to the writer thread beyond which the encoders wait for it */
+static constexpr size_t max_queued_bytes = 64 * 1024 * 1024;
+
+static int getSwsFlags(const ScalingAlgorithm scaling_algorithm) {
+    switch (scaling_algorithm) {
+        case ScalingAlgorithm::FastBilinear:
+            return SWS_FAST_BILINEAR;
+        case ScalingAlgorithm::Bilinear:
+            return SWS_BILINEAR;
+        case ScalingAlgorithm::Area:
+            return SWS_AREA;
+        case ScalingAlgorithm::Bicubic:
+            return SWS_BICUBIC;
+        default:
+            throw std::invalid_argument(errMsg("unknown scaling algorithm"));
+    }
+}
+
+Pipeline::Pipeline(const std::string &output_file, const bool async, const int segment_duration)
+    : async_(async), segment_duration_(segment_duration),
+      muxer_(std::make_unique<Muxer>(output_file, segment_duration)) {
+    global_header_flags_ = muxer_->getGlobalHeaderFlags();
+}
 
 Pipeline::~Pipeline() {
     if (async_ && !terminated_) stopProcessors();
+    try {
+        if (writer_.joinable()) stopWriter();
+    } catch (...) {
+        // nothing else can be done, the output file is left as it is
+    }
 }
 
-void Pipeline::startProcessor(const av::MediaType type) {
+void Pipeline::startProcessor(const int stream) {
     assert(!terminated_);
-    assert(av::validMediaType(type));
-    assert(managed_types_[type]);
-    assert(!processors_[type].joinable());
-
-    processors_[type] = std::thread([this, type]() {
-        try {
-            while (true) {
-                av::PacketUPtr packet;
-                {
-                    std::unique_lock ul(processors_m_);
-                    packets_cv_[type].wait(ul, [this, type]() { return (packets_[type] || terminated_); });
-                    if (!packets_[type] && terminated_) break;
-                    packet = std::move(packets_[type]);
-                }
-                processPacket(packet.get(), type);
-            }
-        } catch (...) {
-            std::lock_guard lg(processors_m_);
-            e_ptrs_[type] = std::current_exception();
-        }
-    });
+    assert(stream >= 0 && stream < chains_.size());
+
+    Chain &chain = chains_[stream];
+    if (!chain.processor && chain.mix_chain >= 0) {
+        /* the inputs of a mix are processed by the strand of the mixed output */
+        startProcessor(chain.mix_chain);
+        chain.processor = chains_[chain.mix_chain].processor;
+    } else if (!chain.processor) {
+        auto priority = (chain.type == av::MediaType::Audio) ? Executor::High : Executor::Normal;
+        chain.processor = std::make_shared<Strand>(Executor::shared(), priority);
+    }
 }
 
 void Pipeline::stopProcessors() {
     {
         std::lock_guard lg(processors_m_);
         terminated_ = true;
-        for (auto &cv : packets_cv_) cv.notify_all();
     }
-    for (auto &p : processors_) {
-        if (p.joinable()) p.join();
+    for (auto &chain : chains_) {
+        if (chain.processor) chain.processor->wait();
     }
 }
 
 void Pipeline::checkExceptions() {
-    for (auto &e_ptr : e_ptrs_) {
-        if (e_ptr) std::rethrow_exception(e_ptr);
+    for (auto &chain : chains_) {
+        if (chain.e_ptr) std::rethrow_exception(chain.e_ptr);
     }
 }
 
-void Pipeline::initVideo(const Demuxer &demuxer, const AVCodecID codec_id, const AVPixelFormat pix_fmt,
-                         const VideoParameters &video_params) {
-    const auto type = av::MediaType::Video;
-
-    if (muxer_.isInited()) throw std::logic_error(errMsg("output has already been initialized"));
+void Pipeline::checkCanAddChain() const {
+    if (muxer_->isInited()) throw std::logic_error(errMsg("output has already been initialized"));
     if (terminated_) throw std::logic_error(errMsg("already terminated"));
-    if (managed_types_[type]) throw std::logic_error(errMsg("video pipeline already initialized"));
-
-    managed_types_[type] = true;
+}
 
-    /* Init decoder */
-    decoders_[type] = Decoder(demuxer.getStreamParams(type));
+void Pipeline::checkStreamType(const AVCodecParameters *stream_params, const av::MediaType type) {
+    const AVMediaType expected = (type == av::MediaType::Video) ? AVMEDIA_TYPE_VIDEO : AVMEDIA_TYPE_AUDIO;
+    if (!stream_params || stream_params->codec_type != expected)
+        throw std::invalid_argument(errMsg("the input stream is missing or of the wrong type"));
+}
 
-    auto dec_ctx = decoders_[type].getContext();
+/* Get the size and offset of the captured area, checking that they're compatible with the decoded frames */
+static std::tuple<int, int, int, int> getCropArea(const AVCodecContext *dec_ctx, const VideoParameters &video_params) {
     auto [width, height] = video_params.getVideoSize();
     auto [offset_x, offset_y] = video_params.getVideoOffset();
     if (!width) width = dec_ctx->width;
@@ -78,38 +97,215 @@ void Pipeline::initVideo(const Demuxer &demuxer, const AVCodecID codec_id, const
     if (offset_x + width > dec_ctx->width) throw std::runtime_error("Specified horizontal offset is too high");
     if (offset_y + height > dec_ctx->height) throw std::runtime_error("Specified veritcal offset is too high");
 
+    return std::make_tuple(width, height, offset_x, offset_y);
+}
+
+/**
+ * Check whether the regions of interest derived from the screen activity must be attached to the frames to encode,
+ * and if so enable the adaptive quantization the encoder needs to apply them (disabled by the fastest presets)
+ * @param codec_id      the ID of the codec of the output video
+ * @param video_params  the parameters of the output video
+ * @param enc_options   the options of the encoder, updated as needed
+ * @return true if the regions of interest must be computed
+ */
+static bool useRoiEncoding(const AVCodecID codec_id, const VideoParameters &video_params,
+                           std::map<std::string, std::string> &enc_options) {
+    if (!video_params.getRoiEncoding() || codec_id != AV_CODEC_ID_H264) return false;
+    enc_options.insert({"aq-mode", "1"});
+    return true;
+}
+
+/**
+ * Check whether the encoder settings must adapt to the recorded content, which requires the constant quality
+ * rate control of H.264 (the only setting libx264 can change while encoding)
+ * @param codec_id      the ID of the codec of the output video
+ * @param video_params  the parameters of the output video
+ * @param enc_options   the options of the encoder
+ * @return true if the content must be classified
+ */
+static bool useSceneAdaptiveEncoding(const AVCodecID codec_id, const VideoParameters &video_params,
+                                     const std::map<std::string, std::string> &enc_options) {
+    return video_params.getSceneAdaptiveEncoding() && codec_id == AV_CODEC_ID_H264 && !enc_options.count("b");
+}
+
+/* Get the CRF offset of a scene, with respect to the requested CRF (used as is for the text) */
+static float getCrfOffset(const SceneClassifier::Scene scene) {
+    switch (scene) {
+        case SceneClassifier::Scene::Idle:
+            return 6;  // nothing changes, only the periodic keyframes cost bits
+        case SceneClassifier::Scene::Video:
+            return 3;  // the motion masks the artifacts, while the details are expensive
+        default:
+            return 0;
+    }
+}
+
+int Pipeline::initVideo(const Demuxer &demuxer, const AVCodecID codec_id, const AVPixelFormat pix_fmt,
+                        const VideoParameters &video_params, const std::map<std::string, std::string> &enc_options) {
+    return initVideo(demuxer.getStreamParams(av::MediaType::Video), demuxer.getStreamTimeBase(av::MediaType::Video),
+                     codec_id, pix_fmt, video_params, enc_options);
+}
+
+int Pipeline::initVideo(const AVCodecParameters *stream_params, const AVRational time_base, const AVCodecID codec_id,
+                        const AVPixelFormat pix_fmt, const VideoParameters &video_params,
+                        const std::map<std::string, std::string> &enc_options) {
+    const auto type = av::MediaType::Video;
+
+    checkCanAddChain();
+    checkStreamType(stream_params, type);
+
+    Chain chain;
+    chain.type = type;
+    chain.time_base = time_base;
+
+    /* Init decoder */
+    chain.decoder = Decoder(stream_params);
+
+    auto [width, height, offset_x, offset_y] = getCropArea(chain.decoder.getContext(), video_params);
+
+    auto [output_width, output_height] = video_params.getOutputSize();
+    if (!output_width) output_width = width;
+    if (!output_height) output_height = height;
+
+    Branch branch;
+
     /* Init encoder */
-    std::map<std::string, std::string> enc_options;
-    /*
-     * Possible presets from fastest (and worst quality) to slowest (and best quality):
-     * ultrafast -> superfast -> veryfast -> faster -> fast -> medium
-     */
-    enc_options.insert({"preset", "ultrafast"});
-    encoders_[type] = Encoder(codec_id, width, height, pix_fmt, demuxer.getStreamTimeBase(type),
-                              muxer_.getGlobalHeaderFlags(), enc_options);
+    std::map<std::string, std::string> options = enc_options;
+    if (useRoiEncoding(codec_id, video_params, options))
+        branch.activity_map = std::make_unique<ActivityMap>(output_width, output_height, pix_fmt);
+    branch.encoder = Encoder(codec_id, output_width, output_height, pix_fmt, time_base,
+                             global_header_flags_, options);
+    if (useSceneAdaptiveEncoding(codec_id, video_params, options)) {
+        /* the x264 defaults: CRF 23 and keyframes every 250 frames */
+        branch.base_crf = options.count("crf") ? std::stof(options.at("crf")) : 23;
+        const int gop_size = branch.encoder.getContext()->gop_size > 0 ? branch.encoder.getContext()->gop_size : 250;
+        branch.scene_classifier = std::make_unique<SceneClassifier>(output_width, output_height, pix_fmt, gop_size);
+    }
 
     /* Init converter */
-    converters_[type] = Converter(decoders_[type].getContext(), encoders_[type].getContext(),
-                                  demuxer.getStreamTimeBase(type), offset_x, offset_y);
+    branch.converter = Converter(chain.decoder.getContext(), branch.encoder.getContext(),
+                                 time_base, width, height, offset_x, offset_y,
+                                 getSwsFlags(video_params.getScalingAlgorithm()), video_params.getConversionSlices());
+
+    chain.branches.push_back(std::move(branch));
+    chains_.push_back(std::move(chain));
+    const int stream = static_cast<int>(chains_.size()) - 1;
+    if (async_) startProcessor(stream);
+    return stream;
+}
 
-    muxer_.addStream(encoders_[type].getContext());
+int Pipeline::initVideoLadder(const Demuxer &demuxer, const AVCodecID codec_id, const AVPixelFormat pix_fmt,
+                              const VideoParameters &video_params, const std::vector<Rendition> &renditions,
+                              const std::map<std::string, std::string> &enc_options) {
+    return initVideoLadder(demuxer.getStreamParams(av::MediaType::Video),
+                           demuxer.getStreamTimeBase(av::MediaType::Video), codec_id, pix_fmt, video_params, renditions,
+                           enc_options);
+}
 
-    if (async_) startProcessor(type);
+int Pipeline::initVideoLadder(const AVCodecParameters *stream_params, const AVRational time_base,
+                              const AVCodecID codec_id, const AVPixelFormat pix_fmt,
+                              const VideoParameters &video_params, const std::vector<Rendition> &renditions,
+                              const std::map<std::string, std::string> &enc_options) {
+    const auto type = av::MediaType::Video;
+
+    checkCanAddChain();
+    checkStreamType(stream_params, type);
+    if (renditions.empty()) throw std::invalid_argument(errMsg("the ladder must have at least one rendition"));
+
+    Chain chain;
+    chain.type = type;
+    chain.time_base = time_base;
+
+    /* Init decoder (shared by all the renditions) */
+    chain.decoder = Decoder(stream_params);
+
+    auto [width, height, offset_x, offset_y] = getCropArea(chain.decoder.getContext(), video_params);
+
+    /* fixed and aligned GOPs, so that the players can switch rendition at any keyframe */
+    std::map<std::string, std::string> ladder_options = enc_options;
+    if (!ladder_options.count("g")) {
+        int framerate = video_params.getFramerate() ? video_params.getFramerate() : 30;
+        ladder_options["g"] = std::to_string(2 * framerate);
+    }
+    ladder_options["keyint_min"] = ladder_options["g"];
+    ladder_options["sc_threshold"] = "0";
+    const bool roi_encoding = useRoiEncoding(codec_id, video_params, ladder_options);
+    const bool scene_adaptive_encoding = useSceneAdaptiveEncoding(codec_id, video_params, ladder_options);
+    /* the x264 default CRF */
+    const float base_crf = ladder_options.count("crf") ? std::stof(ladder_options.at("crf")) : 23;
+
+    std::vector<std::unique_ptr<Muxer>> extra_muxers;
+    for (const auto &rendition : renditions) {
+        auto [output_width, output_height] = rendition.getSize();
+
+        Branch branch;
+
+        if (!rendition.getOutputFile().empty()) {
+            auto muxer = std::make_unique<Muxer>(rendition.getOutputFile());
+            if ((muxer->getGlobalHeaderFlags() & AVFMT_GLOBALHEADER) != (global_header_flags_ & AVFMT_GLOBALHEADER))
+                throw std::invalid_argument(errMsg("the output format of a rendition is not compatible"));
+            extra_muxers.push_back(std::move(muxer));
+            branch.muxer = extra_muxers_.size() + extra_muxers.size();
+        }
+
+        /*
+         * Init encoder, constraining the bitrate with a VBV buffer of 2 seconds
+         * (with a capped CRF instead of the average bitrate if the CRF adapts to the content)
+         */
+        std::map<std::string, std::string> options = ladder_options;
+        if (scene_adaptive_encoding) {
+            options["crf"] = std::to_string(base_crf);
+            branch.base_crf = base_crf;
+        } else {
+            options["b"] = std::to_string(rendition.getBitrate());
+        }
+        options["maxrate"] = std::to_string(rendition.getBitrate());
+        options["bufsize"] = std::to_string(2 * rendition.getBitrate());
+        if (roi_encoding) branch.activity_map = std::make_unique<ActivityMap>(output_width, output_height, pix_fmt);
+        branch.encoder = Encoder(codec_id, output_width, output_height, pix_fmt, time_base,
+                                 global_header_flags_, options);
+        /* the first rendition classifies the scene for all of them, a window per GOP */
+        if (scene_adaptive_encoding && chain.branches.empty())
+            branch.scene_classifier = std::make_unique<SceneClassifier>(output_width, output_height, pix_fmt,
+                                                                        std::stoi(ladder_options.at("g")));
+
+        /* Init converter */
+        branch.converter =
+            Converter(chain.decoder.getContext(), branch.encoder.getContext(), time_base, width,
+                      height, offset_x, offset_y, getSwsFlags(video_params.getScalingAlgorithm()),
+                      video_params.getConversionSlices());
+
+        chain.branches.push_back(std::move(branch));
+    }
+
+    for (auto &muxer : extra_muxers) extra_muxers_.push_back(std::move(muxer));
+    chains_.push_back(std::move(chain));
+    const int stream = static_cast<int>(chains_.size()) - 1;
+    if (async_) startProcessor(stream);
+    return stream;
+}
+
+int Pipeline::initAudio(const Demuxer &demuxer, const AVCodecID codec_id,
+                        const std::map<std::string, std::string> &enc_options) {
+    return initAudio(demuxer.getStreamParams(av::MediaType::Audio), demuxer.getStreamTimeBase(av::MediaType::Audio),
+                     codec_id, enc_options);
 }
 
-void Pipeline::initAudio(const Demuxer &demuxer, const AVCodecID codec_id) {
+int Pipeline::initAudio(const AVCodecParameters *stream_params, const AVRational time_base, const AVCodecID codec_id,
+                        const std::map<std::string, std::string> &enc_options) {
     const auto type = av::MediaType::Audio;
 
-    if (muxer_.isInited()) throw std::logic_error(errMsg("output has already been initialized"));
-    if (terminated_) throw std::logic_error(errMsg("already terminated"));
-    if (managed_types_[type]) throw std::logic_error(errMsg("audio pipeline already initialized"));
+    checkCanAddChain();
+    checkStreamType(stream_params, type);
 
-    managed_types_[type] = true;
+    Chain chain;
+    chain.type = type;
+    chain.time_base = time_base;
 
     /* Init decoder */
-    decoders_[type] = Decoder(demuxer.getStreamParams(type));
+    chain.decoder = Decoder(stream_params);
 
-    auto dec_ctx = decoders_[type].getContext();
+    auto dec_ctx = chain.decoder.getContext();
     uint64_t channel_layout;
     if (dec_ctx->channel_layout) {
         channel_layout = dec_ctx->channel_layout;
@@ -117,31 +313,258 @@ void Pipeline::initAudio(const Demuxer &demuxer, const AVCodecID codec_id) {
         channel_layout = av_get_default_channel_layout(dec_ctx->channels);
     }
 
+    Branch branch;
+
     /* Init encoder */
-    encoders_[type] = Encoder(codec_id, dec_ctx->sample_rate, channel_layout, muxer_.getGlobalHeaderFlags(),
-                              std::map<std::string, std::string>());
+    branch.encoder = Encoder(codec_id, dec_ctx->sample_rate, channel_layout, global_header_flags_, enc_options);
+
+    initSilenceDetector(branch, codec_id, enc_options);
 
     /* Init converter */
-    converters_[type] =
-        Converter(decoders_[type].getContext(), encoders_[type].getContext(), demuxer.getStreamTimeBase(type));
+    branch.converter =
+        Converter(chain.decoder.getContext(), branch.encoder.getContext(), time_base);
+
+    chain.branches.push_back(std::move(branch));
+    chains_.push_back(std::move(chain));
+    const int stream = static_cast<int>(chains_.size()) - 1;
+    if (async_) startProcessor(stream);
+    return stream;
+}
+
+std::vector<int> Pipeline::initAudioMix(const std::vector<AudioInput> &inputs, const AVCodecID codec_id,
+                                        const std::map<std::string, std::string> &enc_options) {
+    const auto type = av::MediaType::Audio;
+
+    checkCanAddChain();
+    if (inputs.empty()) throw std::invalid_argument(errMsg("the mix must have at least one input"));
+    for (const auto &input : inputs) checkStreamType(input.params, type);
+
+    /* Init decoders */
+    std::vector<Chain> input_chains;
+    for (const auto &input : inputs) {
+        Chain chain;
+        chain.type = type;
+        chain.decoder = Decoder(input.params);
+        chain.time_base = input.time_base;
+        input_chains.push_back(std::move(chain));
+    }
 
-    muxer_.addStream(encoders_[type].getContext());
+    auto dec_ctx = input_chains.front().decoder.getContext();
+    uint64_t channel_layout;
+    if (dec_ctx->channel_layout) {
+        channel_layout = dec_ctx->channel_layout;
+    } else {
+        channel_layout = av_get_default_channel_layout(dec_ctx->channels);
+    }
 
-    if (async_) startProcessor(type);
+    /* Init encoder and mixer (the chain of the mixed output follows the inputs ones, so that it's flushed last) */
+    Chain output;
+    output.type = type;
+    Branch branch;
+    branch.encoder = Encoder(codec_id, dec_ctx->sample_rate, channel_layout, global_header_flags_, enc_options);
+    initSilenceDetector(branch, codec_id, enc_options);
+    output.mixer = std::make_shared<AudioMixer>(branch.encoder.getContext(), inputs.size());
+    output.branches.push_back(std::move(branch));
+    const AVCodecContext *enc_ctx = output.branches.front().encoder.getContext();
+
+    /* Init converters */
+    const auto first_stream = static_cast<int>(chains_.size());
+    std::vector<int> streams;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        Chain &chain = input_chains[i];
+        /* the mixer repacks the samples in encoder frames, the converter must not hold back another frame */
+        chain.mix_converter = Converter(chain.decoder.getContext(), enc_ctx, chain.time_base, false);
+        chain.mixer = output.mixer;
+        chain.mix_input = static_cast<int>(i);
+        chain.mix_chain = first_stream + static_cast<int>(inputs.size());
+        chain.mixer->setGain(i, inputs[i].gain);
+        chains_.push_back(std::move(chain));
+        streams.push_back(first_stream + static_cast<int>(i));
+    }
+    chains_.push_back(std::move(output));
+    if (async_) {
+        for (auto stream : streams) startProcessor(stream);
+    }
+    return streams;
+}
+
+void Pipeline::setAudioGain(const int stream, const float gain) {
+    if (stream < 0 || stream >= static_cast<int>(chains_.size()) || chains_[stream].mix_input < 0)
+        throw std::invalid_argument(errMsg("the stream is not a mixed audio input"));
+    chains_[stream].mixer->setGain(chains_[stream].mix_input, gain);
+}
+
+void Pipeline::initSilenceDetector(Branch &branch, const AVCodecID codec_id,
+                                   const std::map<std::string, std::string> &enc_options) const {
+    const AVCodecContext *enc_ctx = branch.encoder.getContext();
+    if (!detect_silence_ || !enc_ctx->frame_size) return;  // e.g. PCM, cheap enough to be always encoded
+    /* the silent packet is encoded by an encoder with the same settings */
+    branch.silence_detector = std::make_unique<SilenceDetector>(
+        Encoder(codec_id, enc_ctx->sample_rate, enc_ctx->channel_layout, global_header_flags_, enc_options),
+        silence_threshold_, silence_hold_time_);
 }
 
 void Pipeline::initOutput() {
-    if (muxer_.isInited()) throw std::logic_error(errMsg("output has already been initialized"));
+    if (muxer_->isInited()) throw std::logic_error(errMsg("output has already been initialized"));
     if (terminated_) throw std::logic_error(errMsg("already terminated"));
-    muxer_.initFile();
+    for (auto &chain : chains_) {
+        for (auto &branch : chain.branches)
+            branch.muxer_stream = getMuxer(branch.muxer).addStream(branch.encoder.getContext());
+    }
+    /* the keyframes of the first video stream of the main output start its segments (see Muxer) */
+    segment_chain_ = -1;
+    for (int stream = 0; segment_duration_ && stream < static_cast<int>(chains_.size()); stream++) {
+        if (chains_[stream].type != av::MediaType::Video) continue;
+        for (auto &branch : chains_[stream].branches) {
+            if (!branch.muxer && segment_chain_ < 0) segment_chain_ = stream;
+        }
+    }
+    if (max_interleave_bytes_) {
+        muxer_->setInterleaving(max_interleave_delta_, max_interleave_bytes_);
+        for (auto &muxer : extra_muxers_) muxer->setInterleaving(max_interleave_delta_, max_interleave_bytes_);
+    }
+    if (write_callback_) {
+        for (size_t index = 0; index <= extra_muxers_.size(); index++) {
+            /* the type and the chain of each stream of the muxer */
+            std::vector<av::MediaType> types;
+            std::vector<size_t> streams;
+            for (size_t stream = 0; stream < chains_.size(); stream++) {
+                for (auto &branch : chains_[stream].branches) {
+                    if (branch.muxer != index) continue;
+                    const auto muxer_stream = static_cast<size_t>(branch.muxer_stream);
+                    if (types.size() <= muxer_stream) {
+                        types.resize(muxer_stream + 1, av::MediaType::None);
+                        streams.resize(muxer_stream + 1);
+                    }
+                    types[muxer_stream] = chains_[stream].type;
+                    streams[muxer_stream] = stream;
+                }
+            }
+            /*
+             * output_start_ and the input start of the chain were set before queuing the first packet of the output,
+             * hence the writer thread (which dequeued it under the same lock) sees them
+             */
+            getMuxer(index).setWriteCallback([this, types, streams](const int stream_index, const int64_t pts) {
+                const int64_t input_start = chains_[streams[stream_index]].input_start;
+                write_callback_(types[stream_index],
+                                pts + output_start_ + (input_start == AV_NOPTS_VALUE ? 0 : input_start));
+            });
+        }
+    }
+    if (!frame_export_name_.empty() && !frame_export_) {
+        /* the frames are exported in the format and size of the encoder input */
+        std::vector<av::CodecParametersUPtr> params;
+        std::vector<FrameRing::Stream> streams;
+        for (auto &chain : chains_) {
+            if (chain.type != av::MediaType::Video) continue;
+            const AVCodecContext *enc_ctx = chain.branches[0].encoder.getContext();
+            params.emplace_back(avcodec_parameters_alloc());
+            if (!params.back()) throw std::runtime_error(errMsg("failed to allocate the export parameters"));
+            params.back()->codec_type = AVMEDIA_TYPE_VIDEO;
+            params.back()->codec_id = AV_CODEC_ID_RAWVIDEO;
+            params.back()->format = enc_ctx->pix_fmt;
+            params.back()->width = enc_ctx->width;
+            params.back()->height = enc_ctx->height;
+            chain.export_stream = static_cast<int>(streams.size());
+            streams.push_back({params.back().get(), enc_ctx->time_base});
+        }
+        if (streams.empty()) throw std::logic_error(errMsg("no video streams to export"));
+        frame_export_ = std::make_unique<FrameRing>(frame_export_name_, streams, frame_export_slots);
+    }
+    muxer_->initFile();
+    for (auto &muxer : extra_muxers_) muxer->initFile();
+
+    writer_stopped_ = false;
+    writer_ = std::thread([this]() { runWriter(); });
+}
+
+Muxer &Pipeline::getMuxer(const size_t index) {
+    assert(index <= extra_muxers_.size());
+    return index ? *extra_muxers_[index - 1] : *muxer_;
 }
 
-void Pipeline::processPacket(const AVPacket *packet, const av::MediaType type) {
-    assert(av::validMediaType(type));
-    assert(managed_types_[type]);
+void Pipeline::processPacket(const AVPacket *packet, const int stream) {
+    assert(stream >= 0 && stream < chains_.size());
+
+    /* the mixed output has no input packets, its frames are mixed by the chains of the inputs */
+    if (chains_[stream].mixer && chains_[stream].mix_input < 0) {
+        if (!packet) encodeMix(stream, true);
+        return;
+    }
+
+    Decoder &decoder = chains_[stream].decoder;
+    std::vector<Branch> &branches = chains_[stream].branches;
+    const bool video = chains_[stream].type == av::MediaType::Video;
+
+    /* serve the keyframe requests received since the last packet */
+    bool force_keyframe = false;
+    if (video) {
+        const uint64_t requests = keyframe_requests_.load(std::memory_order_relaxed);
+        force_keyframe = requests != chains_[stream].keyframe_requests;
+        chains_[stream].keyframe_requests = requests;
+    }
+
+    auto convert = [&branches](const size_t b, av::FrameUPtr frame) {
+        Converter &converter = branches[b].converter;
+        converter.sendFrame(std::move(frame));
 
-    Decoder &decoder = decoders_[type];
-    Converter &converter = converters_[type];
+        std::vector<av::FrameUPtr> converted_frames;
+        while (true) {
+            auto converted_frame = converter.getFrame();
+            if (!converted_frame) break;
+            converted_frames.push_back(std::move(converted_frame));
+        }
+        return converted_frames;
+    };
+
+    /* the scene is classified on the frames of the first branch, before any branch encodes them */
+    auto classify = [&branches](const std::vector<av::FrameUPtr> &converted_frames) {
+        std::vector<bool> scene_changes(converted_frames.size());
+        SceneClassifier *scene_classifier = branches.front().scene_classifier.get();
+        if (!scene_classifier) return scene_changes;
+        for (size_t i = 0; i < converted_frames.size(); i++)
+            scene_changes[i] = scene_classifier->process(converted_frames[i].get());
+        return scene_changes;
+    };
+
+    /*
+     * the frames starting the segments of the output are forced to be keyframes (in all the branches), so that the
+     * muxer starts each segment after its nominal duration exactly, and no segment exceeds the target duration
+     */
+    auto segment = [this, stream, &branches](const std::vector<av::FrameUPtr> &converted_frames) {
+        std::vector<bool> segment_starts(converted_frames.size());
+        if (stream != segment_chain_) return segment_starts;
+        int64_t &segment_start = chains_[stream].segment_start;
+        const AVRational time_base = branches.front().encoder.getContext()->time_base;
+        const int64_t duration = static_cast<int64_t>(segment_duration_) * AV_TIME_BASE;
+        for (size_t i = 0; i < converted_frames.size(); i++) {
+            const int64_t ts = av_rescale_q(converted_frames[i]->pts, time_base, AV_TIME_BASE_Q);
+            if (segment_start != AV_NOPTS_VALUE && ts - segment_start < duration) continue;
+            /* the first frame is a keyframe anyway */
+            segment_starts[i] = segment_start != AV_NOPTS_VALUE;
+            segment_start = ts;
+        }
+        return segment_starts;
+    };
+
+    auto encode = [this, stream, video, &force_keyframe, &branches](const size_t b, AVFrame *converted_frame,
+                                                                     const bool scene_change,
+                                                                     const bool segment_start) {
+        /* the decoders of the capture devices mark every frame as intra, let the encoder choose the types */
+        if (video)
+            converted_frame->pict_type =
+                force_keyframe || segment_start ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        if (scene_change) {
+            /* the new CRF starts with a keyframe, in all the branches together (keeping the ladder GOPs aligned) */
+            const float crf = branches[b].base_crf + getCrfOffset(branches.front().scene_classifier->getScene());
+            branches[b].encoder.setOption("crf", std::to_string(crf));
+            converted_frame->pict_type = AV_PICTURE_TYPE_I;
+        }
+        if (b == 0 && chains_[stream].export_stream >= 0)
+            frame_export_->writeFrame(converted_frame, chains_[stream].export_stream);
+        if (branches[b].activity_map) branches[b].activity_map->process(converted_frame);
+        processConvertedFrame(converted_frame, stream, b);
+    };
 
     bool decoder_received = false;
     while (!decoder_received) {
@@ -150,22 +573,60 @@ void Pipeline::processPacket(const AVPacket *packet, const av::MediaType type) {
         while (true) {
             auto frame = decoder.getFrame();
             if (!frame) break;
-            converter.sendFrame(std::move(frame));
-
-            while (true) {
-                auto converted_frame = converter.getFrame();
-                if (!converted_frame) break;
-                processConvertedFrame(converted_frame.get(), type);
+            chains_[stream].frames++;
+            if (chains_[stream].input_start == AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE)
+                chains_[stream].input_start = av_rescale_q(frame->pts, chains_[stream].time_base, AV_TIME_BASE_Q);
+
+            if (chains_[stream].mixer) {
+                mixFrame(std::move(frame), stream);
+            } else if (branches.size() == 1) {
+                auto converted_frames = convert(0, std::move(frame));
+                const auto scene_changes = classify(converted_frames);
+                const auto segment_starts = segment(converted_frames);
+                for (size_t i = 0; i < converted_frames.size(); i++)
+                    encode(0, converted_frames[i].get(), scene_changes[i], segment_starts[i]);
+            } else {
+                /* each branch gets a new reference to the same frame data */
+                std::vector<av::FrameUPtr> frames;
+                for (size_t b = 0; b < branches.size(); b++) {
+                    frames.emplace_back(av_frame_clone(frame.get()));
+                    if (!frames.back()) throw std::runtime_error(errMsg("failed to reference the decoded frame"));
+                }
+                std::vector<std::vector<av::FrameUPtr>> converted_frames(branches.size());
+                Executor::shared().parallelFor(branches.size(), [&convert, &frames, &converted_frames](const size_t b) {
+                    converted_frames[b] = convert(b, std::move(frames[b]));
+                });
+                /* the video converters output a frame for each input one, the same in all the branches */
+                const auto scene_changes = classify(converted_frames.front());
+                const auto segment_starts = segment(converted_frames.front());
+                Executor::shared().parallelFor(
+                    branches.size(), [&encode, &converted_frames, &scene_changes, &segment_starts](const size_t b) {
+                        for (size_t i = 0; i < converted_frames[b].size(); i++) {
+                            const bool planned = i < scene_changes.size();
+                            encode(b, converted_frames[b][i].get(), planned && scene_changes[i],
+                                   planned && segment_starts[i]);
+                        }
+                    });
             }
+            force_keyframe = false;
         }
     }
 }
 
-void Pipeline::processConvertedFrame(const AVFrame *frame, const av::MediaType type) {
-    assert(av::validMediaType(type));
-    assert(managed_types_[type]);
+void Pipeline::requestKeyframe() { keyframe_requests_.fetch_add(1, std::memory_order_relaxed); }
+
+void Pipeline::processConvertedFrame(const AVFrame *frame, const int stream, const size_t branch) {
+    assert(stream >= 0 && stream < chains_.size());
+    assert(branch < chains_[stream].branches.size());
 
-    Encoder &encoder = encoders_[type];
+    Encoder &encoder = chains_[stream].branches[branch].encoder;
+    SilenceDetector *silence_detector = chains_[stream].branches[branch].silence_detector.get();
+
+    /* a silent frame isn't encoded, the encoder gets the next frame above the threshold */
+    if (frame && silence_detector && silence_detector->process(frame)) {
+        writePacket(silence_detector->getSilentPacket(), stream, branch);
+        return;
+    }
 
     bool encoder_received = false;
     while (!encoder_received) {
@@ -174,34 +635,178 @@ void Pipeline::processConvertedFrame(const AVFrame *frame, const av::MediaType t
         while (true) {
             auto packet = encoder.getPacket();
             if (!packet) break;
+            if (silence_detector) silence_detector->setTimestamps(packet.get());
+            writePacket(std::move(packet), stream, branch);
+        }
+    }
+}
+
+void Pipeline::mixFrame(av::FrameUPtr frame, const int stream) {
+    Chain &chain = chains_[stream];
+    const int sample_rate = chains_[chain.mix_chain].branches.front().encoder.getContext()->sample_rate;
+
+    /* the inputs are aligned on the timestamps of their first frames, the converted ones are contiguous */
+    if (chain.mix_start == AV_NOPTS_VALUE) {
+        chain.mix_start =
+            frame->pts == AV_NOPTS_VALUE ? 0 : av_rescale_q(frame->pts, chain.time_base, {1, sample_rate});
+    }
+    chain.mix_converter.sendFrame(std::move(frame));
+    while (true) {
+        auto converted_frame = chain.mix_converter.getFrame();
+        if (!converted_frame) break;
+        const int64_t position = chain.mix_start + converted_frame->pts;
+        /* the mixed frames are rebased on the position of the first frame sent to the mixer */
+        Chain &output = chains_[chain.mix_chain];
+        if (output.input_start == AV_NOPTS_VALUE)
+            output.input_start = av_rescale_q(position, {1, sample_rate}, AV_TIME_BASE_Q);
+        chain.mixer->sendFrame(chain.mix_input, converted_frame.get(), position);
+    }
+    encodeMix(chain.mix_chain, false);
+}
+
+void Pipeline::encodeMix(const int stream, const bool flush) {
+    AudioMixer &mixer = *chains_[stream].mixer;
+    while (true) {
+        auto mixed_frame = mixer.getFrame(flush);
+        if (!mixed_frame) break;
+        processConvertedFrame(mixed_frame.get(), stream, 0);
+    }
+}
+
+void Pipeline::writePacket(av::PacketUPtr packet, const int stream, const size_t branch) {
+    const Branch &b = chains_[stream].branches[branch];
+    const AVRational time_base = b.encoder.getContext()->time_base;
+
+    std::unique_lock ul(writer_m_);
+    /* the packets are written in background, the encoders wait only if the output can't keep up with them */
+    writer_cv_.wait(ul, [this]() { return queued_bytes_ < max_queued_bytes || writer_e_ptr_; });
+    if (writer_e_ptr_) std::rethrow_exception(writer_e_ptr_);
+    /* the first packet written to a restarted output defines its start time (the same for all the streams) */
+    if (output_start_ == AV_NOPTS_VALUE) output_start_ = av_rescale_q(packet->pts, time_base, AV_TIME_BASE_Q);
+    if (output_start_) {
+        int64_t offset = av_rescale_q(output_start_, AV_TIME_BASE_Q, time_base);
+        packet->pts -= offset;
+        packet->dts -= offset;
+    }
+    queued_bytes_ += packet->size;
+    write_queue_.push_back({std::move(packet), b.muxer, b.muxer_stream});
+    writer_cv_.notify_all();
+}
+
+void Pipeline::runWriter() {
+    try {
+        while (true) {
+            QueuedPacket queued;
+            {
+                std::unique_lock ul(writer_m_);
+                writer_cv_.wait(ul, [this]() { return !write_queue_.empty() || writer_stopped_; });
+                if (write_queue_.empty()) break;
+                queued = std::move(write_queue_.front());
+                write_queue_.pop_front();
+                queued_bytes_ -= queued.packet->size;
+                writer_cv_.notify_all();
+            }
             std::lock_guard lg(muxer_m_);
-            muxer_.writePacket(std::move(packet), type);
+            getMuxer(queued.muxer).writePacket(std::move(queued.packet), queued.muxer_stream);
         }
+    } catch (...) {
+        std::lock_guard lg(writer_m_);
+        writer_e_ptr_ = std::current_exception();
+        write_queue_.clear();
+        queued_bytes_ = 0;
+        writer_cv_.notify_all();
     }
 }
 
-void Pipeline::feed(av::PacketUPtr packet, const av::MediaType packet_type) {
+void Pipeline::stopWriter() {
+    {
+        std::lock_guard lg(writer_m_);
+        writer_stopped_ = true;
+        writer_cv_.notify_all();
+    }
+    writer_.join();
+    if (writer_e_ptr_) std::rethrow_exception(std::exchange(writer_e_ptr_, nullptr));
+}
+
+void Pipeline::feed(av::PacketUPtr packet, const int stream) {
     if (!packet) throw std::invalid_argument(errMsg("received packet is null"));
-    if (!av::validMediaType(packet_type)) throw std::invalid_argument(errMsg("received media type is invalid"));
-    if (!muxer_.isInited()) throw std::logic_error(errMsg("the output file hasn't been initialized yet"));
+    if (stream < 0 || stream >= static_cast<int>(chains_.size()) ||
+        (chains_[stream].mixer && chains_[stream].mix_input < 0))
+        throw std::invalid_argument(errMsg("received stream is not handled by the pipeline"));
+    if (!muxer_->isInited()) throw std::logic_error(errMsg("the output file hasn't been initialized yet"));
     if (terminated_) throw std::logic_error(errMsg("has been terminated"));
-    if (!managed_types_[packet_type])
-        throw std::logic_error(errMsg("received media type is not handled by the pipeline"));
 
     if (async_) {
+        Chain &chain = chains_[stream];
+        /* wait without the lock, which is needed by the processing tasks */
+        if (max_queued_packets_) chain.processor->waitQueuedBelow(max_queued_packets_);
+
         std::lock_guard lg(processors_m_);
         checkExceptions();
-        if (!packets_[packet_type]) {  // if previous packet has been fully processed
-            packets_[packet_type] = std::move(packet);
-            packets_cv_[packet_type].notify_all();
+        /* drop the video packet if the previous one is still waiting to be processed (unless waiting for it) */
+        if (max_queued_packets_ || chain.type == av::MediaType::Audio || !chain.processor->getQueuedTasks()) {
+            std::shared_ptr<AVPacket> shared_packet(packet.release(), DeleterPP<av_packet_free>());
+            chain.processor->post([this, shared_packet, stream]() {
+                try {
+                    {
+                        std::lock_guard lg(processors_m_);
+                        if (chains_[stream].e_ptr) return;  // the processing chain already failed
+                    }
+                    processPacket(shared_packet.get(), stream);
+                } catch (...) {
+                    std::lock_guard lg(processors_m_);
+                    chains_[stream].e_ptr = std::current_exception();
+                }
+            });
         }
     } else {
-        processPacket(packet.get(), packet_type);
+        processPacket(packet.get(), stream);
     }
 }
 
+void Pipeline::setBackpressure(const size_t max_queued_packets) { max_queued_packets_ = max_queued_packets; }
+
+void Pipeline::setInterleaving(const int64_t max_delta, const size_t max_bytes) {
+    if (muxer_->isInited()) throw std::logic_error(errMsg("output has already been initialized"));
+    if (max_delta < 0) throw std::invalid_argument(errMsg("the maximum interleaving delta can't be negative"));
+    if (!max_bytes) throw std::invalid_argument(errMsg("the maximum interleaving size must be > 0"));
+    max_interleave_delta_ = max_delta;
+    max_interleave_bytes_ = max_bytes;
+}
+
+void Pipeline::setSilenceDetection(const float threshold, const int64_t hold_time) {
+    if (muxer_->isInited()) throw std::logic_error(errMsg("output has already been initialized"));
+    if (threshold > 0) throw std::invalid_argument(errMsg("the silence threshold can't be above 0 dBFS"));
+    if (hold_time < 0) throw std::invalid_argument(errMsg("the silence hold time can't be negative"));
+    detect_silence_ = true;
+    silence_threshold_ = threshold;
+    silence_hold_time_ = hold_time;
+}
+
+void Pipeline::setWriteCallback(std::function<void(av::MediaType, int64_t)> callback) {
+    if (muxer_->isInited()) throw std::logic_error(errMsg("output has already been initialized"));
+    write_callback_ = std::move(callback);
+}
+
+void Pipeline::setFrameExport(const std::string &name) {
+    if (muxer_->isInited()) throw std::logic_error(errMsg("output has already been initialized"));
+    if (name.empty()) throw std::invalid_argument(errMsg("the name of the frame export can't be empty"));
+    frame_export_name_ = name;
+}
+
+int64_t Pipeline::getDecodedFrames(const int stream) const {
+    if (stream < 0 || stream >= static_cast<int>(chains_.size()))
+        throw std::invalid_argument(errMsg("stream is not handled by the pipeline"));
+    return chains_[stream].frames;
+}
+
+Interleaver::Stats Pipeline::getInterleaverStats() {
+    std::lock_guard lg(muxer_m_);
+    return muxer_->getInterleaverStats();
+}
+
 void Pipeline::terminate() {
-    if (!muxer_.isInited()) throw std::logic_error(errMsg("the output file hasn't been initialized yet"));
+    if (!muxer_->isInited()) throw std::logic_error(errMsg("the output file hasn't been initialized yet"));
     if (terminated_) throw std::logic_error(errMsg("already terminated"));
 
     if (async_) {
@@ -212,23 +817,115 @@ void Pipeline::terminate() {
     }
 
     /* flush the pipelines */
-    for (auto type : av::validMediaTypes) {
-        if (managed_types_[type]) {
-            processPacket(nullptr, type);
-            processConvertedFrame(nullptr, type);
+    for (int stream = 0; stream < static_cast<int>(chains_.size()); stream++) {
+        processPacket(nullptr, stream);
+        for (size_t branch = 0; branch < chains_[stream].branches.size(); branch++)
+            processConvertedFrame(nullptr, stream, branch);
+    }
+    stopWriter();
+
+    for (size_t index = 0; index <= extra_muxers_.size(); index++) {
+        getMuxer(index).writePacket(nullptr, -1);
+        getMuxer(index).finalizeFile();
+    }
+}
+
+void Pipeline::restart(const std::string &output_file) {
+    if (!terminated_) throw std::logic_error(errMsg("cannot restart a pipeline that hasn't been terminated"));
+    if (!extra_muxers_.empty()) throw std::logic_error(errMsg("cannot restart a pipeline writing to several files"));
+
+    /* the writer thread of the previous output is still running if its termination failed */
+    if (writer_.joinable()) {
+        try {
+            stopWriter();
+        } catch (...) {
+            // the previous output already failed, and terminate() reported it
         }
     }
 
-    muxer_.writePacket(nullptr, av::MediaType::None);
-    muxer_.finalizeFile();
+    auto muxer = std::make_unique<Muxer>(output_file, segment_duration_);
+    if ((muxer->getGlobalHeaderFlags() & AVFMT_GLOBALHEADER) != (global_header_flags_ & AVFMT_GLOBALHEADER))
+        throw std::invalid_argument(errMsg("the new output format is not compatible with the current encoders"));
+
+    for (auto &chain : chains_) {
+        if (chain.decoder.getContext()) chain.decoder.reset();  // the mixed outputs have no decoder
+        chain.input_start = AV_NOPTS_VALUE;
+        if (chain.mix_input >= 0) {
+            chain.mix_converter.reset();
+            chain.mix_start = AV_NOPTS_VALUE;
+        } else if (chain.mixer) {
+            chain.mixer->reset();
+        }
+        for (auto &branch : chain.branches) {
+            branch.converter.reset();
+            branch.encoder.reset();
+            if (branch.activity_map) branch.activity_map->reset();
+            if (branch.scene_classifier) branch.scene_classifier->reset();
+            if (branch.silence_detector) branch.silence_detector->reset();
+        }
+        chain.segment_start = AV_NOPTS_VALUE;
+        chain.e_ptr = nullptr;
+    }
+
+    muxer_ = std::move(muxer);
+    output_start_ = AV_NOPTS_VALUE;
+    terminated_ = false;
+    initOutput();
+
+    if (async_) {
+        for (int stream = 0; stream < static_cast<int>(chains_.size()); stream++) startProcessor(stream);
+    }
 }
 
 void Pipeline::printInfo() const {
-    muxer_.printInfo();
-    for (auto type : av::validMediaTypes) {
-        if (managed_types_[type]) {
-            std::cout << "Decoder " << type << ": " << decoders_[type].getName() << std::endl;
-            std::cout << "Encoder " << type << ": " << encoders_[type].getName() << std::endl;
+    muxer_->printInfo();
+    for (const auto &muxer : extra_muxers_) muxer->printInfo();
+    for (size_t stream = 0; stream < chains_.size(); stream++) {
+        const Chain &chain = chains_[stream];
+        if (chain.decoder.getContext())
+            std::cout << "Decoder " << stream << " (" << chain.type << "): " << chain.decoder.getName() << std::endl;
+        for (const auto &branch : chain.branches)
+            std::cout << "Encoder " << stream << " (" << chain.type << "): " << branch.encoder.getName() << std::endl;
+    }
+}
+
+void Pipeline::printStats() const {
+    using Scene = SceneClassifier::Scene;
+    for (size_t stream = 0; stream < chains_.size(); stream++) {
+        for (const auto &branch : chains_[stream].branches) {
+            if (!branch.scene_classifier) continue;
+            const auto &stats = branch.scene_classifier->getStats();
+            std::cout << "Scene classifier " << stream << ": " << stats.frames << " frames (";
+            for (auto scene : {Scene::Idle, Scene::Text, Scene::Video})
+                std::cout << scene << " " << stats.scene_frames[static_cast<int>(scene)] << ", ";
+            std::cout << "current " << branch.scene_classifier->getScene() << "), "
+                      << (stats.frames ? static_cast<double>(stats.time) / stats.frames : 0) << " us/frame"
+                      << std::endl;
+        }
+    }
+
+    for (size_t stream = 0; stream < chains_.size(); stream++) {
+        for (const auto &branch : chains_[stream].branches) {
+            if (!branch.silence_detector) continue;
+            const auto &stats = branch.silence_detector->getStats();
+            std::cout << "Silence detector " << stream << ": " << stats.silent_frames << " of " << stats.frames
+                      << " frames not encoded" << std::endl;
         }
     }
+
+    for (size_t stream = 0; stream < chains_.size(); stream++) {
+        const Chain &chain = chains_[stream];
+        if (!chain.mixer || chain.mix_input >= 0) continue;
+        std::cout << "Audio mixer " << stream << ": " << chain.mixer->getNumInputs() << " inputs, "
+                  << chain.mixer->getClippedSamples() << " samples clipped" << std::endl;
+    }
+
+    for (size_t index = 0; index <= extra_muxers_.size(); index++) {
+        const Muxer &muxer = index ? *extra_muxers_[index - 1] : *muxer_;
+        if (!muxer.isInited()) continue;
+        const auto stats = muxer.getInterleaverStats();
+        std::cout << "Interleaver " << index << ": " << stats.queued_packets << " packets queued (max "
+                  << stats.max_queued_packets << "), " << stats.queued_bytes << " bytes queued (max "
+                  << stats.max_queued_bytes << "), " << stats.forced_packets << " packets written early" << std::endl;
+    }
 }
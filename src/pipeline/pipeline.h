@@ -1,52 +1,200 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include "common/common.h"
 #include "format/demuxer.h"
+#include "format/frame_ring.h"
 #include "format/muxer.h"
+#include "process/activity_map.h"
+#include "process/audio_mixer.h"
 #include "process/converter.h"
 #include "process/decoder.h"
 #include "process/encoder.h"
+#include "process/scene_classifier.h"
+#include "process/silence_detector.h"
+#include "rendition.h"
+#include "utils/executor.h"
 #include "video_parameters.h"
 
 class Pipeline {
     const bool async_;
+    /* The duration of the segments of the main output, in seconds (0 if not segmented) */
+    const int segment_duration_;
 
-    std::array<bool, av::MediaType::NumTypes> managed_types_{};
-    std::array<Decoder, av::MediaType::NumTypes> decoders_;
-    std::array<Encoder, av::MediaType::NumTypes> encoders_;
-    std::array<Converter, av::MediaType::NumTypes> converters_;
-    Muxer muxer_;
+    /* The conversion and encoding of the decoded frames to an output stream */
+    struct Branch {
+        Converter converter;
+        Encoder encoder;
+        /* the muxer writing the stream (0 for the main one, i for extra_muxers_[i - 1]) */
+        size_t muxer = 0;
+        /* the index of the stream in the output file */
+        int muxer_stream = -1;
+        /* the screen activity driving the regions of interest of the encoder (if enabled) */
+        std::unique_ptr<ActivityMap> activity_map;
+        /*
+         * the classifier of the screen content switching the encoder CRF with a keyframe (if enabled, only in the
+         * first branch: its scene drives the CRF of all the branches)
+         */
+        std::unique_ptr<SceneClassifier> scene_classifier;
+        /* the CRF requested for the encoder, used for the text scenes */
+        float base_crf = 0;
+        /* the detector of the silent stretches, replaced by a silent packet instead of being encoded (if enabled) */
+        std::unique_ptr<SilenceDetector> silence_detector;
+    };
+
+    /*
+     * The processing chain of a single input stream, from the input packets to the output ones.
+     * The decoded frames are shared (by reference) by all the branches, processed in parallel
+     */
+    struct Chain {
+        av::MediaType type = av::MediaType::None;
+        Decoder decoder;
+        /* the time base of the input packets */
+        AVRational time_base{};
+        std::vector<Branch> branches;
+        /* serial queue on the shared executor, keeping the packets of the stream processed in order */
+        std::shared_ptr<Strand> processor;
+        std::exception_ptr e_ptr;
+        /* the number of keyframe requests already served (video only) */
+        uint64_t keyframe_requests = 0;
+        /* the number of decoded frames */
+        int64_t frames = 0;
+        /* the stream of the frame export ring publishing the converted frames (-1 if not exported) */
+        int export_stream = -1;
+        /*
+         * The input timestamp of the first decoded frame, in AV_TIME_BASE units: the converters rebase the frames on
+         * it, so it's added back to get the input timestamps of the output packets
+         */
+        int64_t input_start = AV_NOPTS_VALUE;
+        /* the timestamp of the frame starting the current segment of the output, in AV_TIME_BASE units */
+        int64_t segment_start = AV_NOPTS_VALUE;
+
+        /*
+         * The audio inputs mixed into a single output stream: their chains have no branches, the decoded frames are
+         * converted to the format of the mix and passed to the mixer shared with the chain of the mixed output,
+         * which has no decoder and whose strand processes all the inputs (so that the mixer needs no locking)
+         */
+        std::shared_ptr<AudioMixer> mixer;
+        /* the input of the mixer fed by the chain (-1 for the chain of the mixed output) */
+        int mix_input = -1;
+        /* the chain of the mixed output (inputs only) */
+        int mix_chain = -1;
+        Converter mix_converter;
+        /* the position of the first decoded frame on the clock of the mix, in samples (inputs only) */
+        int64_t mix_start = AV_NOPTS_VALUE;
+    };
+
+    std::vector<Chain> chains_;
+    /* The chain whose keyframes start the segments of the main output (-1 if it isn't segmented) */
+    int segment_chain_ = -1;
+    std::unique_ptr<Muxer> muxer_;
+    /* The muxers of the renditions written to their own files */
+    std::vector<std::unique_ptr<Muxer>> extra_muxers_;
     std::mutex muxer_m_;
 
+    /* A packet waiting to be written by the writer thread */
+    struct QueuedPacket {
+        av::PacketUPtr packet;
+        size_t muxer;
+        int muxer_stream;
+    };
+    /*
+     * The packets are written to the muxers by a dedicated thread, so that the executor workers never block on the
+     * output I/O (the encoders wait for it only if the output falls behind by tens of megabytes)
+     */
+    std::mutex writer_m_;
+    std::condition_variable writer_cv_;
+    std::deque<QueuedPacket> write_queue_;
+    size_t queued_bytes_{};
+    bool writer_stopped_{};
+    std::exception_ptr writer_e_ptr_;
+    std::thread writer_;
+    /* The global header flags of the output format the encoders have been created for */
+    int global_header_flags_;
+    /* Start time of the current output (in AV_TIME_BASE units), subtracted from the packets written to it */
+    int64_t output_start_ = 0;
+
     bool terminated_{};
+    /* The maximum number of packets queued for each stream in async mode before feed() blocks (0 to drop them) */
+    size_t max_queued_packets_{};
+    /* The interleaving limits of the muxers (see Muxer::setInterleaving()), 0 bytes to keep the muxers defaults */
+    int64_t max_interleave_delta_{};
+    size_t max_interleave_bytes_{};
+    /* Called after writing each packet to an output file, with its type and input timestamp */
+    std::function<void(av::MediaType, int64_t)> write_callback_;
+    /* The name of the shared-memory ring the converted video frames are exported to (empty if not exported) */
+    std::string frame_export_name_;
+    /* The frame export ring, kept across the restarts so that its readers aren't interrupted */
+    std::unique_ptr<FrameRing> frame_export_;
+    /* The silence detection of the audio encoders (see setSilenceDetection()) */
+    bool detect_silence_{};
+    float silence_threshold_{};
+    int64_t silence_hold_time_{};
+    /* The number of keyframes requested so far, each video chain forces one when it lags behind it */
+    std::atomic<uint64_t> keyframe_requests_{0};
 
     std::mutex processors_m_;
-    std::array<std::thread, av::MediaType::NumTypes> processors_;
-    std::array<av::PacketUPtr, av::MediaType::NumTypes> packets_;
-    std::array<std::condition_variable, av::MediaType::NumTypes> packets_cv_;
-    std::array<std::exception_ptr, av::MediaType::NumTypes> e_ptrs_;
-    void startProcessor(av::MediaType media_type);
-    /* Stop and join the processor threads */
+    void startProcessor(int stream);
+    /* Wait for the queued packets to be processed */
     void stopProcessors();
     /* Check and eventually re-throw the processors exceptions */
     void checkExceptions();
+    /* Check that new processing chains can still be added */
+    void checkCanAddChain() const;
+    /* Check that the input stream exists and is of the given type */
+    static void checkStreamType(const AVCodecParameters *stream_params, av::MediaType type);
+
+    /* Create the silence detector of an audio branch, if enabled */
+    void initSilenceDetector(Branch &branch, AVCodecID codec_id,
+                             const std::map<std::string, std::string> &enc_options) const;
+
+    /* Get the muxer with the given index (0 for the main one, i for extra_muxers_[i - 1]) */
+    Muxer &getMuxer(size_t index);
 
-    void processPacket(const AVPacket *packet, av::MediaType type);
-    void processConvertedFrame(const AVFrame *frame, av::MediaType type);
+    void processPacket(const AVPacket *packet, int stream);
+    void processConvertedFrame(const AVFrame *frame, int stream, size_t branch);
+    /* Convert a decoded frame of a mixed audio input and pass it to the mixer */
+    void mixFrame(av::FrameUPtr frame, int stream);
+    /* Encode the frames mixed so far by the mixer of the given chain (all the pending samples if flushing) */
+    void encodeMix(int stream, bool flush);
+    /* Rebase the packet timestamps on the start of the current output and queue it to the writer thread */
+    void writePacket(av::PacketUPtr packet, int stream, size_t branch);
+    /* Main loop of the writer thread */
+    void runWriter();
+    /* Write the queued packets and stop the writer thread, re-throwing its exception (if any) */
+    void stopWriter();
 
 public:
+    /* An audio input of a mix */
+    struct AudioInput {
+        /* the parameters of the input stream */
+        const AVCodecParameters *params;
+        /* the time-base of the input packets */
+        AVRational time_base;
+        /* the gain of the input in the mix */
+        float gain = 1.0f;
+    };
+
     /**
      * Create a new Pipeline for processing packets
      * @param output_file   the name of the output file
-     * @param async         whether the pipeline should use background threads to handle the processing
-     * (recommended when a single demuxer will provide both video and audio packets)
+     * @param async         whether the packets should be processed by the shared executor instead of by the caller
+     * (recommended when a single demuxer will provide both video and audio packets, or when several pipelines run
+     * concurrently in the same process)
+     * @param segment_duration  if positive, the main output is segmented for HTTP Live Streaming (output_file is
+     * the playlist) in segments of about segment_duration seconds
      */
-    explicit Pipeline(const std::string &output_file, bool async = false);
+    explicit Pipeline(const std::string &output_file, bool async = false, int segment_duration = 0);
 
     Pipeline(const Pipeline &) = delete;
 
@@ -55,47 +203,221 @@ public:
     Pipeline &operator=(const Pipeline &) = delete;
 
     /**
-     * Initialize the video processing, by creating the corresponding decoder, converter and encoder
+     * Initialize a video processing chain, by creating the corresponding decoder, converter and encoder.
+     * Several video chains can be added, each one producing a separate stream of the output file
      * @param demuxer       the demuxer containing the input stream of packets
      * @param codec_id      the ID of the codec to use for the output video
      * @param pix_fmt       the pixel format to use for the output video
      * @param video_params  the parameters to use for the output video
+     * @param enc_options   a map filled with the key-value options to use for the encoder
+     * @return the index of the new stream, to use when feeding its packets
+     */
+    int initVideo(const Demuxer &demuxer, AVCodecID codec_id, AVPixelFormat pix_fmt,
+                   const VideoParameters &video_params, const std::map<std::string, std::string> &enc_options);
+
+    /**
+     * Initialize a video processing chain for a stream which isn't read by a demuxer (e.g. replayed from a trace)
+     * @param stream_params the parameters of the input stream
+     * @param time_base     the time-base of the input packets
+     * @see initVideo(const Demuxer &, AVCodecID, AVPixelFormat, const VideoParameters &,
+     * const std::map<std::string, std::string> &)
      */
-    void initVideo(const Demuxer &demuxer, AVCodecID codec_id, AVPixelFormat pix_fmt,
-                   const VideoParameters &video_params);
+    int initVideo(const AVCodecParameters *stream_params, AVRational time_base, AVCodecID codec_id,
+                  AVPixelFormat pix_fmt, const VideoParameters &video_params,
+                  const std::map<std::string, std::string> &enc_options);
 
     /**
-     * Initialize the audio processing, by creating the corresponding decoder, converter and encoder
+     * Initialize a video processing chain encoding several renditions of the same input (an adaptive-bitrate
+     * ladder): each frame is grabbed and decoded once, then shared by the branches scaling and encoding it
+     * for each rendition, in parallel. The encoders use the same fixed GOP length (2 seconds, unless "g" is set
+     * in the encoder options) with scene-cut detection disabled, so that the keyframes are aligned across the
+     * renditions.
+     * The renditions are written as separate streams of the main output file, or to their own files.
+     * @param demuxer       the demuxer containing the input stream of packets
+     * @param codec_id      the ID of the codec to use for the output videos
+     * @param pix_fmt       the pixel format to use for the output videos
+     * @param video_params  the parameters of the captured video (its output size is ignored)
+     * @param renditions    the renditions to encode (at least one)
+     * @param enc_options   a map filled with the key-value options shared by all the encoders
+     * @return the index of the new stream, to use when feeding its packets
+     */
+    int initVideoLadder(const Demuxer &demuxer, AVCodecID codec_id, AVPixelFormat pix_fmt,
+                        const VideoParameters &video_params, const std::vector<Rendition> &renditions,
+                        const std::map<std::string, std::string> &enc_options);
+
+    /**
+     * Initialize an adaptive-bitrate ladder for a stream which isn't read by a demuxer (e.g. replayed from a trace)
+     * @param stream_params the parameters of the input stream
+     * @param time_base     the time-base of the input packets
+     * @see initVideoLadder(const Demuxer &, AVCodecID, AVPixelFormat, const VideoParameters &,
+     * const std::vector<Rendition> &, const std::map<std::string, std::string> &)
+     */
+    int initVideoLadder(const AVCodecParameters *stream_params, AVRational time_base, AVCodecID codec_id,
+                        AVPixelFormat pix_fmt, const VideoParameters &video_params,
+                        const std::vector<Rendition> &renditions,
+                        const std::map<std::string, std::string> &enc_options);
+
+    /**
+     * Initialize an audio processing chain, by creating the corresponding decoder, converter and encoder.
+     * Several audio chains can be added, each one producing a separate stream of the output file
      * @param demuxer       the demuxer containing the input stream of packets
      * @param codec_id      the ID of the codec to use for the output audio
+     * @param enc_options   a map filled with the key-value options to use for the encoder
+     * @return the index of the new stream, to use when feeding its packets
+     */
+    int initAudio(const Demuxer &demuxer, AVCodecID codec_id, const std::map<std::string, std::string> &enc_options);
+
+    /**
+     * Initialize an audio processing chain for a stream which isn't read by a demuxer (e.g. replayed from a trace)
+     * @param stream_params the parameters of the input stream
+     * @param time_base     the time-base of the input packets
+     * @see initAudio(const Demuxer &, AVCodecID, const std::map<std::string, std::string> &)
      */
-    void initAudio(const Demuxer &demuxer, AVCodecID codec_id);
+    int initAudio(const AVCodecParameters *stream_params, AVRational time_base, AVCodecID codec_id,
+                  const std::map<std::string, std::string> &enc_options);
 
     /**
-     * Initialize the output file.
+     * Initialize an audio processing chain mixing several inputs (e.g. a microphone and the system audio) into a
+     * single output stream, with the sample rate and channel layout of the first input. Each input is decoded and
+     * converted on its own, then the inputs are aligned on the timestamps of their first packets and mixed with
+     * their gains (clamping the sum to the full scale) before the encoder. The mixing runs on the processing thread
+     * of the audio, waiting at most one encoder frame for the late inputs, which are mixed as silence meanwhile.
+     * WARNING: in synchronous mode, the packets of all the inputs must be fed by the same thread
+     * @param inputs        the inputs to mix (at least one)
+     * @param codec_id      the ID of the codec to use for the output audio (whose encoder must take planar float
+     * samples, e.g. AAC)
+     * @param enc_options   a map filled with the key-value options to use for the encoder
+     * @return the indexes of the streams of the inputs, to use when feeding their packets (the mixed output is a
+     * single stream of the output file)
+     */
+    std::vector<int> initAudioMix(const std::vector<AudioInput> &inputs, AVCodecID codec_id,
+                                  const std::map<std::string, std::string> &enc_options);
+
+    /**
+     * Set the gain of a mixed audio input. Thread-safe, it can be called while other threads are feeding the
+     * pipeline
+     * @param stream    the index of the stream of the input, as returned by initAudioMix()
+     * @param gain      the gain (1 to keep the level of the input, 0 to mute it)
+     */
+    void setAudioGain(int stream, float gain);
+
+    /**
+     * Initialize the output file, adding a stream for each one of the initialized processing chains (in the
+     * order in which they were initialized).
      * WARNING: This function must be called after initializing all the desired processing chains
      * with initVideo() and initAudio()
      */
     void initOutput();
 
     /**
-     * Send the packet to the processing chain corresponding to its type.
+     * Send the packet to the processing chain of the given stream.
+     * The chains of different streams are processed in parallel (in async mode).
      * If 'async' was set to true when building the Pipeline,
-     * the background threads will handle the packet processing and this function will
+     * the shared executor will handle the packet processing and this function will
      * return immediately, otherwise the processing will be handled in
-     * a synchronous way and this function will return only once it's completed
+     * a synchronous way and this function will return only once it's completed.
+     * In async mode, a video packet is dropped if the previous one is still waiting to be processed, while the
+     * audio packets are always queued (and processed with higher priority) to avoid gaps in the audio
      * @param packet        the packet to send to che processing chain (if NULL, an exception will be thrown)
-     * @param packet_type   the type of the packet to process
+     * @param stream        the index of the stream of the packet, as returned by initVideo() or initAudio()
+     */
+    void feed(av::PacketUPtr packet, int stream);
+
+    /**
+     * Make feed() wait for the processing to catch up instead of dropping the video packets (async mode only),
+     * for non-real-time inputs such as media files. Each stream reads ahead up to max_queued_packets packets,
+     * so that all the processing stages are kept busy
+     * @param max_queued_packets the maximum number of packets queued for each stream (if 0, the video packets are
+     * dropped as in real-time mode)
+     */
+    void setBackpressure(size_t max_queued_packets);
+
+    /**
+     * Set the limits of the interleaving of the output streams: a packet waits for the other streams at most
+     * max_delta, and as long as the queued packets take less than max_bytes (see Muxer::setInterleaving()).
+     * WARNING: This function must be called before initOutput()
+     * @param max_delta the maximum interleaving delay, in AV_TIME_BASE units
+     * @param max_bytes the maximum size of the packets waiting to be interleaved, for each output file
+     */
+    void setInterleaving(int64_t max_delta, size_t max_bytes);
+
+    /**
+     * Skip the encoding of the silent stretches of the audio streams: once the level of the audio (RMS and peak)
+     * stays below the threshold for the hold time, its frames are replaced by a silent packet encoded in advance,
+     * with continuous timestamps, until the level rises again. Only for the encoders with frames of fixed size
+     * (e.g. AAC).
+     * WARNING: This function must be called before initializing the audio processing chains
+     * @param threshold the level below which the audio is silent, in dBFS (e.g. -60)
+     * @param hold_time how long the audio must be silent before its encoding is skipped, in AV_TIME_BASE units
      */
-    void feed(av::PacketUPtr packet, av::MediaType packet_type);
+    void setSilenceDetection(float threshold, int64_t hold_time);
+
+    /**
+     * Set a function to call every time a packet has been written to an output file, e.g. to measure the latency
+     * from the input to the output.
+     * WARNING: This function must be called before initOutput()
+     * @param callback  the function, receiving the type of the packet and its presentation timestamp as received
+     * from the input (i.e. before rebasing it on the start of the output), in AV_TIME_BASE units. It's called by
+     * the writer thread of the pipeline (and by the caller of terminate()), so it must be thread-safe and fast
+     */
+    void setWriteCallback(std::function<void(av::MediaType type, int64_t pts)> callback);
+
+    /**
+     * Export the video frames as they are passed to the encoders (of the first rendition, for the ladders) through
+     * a named shared-memory ring, which other processes of the host can read with FrameReader while the pipeline
+     * runs. The export never slows down the processing: the readers lagging behind skip the frames overwritten in the
+     * meantime. POSIX only.
+     * WARNING: This function must be called before initOutput()
+     * @param name the name of the ring (replacing an existing ring with the same name, if any)
+     */
+    void setFrameExport(const std::string &name);
+
+    /**
+     * Get the number of frames decoded by the processing chain of a stream (complete only after terminate())
+     * @param stream the index of the stream
+     * @return the number of decoded frames
+     */
+    [[nodiscard]] int64_t getDecodedFrames(int stream) const;
+
+    /**
+     * Get the current and maximum depth of the interleaving queue of the main output file (it can be called while
+     * other threads are feeding the pipeline)
+     * WARNING: the output must be initialized with initOutput(), otherwise an exception will be thrown
+     * @return the statistics of the interleaving queue
+     */
+    [[nodiscard]] Interleaver::Stats getInterleaverStats();
+
+    /**
+     * Force the encoders of all the video streams to emit a keyframe (IDR) from the next frame they process,
+     * e.g. to let a new viewer join a live stream. Thread-safe, it can be called while other threads are
+     * feeding the pipeline
+     */
+    void requestKeyframe();
 
     /**
      * Flush the processing pipelines and close the output file.
      */
     void terminate();
 
+    /**
+     * Restart a terminated pipeline writing to a new output file.
+     * The decoders, converters and encoders are reset (not re-created, unless the encoder doesn't support
+     * flushing) and only the muxer is replaced, so the first packets of the new output will have timestamps
+     * starting from zero.
+     * WARNING: the new output format must have the same global header requirements as the original one,
+     * otherwise an exception will be thrown (as well as if some renditions are written to their own files)
+     * @param output_file the name of the new output file
+     */
+    void restart(const std::string &output_file);
+
     /**
      * Print the informations about the internal demuxer, decoders and encoders
      */
     void printInfo() const;
+
+    /**
+     * Print the statistics of the processing (e.g. the scenes detected by the content-adaptive encoding and the
+     * time spent detecting them, or the depth of the interleaving queues)
+     */
+    void printStats() const;
 };
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "spool_transcoder.h"
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "format/demuxer.h"
+#include "format/muxer.h"
+#include "pipeline/pipeline.h"
+#include "utils/thread_priority.h"
+
+static std::string errMsg(const std::string &msg) { return ("SpoolTranscoder: " + msg); }
+
+static std::map<std::string, std::string> getVideoEncoderOptions() {
+    std::map<std::string, std::string> options;
+    /* we're not in real-time anymore, so trade speed for a smaller file */
+    options.insert({"preset", "medium"});
+    /* the parallelism is given by the chunks, don't oversubscribe the cores */
+    options.insert({"threads", "1"});
+    return options;
+}
+
+static void removeFiles(const std::vector<std::string> &files) {
+    for (const auto &file : files) {
+        std::error_code ec;  // ignore errors, we're only cleaning up
+        std::filesystem::remove(file, ec);
+    }
+}
+
+/* The timestamp the streams are interleaved on: the dts, or the pts if the dts is unset (AV_NOPTS_VALUE if none) */
+static int64_t getInterleavingTs(const AVPacket *packet) {
+    return packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+}
+
+SpoolTranscoder::SpoolTranscoder(std::string spool_file, std::string output_file, const int num_chunks,
+                                 std::map<std::string, std::string> video_enc_options)
+    : spool_file_(std::move(spool_file)),
+      output_file_(std::move(output_file)),
+      num_chunks_(num_chunks),
+      video_enc_options_(std::move(video_enc_options)) {
+    if (spool_file_.empty()) throw std::invalid_argument(errMsg("spool file not specified"));
+    if (output_file_.empty()) throw std::invalid_argument(errMsg("output file not specified"));
+    if (num_chunks_ < 0) throw std::invalid_argument(errMsg("number of chunks must be >= 0"));
+    if (!num_chunks_) num_chunks_ = static_cast<int>(std::thread::hardware_concurrency());
+    if (!num_chunks_) num_chunks_ = 1;
+
+    for (const auto &[key, value] : getVideoEncoderOptions()) video_enc_options_.insert({key, value});
+}
+
+int64_t SpoolTranscoder::encodeVideoChunk(const int64_t start, const int64_t end, const std::string &chunk_file) const {
+    const auto type = av::MediaType::Video;
+
+    Demuxer demuxer(spool_file_);
+    demuxer.openInput();
+    /* the spool is intra-only, so any frame is a valid starting point */
+    if (start > 0) demuxer.seek(start);
+    const AVRational time_base = demuxer.getStreamTimeBase(type);
+
+    Pipeline pipeline(chunk_file);
+    const int stream =
+        pipeline.initVideo(demuxer, AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P, VideoParameters(), video_enc_options_);
+    pipeline.initOutput();
+
+    int64_t first_ts = AV_NOPTS_VALUE;
+    while (true) {
+        auto [packet, packet_type] = demuxer.readPacket();
+        if (!packet) {
+            if (demuxer.reachedEof()) break;
+            continue;
+        }
+        if (packet_type != type) continue;
+
+        int64_t ts = av_rescale_q(packet->pts, time_base, AV_TIME_BASE_Q);
+        if (ts < start) continue;
+        if (ts >= end) break;
+        if (first_ts == AV_NOPTS_VALUE) first_ts = ts;
+        pipeline.feed(std::move(packet), stream);
+    }
+
+    pipeline.terminate();
+    return first_ts;
+}
+
+void SpoolTranscoder::encodeAudio(const std::string &audio_file) const {
+    const auto type = av::MediaType::Audio;
+
+    Demuxer demuxer(spool_file_);
+    demuxer.openInput();
+
+    Pipeline pipeline(audio_file);
+    const int stream = pipeline.initAudio(demuxer, AV_CODEC_ID_AAC, std::map<std::string, std::string>());
+    pipeline.initOutput();
+
+    while (true) {
+        auto [packet, packet_type] = demuxer.readPacket();
+        if (!packet) {
+            if (demuxer.reachedEof()) break;
+            continue;
+        }
+        if (packet_type == type) pipeline.feed(std::move(packet), stream);
+    }
+
+    pipeline.terminate();
+}
+
+void SpoolTranscoder::run() const {
+    setIdlePriority();
+
+    int64_t duration;
+    bool has_audio;
+    {
+        Demuxer demuxer(spool_file_);
+        demuxer.openInput();
+        if (!demuxer.hasStream(av::MediaType::Video)) throw std::runtime_error(errMsg("spool file has no video"));
+        duration = demuxer.getDuration();
+        has_audio = demuxer.hasStream(av::MediaType::Audio);
+    }
+
+    const int num_chunks = (duration != AV_NOPTS_VALUE && duration > 0) ? num_chunks_ : 1;
+    std::vector<std::string> chunk_files;
+    for (int i = 0; i < num_chunks; i++) chunk_files.push_back(output_file_ + ".chunk" + std::to_string(i) + ".mkv");
+    const std::string audio_file = output_file_ + ".audio.mkv";
+
+    std::vector<std::string> temp_files = chunk_files;
+    if (has_audio) temp_files.push_back(audio_file);
+
+    /* encode the chunks [and the audio] in parallel */
+    std::vector<int64_t> chunk_starts(num_chunks, AV_NOPTS_VALUE);
+    {
+        std::vector<std::exception_ptr> e_ptrs(num_chunks + 1);
+        std::vector<std::thread> workers;
+
+        try {
+            for (int i = 0; i < num_chunks; i++) {
+                int64_t start = i ? (duration * i / num_chunks) : INT64_MIN;
+                int64_t end = (i < num_chunks - 1) ? (duration * (i + 1) / num_chunks) : INT64_MAX;
+                workers.emplace_back([this, i, start, end, &chunk_files, &chunk_starts, &e_ptrs]() {
+                    try {
+                        setIdlePriority();
+                        chunk_starts[i] = encodeVideoChunk(start, end, chunk_files[i]);
+                    } catch (...) {
+                        e_ptrs[i] = std::current_exception();
+                    }
+                });
+            }
+            if (has_audio) {
+                workers.emplace_back([this, &audio_file, &e_ptrs, num_chunks]() {
+                    try {
+                        setIdlePriority();
+                        encodeAudio(audio_file);
+                    } catch (...) {
+                        e_ptrs[num_chunks] = std::current_exception();
+                    }
+                });
+            }
+        } catch (...) {
+            for (auto &w : workers) w.join();
+            removeFiles(temp_files);
+            throw;
+        }
+
+        for (auto &w : workers) w.join();
+
+        for (auto &e_ptr : e_ptrs) {
+            if (e_ptr) {
+                removeFiles(temp_files);
+                std::rethrow_exception(e_ptr);
+            }
+        }
+    }
+
+    /* join the chunks [and the audio] into the final output file */
+    try {
+        std::vector<Demuxer> chunks;
+        std::vector<int64_t> offsets;
+        int64_t first_start = AV_NOPTS_VALUE;
+        for (int i = 0; i < num_chunks; i++) {
+            if (chunk_starts[i] == AV_NOPTS_VALUE) continue;  // empty chunk
+            if (first_start == AV_NOPTS_VALUE) first_start = chunk_starts[i];
+            chunks.emplace_back(chunk_files[i]);
+            chunks.back().openInput();
+            /* each chunk starts from zero: shift it to its position in the spool */
+            offsets.push_back(chunk_starts[i] - first_start);
+        }
+        if (chunks.empty()) throw std::runtime_error(errMsg("spool file contains no video frames"));
+
+        std::optional<Demuxer> audio;
+        if (has_audio) {
+            audio = Demuxer(audio_file);
+            audio->openInput();
+        }
+
+        const AVRational video_time_base = chunks.front().getStreamTimeBase(av::MediaType::Video);
+        AVRational audio_time_base{};
+
+        Muxer muxer(output_file_);
+        const int video_stream = muxer.addStream(chunks.front().getStreamParams(av::MediaType::Video), video_time_base);
+        int audio_stream = -1;
+        if (audio) {
+            audio_time_base = audio->getStreamTimeBase(av::MediaType::Audio);
+            audio_stream = muxer.addStream(audio->getStreamParams(av::MediaType::Audio), audio_time_base);
+        }
+        muxer.initFile();
+
+        size_t chunk_idx = 0;
+        auto read_video = [&chunks, &offsets, &chunk_idx]() -> av::PacketUPtr {
+            while (chunk_idx < chunks.size()) {
+                auto [packet, packet_type] = chunks[chunk_idx].readPacket();
+                if (!packet) {
+                    if (chunks[chunk_idx].reachedEof()) chunk_idx++;
+                    continue;
+                }
+                /* all the chunks share the same time-base, since they have been produced in the same way */
+                const AVRational time_base = chunks[chunk_idx].getStreamTimeBase(packet_type);
+                int64_t offset = av_rescale_q(offsets[chunk_idx], AV_TIME_BASE_Q, time_base);
+                if (packet->pts != AV_NOPTS_VALUE) packet->pts += offset;
+                if (packet->dts != AV_NOPTS_VALUE) packet->dts += offset;
+                return std::move(packet);
+            }
+            return nullptr;
+        };
+        auto read_audio = [&audio]() -> av::PacketUPtr {
+            while (audio && !audio->reachedEof()) {
+                auto [packet, packet_type] = audio->readPacket();
+                if (packet) return std::move(packet);
+            }
+            return nullptr;
+        };
+
+        /* interleave the streams by timestamp */
+        av::PacketUPtr video_packet = read_video();
+        av::PacketUPtr audio_packet = read_audio();
+        while (video_packet || audio_packet) {
+            bool write_video = !audio_packet;
+            if (video_packet && audio_packet) {
+                const int64_t video_ts = getInterleavingTs(video_packet.get());
+                const int64_t audio_ts = getInterleavingTs(audio_packet.get());
+                /* a packet without timestamps can't be placed, it's written right away */
+                write_video = video_ts == AV_NOPTS_VALUE ||
+                              (audio_ts != AV_NOPTS_VALUE &&
+                               av_compare_ts(video_ts, video_time_base, audio_ts, audio_time_base) <= 0);
+            }
+            if (write_video) {
+                muxer.writePacket(std::move(video_packet), video_stream);
+                video_packet = read_video();
+            } else {
+                muxer.writePacket(std::move(audio_packet), audio_stream);
+                audio_packet = read_audio();
+            }
+        }
+
+        muxer.writePacket(nullptr, -1);
+        muxer.finalizeFile();
+    } catch (...) {
+        removeFiles(temp_files);
+        throw;
+    }
+
+    removeFiles(temp_files);
+    removeFiles({spool_file_});
+}
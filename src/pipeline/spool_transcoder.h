@@ -0,0 +1,48 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "common/common.h"
+
+class SpoolTranscoder {
+    std::string spool_file_;
+    std::string output_file_;
+    int num_chunks_;
+    std::map<std::string, std::string> video_enc_options_;
+
+    /**
+     * Encode the video frames of the spool file included in [start, end) to a chunk file
+     * @param start         the start time of the chunk, in AV_TIME_BASE units
+     * @param end           the end time of the chunk, in AV_TIME_BASE units
+     * @param chunk_file    the name of the file to which write the encoded chunk
+     * @return the timestamp of the first frame of the chunk (in AV_TIME_BASE units), AV_NOPTS_VALUE if the
+     * chunk is empty
+     */
+    int64_t encodeVideoChunk(int64_t start, int64_t end, const std::string &chunk_file) const;
+
+    /**
+     * Encode the audio stream of the spool file
+     * @param audio_file the name of the file to which write the encoded audio
+     */
+    void encodeAudio(const std::string &audio_file) const;
+
+public:
+    /**
+     * Create a new transcoder for a spool file (recorded with a fast intra-only codec)
+     * @param spool_file    the name of the spool file to read
+     * @param output_file   the name of the final output file (H.264/AAC)
+     * @param num_chunks    the number of chunks to encode in parallel (if 0, the number of available cores)
+     * @param video_enc_options the options of the video encoder, overriding the transcoder defaults
+     */
+    SpoolTranscoder(std::string spool_file, std::string output_file, int num_chunks = 0,
+                    std::map<std::string, std::string> video_enc_options = {});
+
+    /**
+     * Transcode the spool file to the final output file, encoding the video as several independent chunks
+     * in parallel (and the audio on a separate thread), and then joining them.
+     * All the working threads run with idle priority, in order not to disturb a recording in progress.
+     * Once the output is complete, the spool file and the temporary chunks are removed
+     */
+    void run() const;
+};
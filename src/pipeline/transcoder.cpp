@@ -0,0 +1,88 @@
+#include "transcoder.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include "format/demuxer.h"
+#include "pipeline/encoder_options.h"
+#include "pipeline/pipeline.h"
+
+static std::string errMsg(const std::string &msg) { return ("Transcoder: " + msg); }
+
+/* How long to wait before reading again when the input has nothing to read */
+static constexpr std::chrono::milliseconds read_retry_interval(10);
+
+Transcoder::Transcoder(std::string input_file, std::string output_file, const bool verbose)
+    : input_file_(std::move(input_file)), output_file_(std::move(output_file)), verbose_(verbose) {
+    if (input_file_.empty()) throw std::invalid_argument(errMsg("input file not specified"));
+    if (output_file_.empty()) throw std::invalid_argument(errMsg("output file not specified"));
+}
+
+void Transcoder::setVideoParameters(VideoParameters video_params) { video_params_ = std::move(video_params); }
+
+void Transcoder::setEncoderParameters(EncoderParameters encoder_params) {
+    encoder_params_ = std::move(encoder_params);
+}
+
+void Transcoder::setReadAhead(const size_t read_ahead) {
+    if (!read_ahead) throw std::invalid_argument(errMsg("read-ahead must be >= 1"));
+    read_ahead_ = read_ahead;
+}
+
+Transcoder::Stats Transcoder::run() const {
+    const auto start = std::chrono::steady_clock::now();
+
+    Demuxer demuxer(input_file_);
+    demuxer.openInput();
+
+    /* the chains run on the shared executor, while this thread only reads the packets */
+    Pipeline pipeline(output_file_, true);
+    pipeline.setBackpressure(read_ahead_);
+
+    int video_stream = -1;
+    int audio_stream = -1;
+    if (demuxer.hasStream(av::MediaType::Video)) {
+        std::map<std::string, std::string> enc_options = getH264EncoderOptions(encoder_params_);
+        /* we're not in real-time, so trade speed for a smaller file */
+        enc_options.insert({"preset", "medium"});
+        video_stream =
+            pipeline.initVideo(demuxer, AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P, video_params_, enc_options);
+    }
+    if (demuxer.hasStream(av::MediaType::Audio)) {
+        audio_stream = pipeline.initAudio(demuxer, AV_CODEC_ID_AAC, std::map<std::string, std::string>());
+    }
+    if (video_stream < 0 && audio_stream < 0) throw std::runtime_error(errMsg("no audio or video stream to transcode"));
+    pipeline.initOutput();
+
+    if (verbose_) {
+        demuxer.printInfo();
+        pipeline.printInfo();
+    }
+
+    while (true) {
+        auto [packet, packet_type] = demuxer.readPacket();
+        if (!packet) {
+            if (demuxer.reachedEof()) break;
+            /* nothing to read for now (e.g. a file still being written), wait a bit instead of spinning */
+            std::this_thread::sleep_for(read_retry_interval);
+            continue;
+        }
+        const int stream = (packet_type == av::MediaType::Video) ? video_stream : audio_stream;
+        if (stream >= 0) pipeline.feed(std::move(packet), stream);
+    }
+    pipeline.terminate();
+
+    Stats stats;
+    if (video_stream >= 0) stats.video_frames = pipeline.getDecodedFrames(video_stream);
+    if (audio_stream >= 0) stats.audio_frames = pipeline.getDecodedFrames(audio_stream);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (verbose_) {
+        pipeline.printStats();
+        std::cout << "Transcoded " << stats.video_frames << " video frames in " << stats.seconds << " s ("
+                  << stats.getFramesPerSecond() << " fps)" << std::endl;
+    }
+    return stats;
+}
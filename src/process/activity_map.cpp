@@ -0,0 +1,129 @@
+#include "activity_map.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/block_difference.h"
+
+static std::string errMsg(const std::string &msg) { return ("ActivityMap: " + msg); }
+
+/* The size of the H.264 macroblocks, the unit of the regions of interest */
+static constexpr int block_size = 16;
+/* The mean absolute luma difference above which a macroblock is considered changed */
+static constexpr int activity_threshold = 1;
+/* The quantizer offsets (in [-1, 1], scaled to the whole QP range by the encoder) of the active and static areas */
+static constexpr AVRational active_qoffset = {-1, 10};
+static constexpr AVRational static_qoffset = {1, 10};
+
+ActivityMap::ActivityMap(const int width, const int height, const AVPixelFormat pix_fmt)
+    : width_(width),
+      height_(height),
+      cols_((width + block_size - 1) / block_size),
+      rows_((height + block_size - 1) / block_size) {
+    if (width_ <= 0 || height_ <= 0) throw std::invalid_argument(errMsg("invalid frame size"));
+
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) || desc->comp[0].plane != 0 ||
+        desc->comp[0].step != 1 || desc->comp[0].depth != 8)
+        throw std::invalid_argument(errMsg("the pixel format must have an 8 bit luma plane"));
+
+    prev_luma_.resize(static_cast<size_t>(width_) * height_);
+    active_.resize(static_cast<size_t>(cols_) * rows_);
+}
+
+void ActivityMap::update(const AVFrame *frame) {
+    const uint8_t *luma = frame->data[0];
+    const ptrdiff_t stride = frame->linesize[0];
+
+    for (int r = 0; r < rows_; r++) {
+        const int y = r * block_size;
+        const int h = std::min(block_size, height_ - y);
+        for (int c = 0; c < cols_; c++) {
+            const int x = c * block_size;
+            const int w = std::min(block_size, width_ - x);
+            const uint32_t sad = block_difference::sad(luma + y * stride + x, stride,
+                                                       prev_luma_.data() + static_cast<ptrdiff_t>(y) * width_ + x,
+                                                       width_, w, h);
+            active_[r * cols_ + c] = sad > static_cast<uint32_t>(activity_threshold * w * h);
+        }
+    }
+
+    for (int y = 0; y < height_; y++)
+        std::memcpy(prev_luma_.data() + static_cast<ptrdiff_t>(y) * width_, luma + y * stride, width_);
+}
+
+void ActivityMap::attachRegions(AVFrame *frame) const {
+    struct Run {
+        int left, right, top, bottom;  // in macroblocks, right and bottom excluded
+    };
+
+    /* the horizontal runs of active macroblocks, merged with the identical ones of the previous row */
+    std::vector<Run> runs;
+    std::vector<size_t> prev_row;  // the runs reaching the previous row, sorted by left edge
+    std::vector<size_t> row;
+    size_t active_blocks = 0;
+    for (int r = 0; r < rows_; r++) {
+        row.clear();
+        size_t p = 0;
+        for (int c = 0; c < cols_;) {
+            if (!active_[r * cols_ + c]) {
+                c++;
+                continue;
+            }
+            int end = c;
+            while (end < cols_ && active_[r * cols_ + end]) end++;
+            active_blocks += end - c;
+
+            while (p < prev_row.size() && runs[prev_row[p]].left < c) p++;
+            if (p < prev_row.size() && runs[prev_row[p]].left == c && runs[prev_row[p]].right == end) {
+                runs[prev_row[p]].bottom = r + 1;
+                row.push_back(prev_row[p]);
+            } else {
+                runs.push_back({c, end, r, r + 1});
+                row.push_back(runs.size() - 1);
+            }
+            c = end;
+        }
+        std::swap(prev_row, row);
+    }
+
+    /* without contrast between the areas there's nothing to prioritize */
+    if (!active_blocks || active_blocks == active_.size()) return;
+
+    /* the encoder gives precedence to the first regions, so the whole frame (the static areas) goes last */
+    const size_t nb_regions = runs.size() + 1;
+    AVFrameSideData *side_data =
+        av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, nb_regions * sizeof(AVRegionOfInterest));
+    if (!side_data) throw std::runtime_error(errMsg("failed to allocate the regions of interest"));
+
+    auto *regions = reinterpret_cast<AVRegionOfInterest *>(side_data->data);
+    for (size_t i = 0; i < runs.size(); i++) {
+        regions[i].self_size = sizeof(AVRegionOfInterest);
+        regions[i].top = runs[i].top * block_size;
+        regions[i].bottom = std::min(runs[i].bottom * block_size, height_);
+        regions[i].left = runs[i].left * block_size;
+        regions[i].right = std::min(runs[i].right * block_size, width_);
+        regions[i].qoffset = active_qoffset;
+    }
+    AVRegionOfInterest &background = regions[runs.size()];
+    background.self_size = sizeof(AVRegionOfInterest);
+    background.top = 0;
+    background.bottom = height_;
+    background.left = 0;
+    background.right = width_;
+    background.qoffset = static_qoffset;
+}
+
+void ActivityMap::process(AVFrame *frame) {
+    if (frame->width != width_ || frame->height != height_)
+        throw std::invalid_argument(errMsg("unexpected frame size"));
+
+    const bool had_prev = has_prev_;
+    update(frame);
+    has_prev_ = true;
+
+    if (had_prev) attachRegions(frame);
+}
+
+void ActivityMap::reset() { has_prev_ = false; }
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "common/common.h"
+
+/*
+ * Per-macroblock map of the screen areas changed since the previous frame, attached to the frames as
+ * regions of interest, so that the encoder spends its bits on the active areas (e.g. a playing video or the
+ * line being typed) rather than on the static text around them
+ */
+class ActivityMap {
+    int width_;
+    int height_;
+    int cols_;
+    int rows_;
+    /* The luma plane of the previous frame (without padding) */
+    std::vector<uint8_t> prev_luma_;
+    bool has_prev_{};
+    std::vector<uint8_t> active_;
+
+    /* Compute the activity of the macroblocks with respect to the previous frame */
+    void update(const AVFrame *frame);
+
+    /* Attach the regions of interest corresponding to the current map to the frame */
+    void attachRegions(AVFrame *frame) const;
+
+public:
+    /**
+     * Create a new activity map
+     * @param width     the width of the frames
+     * @param height    the height of the frames
+     * @param pix_fmt   the pixel format of the frames (with an 8 bit luma plane)
+     */
+    ActivityMap(int width, int height, AVPixelFormat pix_fmt);
+
+    /**
+     * Update the map with a new frame and attach the resulting regions of interest to it.
+     * Nothing is attached to the first frame, and when the whole frame is either static or active
+     * @param frame the frame, in the size and pixel format given when creating the map
+     */
+    void process(AVFrame *frame);
+
+    /* Forget the previous frame, e.g. when restarting the processing */
+    void reset();
+};
@@ -0,0 +1,160 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/sample_mixing.h"
+
+static std::string errMsg(const std::string &msg) { return ("AudioMixer: " + msg); }
+
+AudioMixer::AudioMixer(const AVCodecContext *enc_ctx, const size_t num_inputs) : inputs_(num_inputs) {
+    if (!enc_ctx) throw std::invalid_argument(errMsg("enc_ctx is NULL"));
+    if (enc_ctx->codec_type != AVMEDIA_TYPE_AUDIO || enc_ctx->sample_fmt != AV_SAMPLE_FMT_FLTP)
+        throw std::invalid_argument(errMsg("the encoder must take planar float samples"));
+    if (!num_inputs) throw std::invalid_argument(errMsg("no inputs to mix"));
+
+    channels_ = enc_ctx->channels;
+    sample_rate_ = enc_ctx->sample_rate;
+    channel_layout_ = enc_ctx->channel_layout;
+    /* the encoders accepting frames of any size get frames of about 20ms */
+    frame_size_ = enc_ctx->frame_size ? enc_ctx->frame_size : sample_rate_ / 50;
+
+    for (auto &input : inputs_) {
+        input.planes.resize(channels_);
+        /* room for the pending frame and the one being received */
+        for (auto &plane : input.planes) plane.reserve(3 * static_cast<size_t>(frame_size_));
+    }
+}
+
+void AudioMixer::setGain(const size_t input, const float gain) {
+    if (input >= inputs_.size()) throw std::invalid_argument(errMsg("invalid input index"));
+    if (gain < 0) throw std::invalid_argument(errMsg("the gain can't be negative"));
+    inputs_[input].gain.store(gain, std::memory_order_relaxed);
+}
+
+int64_t AudioMixer::getLivePosition() const {
+    int64_t position = next_pos_;
+    for (const auto &input : inputs_) {
+        if (input.start != AV_NOPTS_VALUE)
+            position = std::max(position, input.start + static_cast<int64_t>(input.planes.front().size()));
+    }
+    return position;
+}
+
+void AudioMixer::sendFrame(const size_t input, const AVFrame *frame, int64_t position) {
+    if (input >= inputs_.size()) throw std::invalid_argument(errMsg("invalid input index"));
+    if (!frame) throw std::invalid_argument(errMsg("sent frame is not allocated"));
+    if (frame->format != AV_SAMPLE_FMT_FLTP || frame->channels != channels_ || frame->sample_rate != sample_rate_)
+        throw std::runtime_error(errMsg("unexpected format of the sent frame"));
+
+    Input &in = inputs_[input];
+    if (next_pos_ == AV_NOPTS_VALUE) {
+        origin_ = position;
+        next_pos_ = position;
+    }
+    if (in.start == AV_NOPTS_VALUE) {
+        /* an input whose clock is more than a second away from the other ones is aligned on the live position */
+        const int64_t live_position = getLivePosition();
+        if (std::abs(position - live_position) > sample_rate_) in.offset = live_position - position;
+    }
+    position += in.offset;
+
+    auto &planes = in.planes;
+    int64_t end = in.start + static_cast<int64_t>(planes.front().size());
+    if (planes.front().empty()) {
+        /* nothing pending: an input late by less than a frame is delayed to the next mixed frame, the samples
+         * older than that are too late to be mixed */
+        if (position < next_pos_ && next_pos_ - position <= frame_size_) {
+            in.offset += next_pos_ - position;
+            position = next_pos_;
+        }
+        in.start = std::max(position, next_pos_);
+        end = in.start;
+    } else if (position > end + sample_rate_) {
+        /* the input jumped forward, it restarts from the new position */
+        for (auto &plane : planes) plane.clear();
+        in.start = position;
+        end = position;
+    } else if (position > end) {
+        /* a short gap in the input is filled with silence */
+        for (auto &plane : planes) plane.resize(plane.size() + static_cast<size_t>(position - end), 0.0f);
+        end = position;
+    }
+
+    /* skip the samples overlapping the pending ones */
+    const int64_t skip = end - position;
+    if (skip >= frame->nb_samples) return;
+    const auto n = static_cast<size_t>(frame->nb_samples - skip);
+    for (int c = 0; c < channels_; c++) {
+        const auto *src = reinterpret_cast<const float *>(frame->extended_data[c]) + skip;
+        planes[c].insert(planes[c].end(), src, src + n);
+    }
+}
+
+av::FrameUPtr AudioMixer::getFrame(const bool flush) {
+    if (next_pos_ == AV_NOPTS_VALUE) return nullptr;
+    const int64_t frame_end = next_pos_ + frame_size_;
+
+    /* mix as soon as the main input covers the frame, or another input is a frame ahead of it (the main one stalled) */
+    bool covered = false;
+    bool pending = false;
+    for (size_t i = 0; i < inputs_.size(); i++) {
+        const Input &input = inputs_[i];
+        if (input.start == AV_NOPTS_VALUE) continue;
+        const int64_t end = input.start + static_cast<int64_t>(input.planes.front().size());
+        if (end >= (i == 0 ? frame_end : frame_end + frame_size_)) covered = true;
+        if (end > next_pos_) pending = true;
+    }
+    if (!covered && !(flush && pending)) return nullptr;
+
+    av::FrameUPtr frame(av_frame_alloc());
+    if (!frame) throw std::runtime_error(errMsg("failed to allocate frame"));
+    frame->nb_samples = frame_size_;
+    frame->format = AV_SAMPLE_FMT_FLTP;
+    frame->channel_layout = channel_layout_;
+    frame->channels = channels_;
+    frame->sample_rate = sample_rate_;
+    if (av_frame_get_buffer(frame.get(), 0) < 0) throw std::runtime_error(errMsg("failed to allocate frame data"));
+    for (int c = 0; c < channels_; c++) std::memset(frame->extended_data[c], 0, frame_size_ * sizeof(float));
+
+    for (auto &input : inputs_) {
+        if (input.start == AV_NOPTS_VALUE) continue;
+        const auto size = static_cast<int64_t>(input.planes.front().size());
+        const int64_t from = std::max(input.start, next_pos_);
+        const int64_t to = std::min(input.start + size, frame_end);
+        const float gain = input.gain.load(std::memory_order_relaxed);
+        if (to > from && gain > 0) {
+            for (int c = 0; c < channels_; c++) {
+                auto *dst = reinterpret_cast<float *>(frame->extended_data[c]);
+                sample_mixing::mixAdd(input.planes[c].data() + (from - input.start), dst + (from - next_pos_), gain,
+                                      static_cast<size_t>(to - from));
+            }
+        }
+
+        /* drop the samples mixed (or too late to be mixed) */
+        const int64_t consumed = std::clamp<int64_t>(frame_end - input.start, 0, size);
+        for (auto &plane : input.planes) plane.erase(plane.begin(), plane.begin() + consumed);
+        input.start += consumed;
+    }
+
+    for (int c = 0; c < channels_; c++) {
+        clipped_samples_ +=
+            sample_mixing::clip(reinterpret_cast<float *>(frame->extended_data[c]), static_cast<size_t>(frame_size_));
+    }
+    /* in the time base of the encoder (1/sample_rate), starting from 0 like the converted frames */
+    frame->pts = next_pos_ - origin_;
+    next_pos_ = frame_end;
+    return frame;
+}
+
+void AudioMixer::reset() {
+    for (auto &input : inputs_) {
+        input.offset = 0;
+        input.start = AV_NOPTS_VALUE;
+        for (auto &plane : input.planes) plane.clear();
+    }
+    origin_ = AV_NOPTS_VALUE;
+    next_pos_ = AV_NOPTS_VALUE;
+}
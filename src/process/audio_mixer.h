@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "common/common.h"
+
+/*
+ * Mixer of several audio inputs into a single stream, in the planar float format of its encoder. The inputs are
+ * aligned on a common clock (the positions of their frames, in samples) and mixed with their own gains, clamping the
+ * result so that loud inputs can't wrap around in the encoder.
+ * A mixed frame is produced as soon as the main input (the first one) covers it, so that the mix never adds more than
+ * one encoder frame of buffering: the samples the other inputs haven't delivered yet are mixed as silence, and an
+ * input whose samples arrive after their frame has been mixed (by less than a frame) is delayed by that much, instead
+ * of losing them. If the main input stalls, the frame is mixed once another input is a frame ahead of it
+ */
+class AudioMixer {
+    int channels_;
+    int sample_rate_;
+    uint64_t channel_layout_;
+    int frame_size_;
+
+    /* An input of the mix, with its samples received but not mixed yet */
+    struct Input {
+        std::atomic<float> gain{1.0f};
+        /* added to the positions of the frames, when the clock of the input is unrelated to the other ones */
+        int64_t offset = 0;
+        /* the position of the first pending sample (AV_NOPTS_VALUE until the first frame is received) */
+        int64_t start = AV_NOPTS_VALUE;
+        std::vector<std::vector<float>> planes;
+    };
+    std::vector<Input> inputs_;
+
+    /* The position of the first mixed sample, and of the next mixed frame */
+    int64_t origin_ = AV_NOPTS_VALUE;
+    int64_t next_pos_ = AV_NOPTS_VALUE;
+    uint64_t clipped_samples_{};
+
+    /* Get the position of the end of the samples received so far (the most advanced input) */
+    [[nodiscard]] int64_t getLivePosition() const;
+
+public:
+    /**
+     * Create a new mixer
+     * @param enc_ctx       the context of the encoder of the mix (with planar float samples)
+     * @param num_inputs    the number of inputs
+     */
+    AudioMixer(const AVCodecContext *enc_ctx, size_t num_inputs);
+
+    AudioMixer(const AudioMixer &) = delete;
+
+    AudioMixer &operator=(const AudioMixer &) = delete;
+
+    [[nodiscard]] size_t getNumInputs() const { return inputs_.size(); }
+
+    /**
+     * Set the gain of an input. Thread-safe, it can be called while the inputs are being mixed
+     * @param input the index of the input
+     * @param gain  the gain (1 to keep the level of the input, 0 to mute it)
+     */
+    void setGain(size_t input, float gain);
+
+    /**
+     * Send the frame of an input to mix
+     * @param input     the index of the input
+     * @param frame     the frame, in the format of the encoder of the mix
+     * @param position  the position of the frame on the clock of the mix, in samples
+     */
+    void sendFrame(size_t input, const AVFrame *frame, int64_t position);
+
+    /**
+     * Get the next mixed frame, of the frame size of the encoder
+     * @param flush true to mix the pending samples even if some inputs don't cover the whole frame yet (e.g. when
+     * the inputs have ended)
+     * @return the mixed frame, with the timestamp of its position from the start of the mix, or nullptr if no
+     * frame can be mixed yet
+     */
+    av::FrameUPtr getFrame(bool flush = false);
+
+    /**
+     * Reset the mixer to its initial state, dropping the pending samples: the next frames start a new mix, whose
+     * timestamps start again from 0 (the gains and the clipped samples count are kept)
+     */
+    void reset();
+
+    /**
+     * Get the number of mixed samples clamped so far, because the sum of the inputs exceeded the full scale
+     * @return the number of clipped samples (of all the channels)
+     */
+    [[nodiscard]] uint64_t getClippedSamples() const { return clipped_samples_; }
+};
@@ -1,7 +1,12 @@
 #include "converter.h"
 
+#include <algorithm>
 #include <sstream>
 
+#include "utils/executor.h"
+#include "utils/flow_tracer.h"
+#include "utils/sample_conversion.h"
+
 static std::string errMsg(const std::string &msg) { return ("Converter: " + msg); }
 
 void swap(Converter &lhs, Converter &rhs) {
@@ -9,11 +14,36 @@ void swap(Converter &lhs, Converter &rhs) {
     std::swap(lhs.buffersrc_ctx_, rhs.buffersrc_ctx_);
     std::swap(lhs.buffersink_ctx_, rhs.buffersink_ctx_);
     std::swap(lhs.frame_, rhs.frame_);
+    std::swap(lhs.graph_type_, rhs.graph_type_);
+    std::swap(lhs.src_args_, rhs.src_args_);
+    std::swap(lhs.filter_spec_, rhs.filter_spec_);
+    std::swap(lhs.sws_opts_, rhs.sws_opts_);
+    std::swap(lhs.slices_, rhs.slices_);
+    std::swap(lhs.in_pix_fmt_, rhs.in_pix_fmt_);
+    std::swap(lhs.out_pix_fmt_, rhs.out_pix_fmt_);
+    std::swap(lhs.out_width_, rhs.out_width_);
+    std::swap(lhs.out_height_, rhs.out_height_);
+    std::swap(lhs.offset_x_, rhs.offset_x_);
+    std::swap(lhs.offset_y_, rhs.offset_y_);
+    std::swap(lhs.start_pts_, rhs.start_pts_);
+    std::swap(lhs.converted_frame_, rhs.converted_frame_);
+    std::swap(lhs.sample_buffers_, rhs.sample_buffers_);
+    std::swap(lhs.in_sample_fmt_, rhs.in_sample_fmt_);
+    std::swap(lhs.out_sample_fmt_, rhs.out_sample_fmt_);
+    std::swap(lhs.channel_layout_, rhs.channel_layout_);
+    std::swap(lhs.channels_, rhs.channels_);
+    std::swap(lhs.sample_rate_, rhs.sample_rate_);
+    std::swap(lhs.frame_size_, rhs.frame_size_);
+    std::swap(lhs.plane_sample_size_, rhs.plane_sample_size_);
+    std::swap(lhs.in_time_base_, rhs.in_time_base_);
+    std::swap(lhs.written_samples_, rhs.written_samples_);
+    std::swap(lhs.next_pts_, rhs.next_pts_);
+    std::swap(lhs.scratch_, rhs.scratch_);
 }
 
 static std::pair<std::string, std::string> getAudioFilterSpec(const AVCodecContext *dec_ctx,
                                                               const AVCodecContext *enc_ctx,
-                                                              const AVRational in_time_base) {
+                                                              const AVRational in_time_base, const bool reframe) {
     std::stringstream src_args_ss;
     src_args_ss << "time_base=" << in_time_base.num << "/" << in_time_base.den;
     src_args_ss << ":sample_rate=" << dec_ctx->sample_rate;
@@ -34,8 +64,11 @@ static std::pair<std::string, std::string> getAudioFilterSpec(const AVCodecConte
      */
     filter_spec_ss << ",aresample=" << enc_ctx->sample_rate << ":async=1"
                    << ":out_sample_fmt=" << enc_ctx->sample_fmt << ":out_channel_layout=" << enc_ctx->channel_layout;
-    /* ensure correct number of samples for output frames (even with injected silence) */
-    filter_spec_ss << ",asetnsamples=n=" << enc_ctx->frame_size;
+    /*
+     * ensure correct number of samples for output frames (even with injected silence),
+     * unless the encoder accepts frames of any size (e.g. PCM) or the frames are repacked afterwards
+     */
+    if (enc_ctx->frame_size && reframe) filter_spec_ss << ",asetnsamples=n=" << enc_ctx->frame_size;
 
     /* format conversion (OLD, now use aresample instead) */
     // filter_spec_ss << ",aformat=sample_fmts=" << av_get_sample_fmt_name(enc_ctx->sample_fmt)
@@ -46,8 +79,9 @@ static std::pair<std::string, std::string> getAudioFilterSpec(const AVCodecConte
 
 static std::pair<std::string, std::string> getVideoFilterSpec(const AVCodecContext *dec_ctx,
                                                               const AVCodecContext *enc_ctx,
-                                                              const AVRational in_time_base, const int offset_x,
-                                                              const int offset_y) {
+                                                              const AVRational in_time_base, const int crop_width,
+                                                              const int crop_height, const int offset_x,
+                                                              const int offset_y, const std::string &sws_flags) {
     std::stringstream src_args_ss;
     src_args_ss << "video_size=" << dec_ctx->width << "x" << dec_ctx->height;
     src_args_ss << ":pix_fmt=" << dec_ctx->pix_fmt;
@@ -57,43 +91,269 @@ static std::pair<std::string, std::string> getVideoFilterSpec(const AVCodecConte
     std::stringstream filter_spec_ss;
     /* set PTS */
     filter_spec_ss << "setpts=PTS-STARTPTS";
+    /* cropping (first, so that the following steps only process the pixels that will be kept) */
+    filter_spec_ss << ",crop=" << crop_width << ":" << crop_height << ":" << offset_x << ":" << offset_y;
+    /*
+     * scaling: when followed by the format filter, the scaler directly outputs the final pixel format,
+     * so that scaling and conversion are fused in a single pass
+     */
+    if (crop_width != enc_ctx->width || crop_height != enc_ctx->height)
+        filter_spec_ss << ",scale=" << enc_ctx->width << ":" << enc_ctx->height << ":flags=" << sws_flags;
     /* format conversion */
     filter_spec_ss << ",format=" << enc_ctx->pix_fmt;
-    /* cropping */
-    filter_spec_ss << ",crop=" << enc_ctx->width << ":" << enc_ctx->height << ":" << offset_x << ":" << offset_y;
 
     return std::make_pair(src_args_ss.str(), filter_spec_ss.str());
 }
 
+static std::string getSwsFlagsName(const int sws_flags) {
+    switch (sws_flags) {
+        case SWS_FAST_BILINEAR:
+            return "fast_bilinear";
+        case SWS_BILINEAR:
+            return "bilinear";
+        case SWS_AREA:
+            return "area";
+        case SWS_BICUBIC:
+            return "bicubic";
+        default:
+            throw std::invalid_argument(errMsg("unsupported scaling flags"));
+    }
+}
+
+Converter::Converter(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, const AVRational in_time_base,
+                     const bool reframe) {
+    if (!dec_ctx) throw std::invalid_argument(errMsg("dec_ctx is NULL"));
+    if (!enc_ctx) throw std::invalid_argument(errMsg("enc_ctx is NULL"));
+    if (dec_ctx->codec_type != AVMEDIA_TYPE_AUDIO || enc_ctx->codec_type != AVMEDIA_TYPE_AUDIO)
+        throw std::invalid_argument(errMsg("received decoder and encoder must be both of type audio"));
+
+    initSampleBuffers(dec_ctx, enc_ctx, in_time_base, reframe);
+    if (!sample_buffers_.empty()) return;
+
+    auto [src_args, filter_spec] = getAudioFilterSpec(dec_ctx, enc_ctx, in_time_base, reframe);
+    initGraph(AVMEDIA_TYPE_AUDIO, src_args, filter_spec, "");
+}
+
 Converter::Converter(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, const AVRational in_time_base,
-                     const int offset_x, const int offset_y) {
+                     const int crop_width, const int crop_height, const int offset_x, const int offset_y,
+                     const int sws_flags, const int num_slices) {
     if (!dec_ctx) throw std::invalid_argument(errMsg("dec_ctx is NULL"));
     if (!enc_ctx) throw std::invalid_argument(errMsg("enc_ctx is NULL"));
+    if (dec_ctx->codec_type != AVMEDIA_TYPE_VIDEO || enc_ctx->codec_type != AVMEDIA_TYPE_VIDEO)
+        throw std::invalid_argument(errMsg("received decoder and encoder must be both of type video"));
+
+    if (num_slices < 0) throw std::invalid_argument(errMsg("the number of slices can't be negative"));
+    std::string sws_flags_name = getSwsFlagsName(sws_flags);
+
+    initSlices(dec_ctx, enc_ctx, crop_width, crop_height, sws_flags, num_slices);
+    if (!slices_.empty()) {
+        offset_x_ = offset_x;
+        offset_y_ = offset_y;
+        return;
+    }
+
+    auto [src_args, filter_spec] = getVideoFilterSpec(dec_ctx, enc_ctx, in_time_base, crop_width, crop_height,
+                                                      offset_x, offset_y, sws_flags_name);
+    /* use the same algorithm for the scalers inserted automatically to only convert the pixel format */
+    initGraph(AVMEDIA_TYPE_VIDEO, src_args, filter_spec, "flags=" + sws_flags_name);
+}
+
+void Converter::initSlices(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, const int crop_width,
+                           const int crop_height, const int sws_flags, int num_slices) {
+    /* slices can be converted independently only if each output line depends on a single input line */
+    if (crop_width != enc_ctx->width || crop_height != enc_ctx->height) return;
+
+    /* cropping is applied by offsetting the input pointer, so the input must have a single packed plane */
+    const AVPixFmtDescriptor *in_desc = av_pix_fmt_desc_get(dec_ctx->pix_fmt);
+    const AVPixFmtDescriptor *out_desc = av_pix_fmt_desc_get(enc_ctx->pix_fmt);
+    if (!in_desc || !out_desc) return;
+    const uint64_t unsupported_flags = AV_PIX_FMT_FLAG_PLANAR | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL |
+                                       AV_PIX_FMT_FLAG_HWACCEL;
+    if ((in_desc->flags & unsupported_flags) || in_desc->log2_chroma_w || in_desc->log2_chroma_h) return;
+    if (out_desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) return;
+    if (av_get_padded_bits_per_pixel(in_desc) % 8) return;
+
+    if (!num_slices) num_slices = static_cast<int>(Executor::shared().getNumWorkers());
+
+    /*
+     * the slice height is a multiple of 16 lines (which also respects the chroma subsampling of the output),
+     * so that the slices start at the beginning of a chroma line and don't share cache lines
+     */
+    const int alignment = std::max(16, 1 << out_desc->log2_chroma_h);
+    int slice_height = (crop_height + num_slices - 1) / num_slices;
+    slice_height = (slice_height + alignment - 1) / alignment * alignment;
+
+    for (int y = 0; y < crop_height; y += slice_height) {
+        Slice slice;
+        slice.y = y;
+        slice.height = std::min(slice_height, crop_height - y);
+        slice.sws_ctx = av::SwsContextUPtr(sws_getContext(crop_width, slice.height, dec_ctx->pix_fmt, crop_width,
+                                                          slice.height, enc_ctx->pix_fmt, sws_flags, nullptr,
+                                                          nullptr, nullptr));
+        if (!slice.sws_ctx) throw std::runtime_error(errMsg("failed to create the scaler of a slice"));
+        slices_.push_back(std::move(slice));
+    }
+
+    in_pix_fmt_ = dec_ctx->pix_fmt;
+    out_pix_fmt_ = enc_ctx->pix_fmt;
+    out_width_ = crop_width;
+    out_height_ = crop_height;
+}
+
+void Converter::convertSlices(const AVFrame *frame) {
+    if (converted_frame_) throw std::logic_error(errMsg("the previous converted frame hasn't been retrieved yet"));
+    if (frame->format != in_pix_fmt_) throw std::runtime_error(errMsg("unexpected pixel format of the sent frame"));
+    if (offset_x_ + out_width_ > frame->width || offset_y_ + out_height_ > frame->height)
+        throw std::runtime_error(errMsg("the sent frame is smaller than the cropped area"));
+
+    av::FrameUPtr out_frame(av_frame_alloc());
+    if (!out_frame) throw std::runtime_error(errMsg("failed to allocate frame"));
+    out_frame->format = out_pix_fmt_;
+    out_frame->width = out_width_;
+    out_frame->height = out_height_;
+    if (av_frame_get_buffer(out_frame.get(), 0) < 0) throw std::runtime_error(errMsg("failed to allocate frame data"));
+    if (av_frame_copy_props(out_frame.get(), frame) < 0)
+        throw std::runtime_error(errMsg("failed to copy the frame properties"));
+
+    /* same as the setpts=PTS-STARTPTS filter */
+    if (frame->pts != AV_NOPTS_VALUE) {
+        if (start_pts_ == AV_NOPTS_VALUE) start_pts_ = frame->pts;
+        out_frame->pts = frame->pts - start_pts_;
+    }
+
+    const AVPixFmtDescriptor *out_desc = av_pix_fmt_desc_get(out_pix_fmt_);
+    const int bytes_per_pixel = av_get_padded_bits_per_pixel(av_pix_fmt_desc_get(in_pix_fmt_)) / 8;
+    AVFrame *out = out_frame.get();
+
+    Executor::shared().parallelFor(slices_.size(), [&](const size_t i) {
+        const Slice &slice = slices_[i];
+
+        const uint8_t *src[4] = {frame->data[0] + static_cast<ptrdiff_t>(offset_y_ + slice.y) * frame->linesize[0] +
+                                 static_cast<ptrdiff_t>(offset_x_) * bytes_per_pixel};
+        const int src_stride[4] = {frame->linesize[0]};
+
+        uint8_t *dst[4] = {};
+        for (int p = 0; p < 4 && out->data[p]; p++) {
+            int shift = (p == 1 || p == 2) ? out_desc->log2_chroma_h : 0;
+            dst[p] = out->data[p] + static_cast<ptrdiff_t>(slice.y >> shift) * out->linesize[p];
+        }
+
+        if (sws_scale(slice.sws_ctx.get(), src, src_stride, 0, slice.height, dst, out->linesize) != slice.height)
+            throw std::runtime_error(errMsg("failed to convert a slice"));
+    });
 
+    converted_frame_ = std::move(out_frame);
+}
+
+/* Whether the direct audio conversion supports the given sample formats */
+static bool directSampleConversion(const AVSampleFormat in_sample_fmt, const AVSampleFormat out_sample_fmt) {
+    switch (in_sample_fmt) {
+        case AV_SAMPLE_FMT_S16:
+            return (out_sample_fmt == AV_SAMPLE_FMT_S16 || out_sample_fmt == AV_SAMPLE_FMT_FLT ||
+                    out_sample_fmt == AV_SAMPLE_FMT_FLTP);
+        case AV_SAMPLE_FMT_FLT:
+            return (out_sample_fmt == AV_SAMPLE_FMT_FLT || out_sample_fmt == AV_SAMPLE_FMT_FLTP);
+        default:
+            return false;
+    }
+}
+
+void Converter::initSampleBuffers(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx,
+                                  const AVRational in_time_base, const bool reframe) {
+    /* resampling and channel remapping require the filter graph */
+    if (dec_ctx->sample_rate != enc_ctx->sample_rate || dec_ctx->channels != enc_ctx->channels) return;
+    if (dec_ctx->channel_layout && dec_ctx->channel_layout != enc_ctx->channel_layout) return;
+    if (!directSampleConversion(dec_ctx->sample_fmt, enc_ctx->sample_fmt)) return;
+
+    in_sample_fmt_ = dec_ctx->sample_fmt;
+    out_sample_fmt_ = enc_ctx->sample_fmt;
+    channel_layout_ = enc_ctx->channel_layout;
+    channels_ = enc_ctx->channels;
+    sample_rate_ = enc_ctx->sample_rate;
+    frame_size_ = reframe ? enc_ctx->frame_size : 0;  // if 0, all the available samples are returned
+    in_time_base_ = in_time_base;
+
+    int num_planes = 1;
+    plane_sample_size_ = av_get_bytes_per_sample(out_sample_fmt_);
+    if (av_sample_fmt_is_planar(out_sample_fmt_)) {
+        num_planes = channels_;
+    } else {
+        plane_sample_size_ *= channels_;
+    }
+
+    /* room for a full encoder frame plus the samples of (at least) one second of input */
+    const size_t capacity = static_cast<size_t>(frame_size_ + sample_rate_) * plane_sample_size_;
+    for (int p = 0; p < num_planes; p++) sample_buffers_.push_back(std::make_unique<RingBuffer<uint8_t>>(capacity));
+}
+
+void Converter::convertSamples(const AVFrame *frame) {
+    if (frame->format != in_sample_fmt_ || frame->channels != channels_ || frame->sample_rate != sample_rate_)
+        throw std::runtime_error(errMsg("unexpected format of the sent frame"));
+
+    const auto nb_samples = static_cast<size_t>(frame->nb_samples);
+    const size_t free_samples = sample_buffers_.front()->getFreeSpace() / plane_sample_size_;
+    if (nb_samples > free_samples) throw std::runtime_error(errMsg("the sent frame exceeds the buffers capacity"));
+
+    /* like aresample=async=1, fill the gaps (longer than 20ms) in the input timestamps with silence */
+    if (frame->pts != AV_NOPTS_VALUE) {
+        if (start_pts_ == AV_NOPTS_VALUE) start_pts_ = frame->pts;
+        int64_t position = av_rescale_q(frame->pts - start_pts_, in_time_base_, {1, sample_rate_});
+        int64_t gap = position - written_samples_;
+        if (gap > sample_rate_ / 50) {
+            auto silence = static_cast<size_t>(std::min<int64_t>(gap, free_samples - nb_samples));
+            for (auto &buffer : sample_buffers_) buffer->write(nullptr, silence * plane_sample_size_);
+            written_samples_ += static_cast<int64_t>(silence);
+        }
+    }
+
+    const uint8_t *const *planes = frame->extended_data;
+    std::array<const uint8_t *, AV_NUM_DATA_POINTERS> converted{};
+    if (in_sample_fmt_ != out_sample_fmt_) {
+        scratch_.resize(nb_samples * plane_sample_size_ * sample_buffers_.size());
+        std::array<float *, AV_NUM_DATA_POINTERS> dst{};
+        for (size_t p = 0; p < sample_buffers_.size(); p++) {
+            auto plane = scratch_.data() + p * nb_samples * plane_sample_size_;
+            dst[p] = reinterpret_cast<float *>(plane);
+            converted[p] = plane;
+        }
+
+        auto src = frame->extended_data[0];
+        if (in_sample_fmt_ == AV_SAMPLE_FMT_S16 && out_sample_fmt_ == AV_SAMPLE_FMT_FLTP) {
+            sample_conversion::s16ToFltp(reinterpret_cast<const int16_t *>(src), dst.data(), channels_, nb_samples);
+        } else if (in_sample_fmt_ == AV_SAMPLE_FMT_S16 && out_sample_fmt_ == AV_SAMPLE_FMT_FLT) {
+            sample_conversion::s16ToFlt(reinterpret_cast<const int16_t *>(src), dst[0], nb_samples * channels_);
+        } else {  // FLT -> FLTP
+            sample_conversion::fltToFltp(reinterpret_cast<const float *>(src), dst.data(), channels_, nb_samples);
+        }
+        planes = converted.data();
+    }
+
+    for (size_t p = 0; p < sample_buffers_.size(); p++)
+        sample_buffers_[p]->write(planes[p], nb_samples * plane_sample_size_);
+    written_samples_ += static_cast<int64_t>(nb_samples);
+}
+
+void Converter::initGraph(const AVMediaType type, const std::string &src_args, const std::string &filter_spec,
+                          const std::string &sws_opts) {
     std::string src_filter_name;
     std::string sink_filter_name;
-    std::string src_args;
-    std::string filter_spec;
 
-    if (dec_ctx->codec_type != enc_ctx->codec_type) {
-        throw std::invalid_argument(errMsg("type mismatch between received decoder and encoder"));
-    } else if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+    if (type == AVMEDIA_TYPE_VIDEO) {
         src_filter_name = "buffer";
         sink_filter_name = "buffersink";
-        std::tie(src_args, filter_spec) = getVideoFilterSpec(dec_ctx, enc_ctx, in_time_base, offset_x, offset_y);
-    } else if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-        if (offset_x || offset_y)
-            throw std::logic_error(errMsg("video offset specified specified for audio converter constructor"));
+    } else {
         src_filter_name = "abuffer";
         sink_filter_name = "abuffersink";
-        std::tie(src_args, filter_spec) = getAudioFilterSpec(dec_ctx, enc_ctx, in_time_base);
-    } else {
-        throw std::invalid_argument(errMsg("unknown media type received in constructor"));
     }
 
     filter_graph_ = av::FilterGraphUPtr(avfilter_graph_alloc());
     if (!filter_graph_) throw std::runtime_error(errMsg("failed to allocate filter graph"));
 
+    if (!sws_opts.empty()) {
+        filter_graph_->scale_sws_opts = av_strdup(sws_opts.c_str());
+        if (!filter_graph_->scale_sws_opts) throw std::runtime_error(errMsg("failed to set scaler options"));
+    }
+
     { /* buffer src set-up*/
         const AVFilter *filter = avfilter_get_by_name(src_filter_name.c_str());
         if (!filter) throw std::logic_error(errMsg("failed to find src filter definition"));
@@ -136,6 +396,11 @@ Converter::Converter(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ct
 
     if (avfilter_graph_config(filter_graph_.get(), nullptr) < 0)
         throw std::runtime_error(errMsg("failed to configure the filter graph"));
+
+    graph_type_ = type;
+    src_args_ = src_args;
+    filter_spec_ = filter_spec;
+    sws_opts_ = sws_opts;
 }
 
 Converter::Converter(Converter &&other) noexcept { swap(*this, other); }
@@ -146,6 +411,20 @@ Converter &Converter::operator=(Converter other) {
 }
 
 void Converter::sendFrame(const av::FrameUPtr frame) {
+    FlowTracer::Scope scope("convert send");
+    if (frame) {
+        scope.setData(frame->nb_samples ? "audio" : "video", FlowTracer::unknown, frame->pts, FlowTracer::unknown);
+    }
+    if (!slices_.empty()) {
+        if (!frame) throw std::invalid_argument(errMsg("sent frame is not allocated"));
+        convertSlices(frame.get());
+        return;
+    }
+    if (!sample_buffers_.empty()) {
+        if (!frame) throw std::invalid_argument(errMsg("sent frame is not allocated"));
+        convertSamples(frame.get());
+        return;
+    }
     if (!buffersrc_ctx_) throw std::logic_error(errMsg("buffersrc is not allocated"));
     if (!frame) throw std::invalid_argument(errMsg("sent frame is not allocated"));
     if (av_buffersrc_add_frame(buffersrc_ctx_, frame.get()))
@@ -153,6 +432,40 @@ void Converter::sendFrame(const av::FrameUPtr frame) {
 }
 
 av::FrameUPtr Converter::getFrame() {
+    FlowTracer::Scope scope("convert receive");
+    av::FrameUPtr frame = receiveFrame();
+    if (frame) {
+        scope.setData(frame->nb_samples ? "audio" : "video", FlowTracer::unknown, frame->pts, FlowTracer::unknown);
+    } else {
+        scope.cancel();
+    }
+    return frame;
+}
+
+av::FrameUPtr Converter::receiveFrame() {
+    if (!slices_.empty()) return std::move(converted_frame_);
+    if (!sample_buffers_.empty()) {
+        /* if the encoder accepts frames of any size, return all the available samples */
+        const size_t available = sample_buffers_.front()->size() / plane_sample_size_;
+        const size_t nb_samples = frame_size_ ? frame_size_ : available;
+        if (!nb_samples || available < nb_samples) return nullptr;
+
+        av::FrameUPtr frame(av_frame_alloc());
+        if (!frame) throw std::runtime_error(errMsg("failed to allocate frame"));
+        frame->nb_samples = static_cast<int>(nb_samples);
+        frame->format = out_sample_fmt_;
+        frame->channel_layout = channel_layout_;
+        frame->channels = channels_;
+        frame->sample_rate = sample_rate_;
+        if (av_frame_get_buffer(frame.get(), 0) < 0) throw std::runtime_error(errMsg("failed to allocate frame data"));
+
+        for (size_t p = 0; p < sample_buffers_.size(); p++)
+            sample_buffers_[p]->read(frame->extended_data[p], nb_samples * plane_sample_size_);
+        /* in the time base of the encoder (1/sample_rate), starting from 0 like the asetpts=PTS-STARTPTS filter */
+        frame->pts = next_pts_;
+        next_pts_ += static_cast<int64_t>(nb_samples);
+        return frame;
+    }
     if (!buffersink_ctx_) throw std::logic_error(errMsg("buffersink is not allocated"));
 
     if (!frame_) {
@@ -165,4 +478,14 @@ av::FrameUPtr Converter::getFrame() {
     if (ret < 0) throw std::runtime_error(errMsg("failed to receive frame from filter"));
 
     return std::move(frame_);
-}
\ No newline at end of file
+}
+
+void Converter::reset() {
+    start_pts_ = AV_NOPTS_VALUE;
+    converted_frame_.reset();
+    for (auto &buffer : sample_buffers_) buffer->read(nullptr, buffer->size());
+    written_samples_ = 0;
+    next_pts_ = 0;
+    /* the filters keep their state (e.g. STARTPTS and the buffered samples), so the graph is built again */
+    if (filter_graph_) initGraph(graph_type_, src_args_, filter_spec_, sws_opts_);
+}
@@ -1,15 +1,101 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "common/common.h"
+#include "utils/ring_buffer.h"
 
 class Converter {
     av::FilterGraphUPtr filter_graph_;
     AVFilterContext *buffersrc_ctx_{};
     AVFilterContext *buffersink_ctx_{};
     av::FrameUPtr frame_;
+    /* The description of the filter graph, to build it again on reset() */
+    AVMediaType graph_type_ = AVMEDIA_TYPE_UNKNOWN;
+    std::string src_args_;
+    std::string filter_spec_;
+    std::string sws_opts_;
+
+    /* Horizontal band of the video frames, converted by its own scaler in parallel with the other ones */
+    struct Slice {
+        av::SwsContextUPtr sws_ctx;
+        int y;
+        int height;
+    };
+    /* When not empty, the video frames are converted slice by slice, without using the filter graph */
+    std::vector<Slice> slices_;
+    AVPixelFormat in_pix_fmt_ = AV_PIX_FMT_NONE;
+    AVPixelFormat out_pix_fmt_ = AV_PIX_FMT_NONE;
+    int out_width_{};
+    int out_height_{};
+    int offset_x_{};
+    int offset_y_{};
+    int64_t start_pts_ = AV_NOPTS_VALUE;
+    av::FrameUPtr converted_frame_;
+
+    /*
+     * When not empty, the audio frames are converted directly, without the filter graph, accumulating the samples
+     * of each output plane until a full frame for the encoder is available
+     */
+    std::vector<std::unique_ptr<RingBuffer<uint8_t>>> sample_buffers_;
+    AVSampleFormat in_sample_fmt_ = AV_SAMPLE_FMT_NONE;
+    AVSampleFormat out_sample_fmt_ = AV_SAMPLE_FMT_NONE;
+    uint64_t channel_layout_{};
+    int channels_{};
+    int sample_rate_{};
+    int frame_size_{};
+    int plane_sample_size_{};  // size in bytes of a sample in each output plane
+    AVRational in_time_base_{};
+    int64_t written_samples_{};  // samples written to the buffers since the first frame (including the silence)
+    int64_t next_pts_{};
+    std::vector<uint8_t> scratch_;
 
     friend void swap(Converter &lhs, Converter &rhs);
 
+    /**
+     * Build and configure the filter graph
+     * @param type          the media type of the frames to convert
+     * @param src_args      the arguments of the buffer source
+     * @param filter_spec   the description of the filters to apply
+     * @param sws_opts      the options of the scalers automatically inserted in the graph (if empty, the default ones)
+     */
+    void initGraph(AVMediaType type, const std::string &src_args, const std::string &filter_spec,
+                   const std::string &sws_opts);
+
+    /**
+     * Set up the scalers converting the frames slice by slice, if the conversion allows it (no scaling and packed
+     * input pixel format), otherwise leave the slices empty
+     * @param dec_ctx       the decoder context containing the input params
+     * @param enc_ctx       the encoder context containing the output params
+     * @param crop_width    the width of the cropped area
+     * @param crop_height   the height of the cropped area
+     * @param sws_flags     the swscale flags
+     * @param num_slices    the number of slices (if 0, the number of workers of the shared executor)
+     */
+    void initSlices(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, int crop_width, int crop_height,
+                    int sws_flags, int num_slices);
+
+    /* Convert a frame slice by slice, on the shared executor */
+    void convertSlices(const AVFrame *frame);
+
+    /**
+     * Set up the direct audio conversion, if the conversion allows it (same sample rate and channels, supported
+     * sample formats), otherwise leave the sample buffers empty
+     * @param dec_ctx       the decoder context containing the input params
+     * @param enc_ctx       the encoder context containing the output params
+     * @param in_time_base  the time-base of the frames sent to the converter
+     * @param reframe       whether the samples are repacked in frames of the encoder frame size
+     */
+    void initSampleBuffers(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, AVRational in_time_base,
+                           bool reframe);
+
+    /* Convert the samples of a frame and append them to the sample buffers */
+    void convertSamples(const AVFrame *frame);
+
+    /* Get the next converted frame, from the slices, the sample buffers or the filter graph */
+    av::FrameUPtr receiveFrame();
+
 public:
     /**
      * Create a new empty converter
@@ -17,19 +103,41 @@ public:
     Converter() = default;
 
     /**
-     * Create a new audio/video converter.
-     * For video, converting the pixel-format and cropping the frame to the output size.
-     * For audio, converting the sample-format, sample-rate and channel layout.
+     * Create a new audio converter, converting the sample-format, sample-rate and channel layout.
+     * When only the sample-format has to be converted (e.g. interleaved 16 bit to planar float), the samples are
+     * converted directly and repacked in frames of the encoder frame size, otherwise a filter graph is used.
+     * WARNING: Even if the time-base of the encoder differs from the decoder's one, the timestamps of the frames
+     * won't be converted (an eventual conversion will have to be performed separately)
+     * @param dec_ctx       the decoder context containing the input params (time_base will be ignored)
+     * @param enc_ctx       the encoder context containing the output params (time_base will be ignored)
+     * @param in_time_base  the time-base of the frames sent to the converter
+     * @param reframe       whether the frames are repacked in frames of the encoder frame size (false if they are
+     * repacked afterwards, e.g. by a mixer, so that the converter doesn't hold back a frame of samples)
+     */
+    Converter(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, AVRational in_time_base,
+              bool reframe = true);
+
+    /**
+     * Create a new video converter, cropping the frames, scaling them to the output size and converting
+     * the pixel-format. Scaling and pixel-format conversion are performed together in a single pass, after
+     * cropping, so that their cost is proportional to the output pixels when downscaling.
+     * When no scaling is needed, the frames are split in horizontal slices converted in parallel on the shared
+     * executor, otherwise a filter graph is used.
      * WARNING: Even if the time-base of the encoder differs from the decoder's one, the timestamps of the frames
      * won't be converted (an eventual conversion will have to be performed separately)
      * @param dec_ctx       the decoder context containing the input params (time_base will be ignored)
      * @param enc_ctx       the encoder context containing the output params (time_base will be ignored)
      * @param in_time_base  the time-base of the frames sent to the converter
-     * @param offset_x      (video-only) the horizontal offset to use when performing the cropping of the frames
-     * @param offset_y      (video-only) the vertical offset to use when performing the cropping of the frames
+     * @param crop_width    the width of the cropped area
+     * @param crop_height   the height of the cropped area
+     * @param offset_x      the horizontal offset of the cropped area
+     * @param offset_y      the vertical offset of the cropped area
+     * @param sws_flags     the swscale flags selecting the scaling algorithm (e.g. SWS_FAST_BILINEAR)
+     * @param num_slices    the number of slices converted in parallel (if 0, the number of workers of the shared
+     * executor, if 1 the conversion is performed by the calling thread)
      */
-    Converter(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, AVRational in_time_base, int offset_x = 0,
-              int offset_y = 0);
+    Converter(const AVCodecContext *dec_ctx, const AVCodecContext *enc_ctx, AVRational in_time_base, int crop_width,
+              int crop_height, int offset_x, int offset_y, int sws_flags, int num_slices = 0);
 
     Converter(const Converter &) = delete;
 
@@ -49,4 +157,10 @@ public:
      * @return a new converted frame if it was possible to build it, nullptr otherwise
      */
     av::FrameUPtr getFrame();
+
+    /**
+     * Reset the converter to its initial state, dropping the frames (or samples) not retrieved yet, so that the
+     * timestamps of the next frames start again from 0
+     */
+    void reset();
 };
\ No newline at end of file
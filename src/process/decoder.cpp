@@ -2,6 +2,8 @@
 
 #include <stdexcept>
 
+#include "utils/flow_tracer.h"
+
 static std::string errMsg(const std::string &msg) { return ("Decoder: " + msg); }
 
 void swap(Decoder &lhs, Decoder &rhs) {
@@ -35,6 +37,11 @@ Decoder &Decoder::operator=(Decoder other) {
 
 bool Decoder::sendPacket(const AVPacket *packet) {
     if (!codec_ctx_) throw std::logic_error(errMsg("decoder was not initialized yet"));
+    FlowTracer::Scope scope("decode send");
+    if (packet) {
+        scope.setData(av_get_media_type_string(codec_ctx_->codec_type), packet->stream_index, packet->pts,
+                      packet->size);
+    }
     int ret = avcodec_send_packet(codec_ctx_.get(), packet);
     if (ret == AVERROR(EAGAIN)) return false;
     if (ret == AVERROR_EOF) throw std::logic_error(errMsg("has already been flushed"));
@@ -50,13 +57,24 @@ av::FrameUPtr Decoder::getFrame() {
         if (!frame_) throw std::runtime_error(errMsg("failed to allocate frame"));
     }
 
+    FlowTracer::Scope scope("decode receive");
     int ret = avcodec_receive_frame(codec_ctx_.get(), frame_.get());
-    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return nullptr;
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        scope.cancel();
+        return nullptr;
+    }
     if (ret < 0) throw std::runtime_error(errMsg("failed to receive frame from decoder"));
+    scope.setData(av_get_media_type_string(codec_ctx_->codec_type), FlowTracer::unknown, frame_->pts,
+                  FlowTracer::unknown);
 
     return std::move(frame_);
 }
 
+void Decoder::reset() {
+    if (!codec_ctx_) throw std::logic_error(errMsg("decoder was not initialized yet"));
+    avcodec_flush_buffers(codec_ctx_.get());
+}
+
 const AVCodecContext *Decoder::getContext() const { return codec_ctx_.get(); }
 
 std::string Decoder::getName() const {
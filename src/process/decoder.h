@@ -47,6 +47,11 @@ public:
      */
     av::FrameUPtr getFrame();
 
+    /**
+     * Reset the internal state of the decoder (e.g. after it has been flushed), so that it can accept new packets
+     */
+    void reset();
+
     /**
      * Access the internal codec context
      * @return an observer pointer to access the codec context
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <stdexcept>
 
+#include "utils/flow_tracer.h"
+
 #define VERBOSE 0  // TO-DO: improve
 
 static std::string errMsg(const std::string &msg) { return ("Encoder: " + msg); }
@@ -12,6 +14,8 @@ void swap(Encoder &lhs, Encoder &rhs) {
     std::swap(lhs.codec_, rhs.codec_);
     std::swap(lhs.codec_ctx_, rhs.codec_ctx_);
     std::swap(lhs.packet_, rhs.packet_);
+    std::swap(lhs.global_header_flags_, rhs.global_header_flags_);
+    std::swap(lhs.options_, rhs.options_);
 }
 
 Encoder::Encoder(const AVCodecID codec_id) {
@@ -75,6 +79,9 @@ void Encoder::init(const int global_header_flags, const std::map<std::string, st
     assert(codec_);
     assert(codec_ctx_);
 
+    global_header_flags_ = global_header_flags;
+    options_ = options;
+
     if (global_header_flags & AVFMT_GLOBALHEADER) codec_ctx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
     av::DictionaryUPtr dict = av::map2dict(options);
@@ -92,6 +99,11 @@ void Encoder::init(const int global_header_flags, const std::map<std::string, st
 
 bool Encoder::sendFrame(const AVFrame *frame) {
     if (!codec_ctx_) throw std::logic_error(errMsg("encoder was not initialized yet"));
+    FlowTracer::Scope scope("encode send");
+    if (frame) {
+        scope.setData(av_get_media_type_string(codec_ctx_->codec_type), FlowTracer::unknown, frame->pts,
+                      FlowTracer::unknown);
+    }
     int ret = avcodec_send_frame(codec_ctx_.get(), frame);
     if (ret == AVERROR(EAGAIN)) return false;
     if (ret == AVERROR_EOF) throw std::logic_error(errMsg("has already been flushed"));
@@ -107,13 +119,54 @@ av::PacketUPtr Encoder::getPacket() {
         if (!packet_) throw std::runtime_error(errMsg("failed to allocate packet"));
     }
 
+    FlowTracer::Scope scope("encode receive");
     int ret = avcodec_receive_packet(codec_ctx_.get(), packet_.get());
-    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return nullptr;
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        scope.cancel();
+        return nullptr;
+    }
     if (ret < 0) throw std::runtime_error(errMsg("failed to receive frame from decoder"));
+    scope.setData(av_get_media_type_string(codec_ctx_->codec_type), FlowTracer::unknown, packet_->pts,
+                  packet_->size);
 
     return std::move(packet_);
 }
 
+void Encoder::setOption(const std::string &key, const std::string &value) {
+    if (!codec_ctx_) throw std::logic_error(errMsg("encoder was not initialized yet"));
+    if (av_opt_set(codec_ctx_.get(), key.c_str(), value.c_str(), AV_OPT_SEARCH_CHILDREN) < 0)
+        throw std::runtime_error(errMsg("failed to set the '" + key + "' option"));
+    options_[key] = value;
+}
+
+void Encoder::reset() {
+    if (!codec_ctx_) throw std::logic_error(errMsg("encoder was not initialized yet"));
+
+    if (codec_->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) {
+        avcodec_flush_buffers(codec_ctx_.get());
+        return;
+    }
+
+    /* the codec cannot be flushed: open a new context with the same parameters */
+    av::CodecContextUPtr old_ctx = std::move(codec_ctx_);
+    codec_ctx_ = av::CodecContextUPtr(avcodec_alloc_context3(codec_));
+    if (!codec_ctx_) throw std::runtime_error(errMsg("failed to allocated memory for AVCodecContext"));
+
+    if (codec_->type == AVMEDIA_TYPE_VIDEO) {
+        codec_ctx_->width = old_ctx->width;
+        codec_ctx_->height = old_ctx->height;
+        codec_ctx_->pix_fmt = old_ctx->pix_fmt;
+        codec_ctx_->time_base = old_ctx->time_base;
+    } else {
+        codec_ctx_->sample_rate = old_ctx->sample_rate;
+        codec_ctx_->channel_layout = old_ctx->channel_layout;
+        codec_ctx_->channels = old_ctx->channels;
+        codec_ctx_->sample_fmt = old_ctx->sample_fmt;
+    }
+
+    init(global_header_flags_, options_);
+}
+
 const AVCodecContext *Encoder::getContext() const { return codec_ctx_.get(); }
 
 std::string Encoder::getName() const {
@@ -13,6 +13,9 @@ class Encoder {
 #endif
     av::CodecContextUPtr codec_ctx_;
     av::PacketUPtr packet_;
+    /* Kept to re-open the codec context when the encoder doesn't support flushing */
+    int global_header_flags_{};
+    std::map<std::string, std::string> options_;
 
     friend void swap(Encoder &lhs, Encoder &rhs);
 
@@ -84,6 +87,21 @@ public:
      */
     av::PacketUPtr getPacket();
 
+    /**
+     * Change an option of the open encoder, taking effect from the next frame (only the options the codec can
+     * reconfigure while encoding, e.g. the CRF of libx264). The option is kept when the context is re-opened
+     * @param key   the name of the option
+     * @param value the new value of the option
+     */
+    void setOption(const std::string &key, const std::string &value);
+
+    /**
+     * Reset the internal state of the encoder (e.g. after it has been flushed), so that it can accept new frames.
+     * If the codec doesn't support flushing, the codec context will be re-opened with the same parameters
+     * (in this case, previously obtained context pointers will become invalid)
+     */
+    void reset();
+
     /**
      * Access the internal codec context
      * @return an observer pointer to access the codec context
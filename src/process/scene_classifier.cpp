@@ -0,0 +1,118 @@
+#include "scene_classifier.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+static std::string errMsg(const std::string &msg) { return ("SceneClassifier: " + msg); }
+
+/* The subsampling step, in both directions */
+static constexpr int step = 4;
+/* The luma difference between horizontally adjacent (subsampled) pixels counted as an edge */
+static constexpr int edge_threshold = 32;
+/* The luma difference between consecutive frames counted as a change */
+static constexpr int change_threshold = 8;
+/* Below this average change ratio nothing is happening on the screen */
+static constexpr double idle_change_ratio = 0.002;
+/* Above this average edge density the screen is dominated by text (or other sharp synthetic content) */
+static constexpr double text_edge_density = 0.08;
+/* Above this average change ratio with a strong motion the screen is dominated by natural video */
+static constexpr double video_change_ratio = 0.25;
+static constexpr double video_motion = 12;
+
+SceneClassifier::SceneClassifier(const int width, const int height, const AVPixelFormat pix_fmt, const int window)
+    : width_(width),
+      height_(height),
+      window_(window),
+      small_width_((width + step - 1) / step),
+      small_height_((height + step - 1) / step) {
+    if (width_ <= 0 || height_ <= 0) throw std::invalid_argument(errMsg("invalid frame size"));
+    if (window_ <= 0) throw std::invalid_argument(errMsg("window must be > 0"));
+
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) || desc->comp[0].plane != 0 ||
+        desc->comp[0].step != 1 || desc->comp[0].depth != 8)
+        throw std::invalid_argument(errMsg("the pixel format must have an 8 bit luma plane"));
+
+    small_.resize(static_cast<size_t>(small_width_) * small_height_);
+    prev_small_.resize(small_.size());
+}
+
+bool SceneClassifier::process(const AVFrame *frame) {
+    if (frame->width != width_ || frame->height != height_)
+        throw std::invalid_argument(errMsg("unexpected frame size"));
+
+    const int64_t start = av_gettime_relative();
+
+    const uint8_t *luma = frame->data[0];
+    const ptrdiff_t stride = frame->linesize[0];
+    int edges = 0;
+    int changes = 0;
+    int64_t motion = 0;
+    for (int y = 0; y < small_height_; y++) {
+        const uint8_t *src = luma + y * step * stride;
+        uint8_t *dst = &small_[static_cast<size_t>(y) * small_width_];
+        const uint8_t *prev = &prev_small_[static_cast<size_t>(y) * small_width_];
+        for (int x = 0; x < small_width_; x++) {
+            dst[x] = src[x * step];
+            if (x && std::abs(dst[x] - dst[x - 1]) > edge_threshold) edges++;
+            const int diff = std::abs(dst[x] - prev[x]);
+            if (diff > change_threshold) {
+                changes++;
+                motion += diff;
+            }
+        }
+    }
+    std::swap(small_, prev_small_);
+
+    const double pixels = static_cast<double>(small_width_) * small_height_;
+    edge_density_ += edges / pixels;
+    if (has_prev_) {
+        change_ratio_ += changes / pixels;
+        if (changes) motion_ += static_cast<double>(motion) / changes;
+    }
+    has_prev_ = true;
+    window_frames_++;
+
+    bool changed = false;
+    if (window_frames_ == window_) {
+        const Scene previous = scene_;
+        scene_ = classify();
+        stats_.scene_frames[static_cast<int>(scene_)] += window_;
+        changed = scene_ != previous;
+    }
+
+    stats_.frames++;
+    stats_.time += av_gettime_relative() - start;
+    return changed;
+}
+
+SceneClassifier::Scene SceneClassifier::classify() {
+    const double edge_density = edge_density_ / window_frames_;
+    const double change_ratio = change_ratio_ / window_frames_;
+    const double motion = motion_ / window_frames_;
+    window_frames_ = 0;
+    edge_density_ = change_ratio_ = motion_ = 0;
+
+    if (change_ratio < idle_change_ratio) return Scene::Idle;
+    if (change_ratio > video_change_ratio && motion > video_motion) return Scene::Video;
+    if (edge_density > text_edge_density) return Scene::Text;
+    return Scene::Video;
+}
+
+void SceneClassifier::reset() {
+    has_prev_ = false;
+    window_frames_ = 0;
+    edge_density_ = change_ratio_ = motion_ = 0;
+}
+
+std::ostream &operator<<(std::ostream &os, const SceneClassifier::Scene scene) {
+    switch (scene) {
+        case SceneClassifier::Scene::Idle:
+            return os << "idle";
+        case SceneClassifier::Scene::Text:
+            return os << "text";
+        case SceneClassifier::Scene::Video:
+            return os << "video";
+    }
+    return os;
+}
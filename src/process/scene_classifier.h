@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "common/common.h"
+
+/*
+ * Lightweight classifier of the recorded screen content, working on a subsampled copy of the luma plane.
+ * The features (edge density, change ratio, motion) are averaged over windows of frames (the GOP length of the
+ * encoder), so that the encoder settings are switched at most once per GOP (with a keyframe starting a new one)
+ */
+class SceneClassifier {
+public:
+    enum class Scene { Idle, Text, Video };
+
+    struct Stats {
+        int64_t frames = 0;
+        int64_t time = 0;  // in microseconds
+        /* the frames classified as each scene */
+        std::array<int64_t, 3> scene_frames{};
+    };
+
+private:
+    int width_;
+    int height_;
+    int window_;
+    int small_width_;
+    int small_height_;
+    std::vector<uint8_t> small_;
+    std::vector<uint8_t> prev_small_;
+    bool has_prev_{};
+    Scene scene_ = Scene::Text;
+
+    /* The features accumulated in the current window */
+    int window_frames_{};
+    double edge_density_{};
+    double change_ratio_{};
+    double motion_{};
+
+    Stats stats_;
+
+    /* Classify the current window and start a new one */
+    Scene classify();
+
+public:
+    /**
+     * Create a new classifier
+     * @param width     the width of the frames
+     * @param height    the height of the frames
+     * @param pix_fmt   the pixel format of the frames (with an 8 bit luma plane)
+     * @param window    the number of frames of each classification window (e.g. the GOP length)
+     */
+    SceneClassifier(int width, int height, AVPixelFormat pix_fmt, int window);
+
+    /**
+     * Add a frame to the current window
+     * @param frame the frame, in the size and pixel format given when creating the classifier
+     * @return true if the frame closes a window whose scene differs from the previous one (see getScene())
+     */
+    bool process(const AVFrame *frame);
+
+    /* Get the scene of the last complete window (Text before the first one) */
+    [[nodiscard]] Scene getScene() const { return scene_; }
+
+    /* Get the number of analyzed frames, their classification and the time spent */
+    [[nodiscard]] const Stats &getStats() const { return stats_; }
+
+    /* Discard the current window and the previous frame, e.g. when restarting the processing */
+    void reset();
+};
+
+std::ostream &operator<<(std::ostream &os, SceneClassifier::Scene scene);
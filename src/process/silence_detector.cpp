@@ -0,0 +1,107 @@
+#include "silence_detector.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "utils/sample_levels.h"
+
+static std::string errMsg(const std::string &msg) { return ("SilenceDetector: " + msg); }
+
+/* The number of silent frames encoded to get a packet past the start-up of the encoder */
+static constexpr int silent_frames = 4;
+
+SilenceDetector::SilenceDetector(Encoder encoder, const float threshold, const int64_t hold_time) {
+    const AVCodecContext *enc_ctx = encoder.getContext();
+    if (!enc_ctx || enc_ctx->codec_type != AVMEDIA_TYPE_AUDIO)
+        throw std::invalid_argument(errMsg("the encoder must be an audio one"));
+    if (!enc_ctx->frame_size) throw std::invalid_argument(errMsg("the frames of the encoder must be of fixed size"));
+    if (enc_ctx->sample_fmt != AV_SAMPLE_FMT_FLTP && enc_ctx->sample_fmt != AV_SAMPLE_FMT_FLT)
+        throw std::invalid_argument(errMsg("the encoder must take float samples"));
+    if (threshold > 0) throw std::invalid_argument(errMsg("the threshold can't be above the full scale"));
+    if (hold_time < 0) throw std::invalid_argument(errMsg("the hold time can't be negative"));
+
+    frame_size_ = enc_ctx->frame_size;
+    delay_ = enc_ctx->initial_padding;
+    planar_ = enc_ctx->sample_fmt == AV_SAMPLE_FMT_FLTP;
+    channels_ = enc_ctx->channels;
+    const float level = std::pow(10.0f, threshold / 20);
+    threshold_squared_ = level * level;
+    /* a click 20 dB above the threshold breaks the silence, even if the RMS of its frame is low */
+    peak_threshold_ = level * 10;
+    hold_samples_ = av_rescale(hold_time, enc_ctx->sample_rate, AV_TIME_BASE);
+
+    av::FrameUPtr frame(av_frame_alloc());
+    if (!frame) throw std::runtime_error(errMsg("failed to allocate frame"));
+    frame->nb_samples = frame_size_;
+    frame->format = enc_ctx->sample_fmt;
+    frame->channel_layout = enc_ctx->channel_layout;
+    frame->channels = channels_;
+    frame->sample_rate = enc_ctx->sample_rate;
+    if (av_frame_get_buffer(frame.get(), 0) < 0) throw std::runtime_error(errMsg("failed to allocate frame data"));
+    av_samples_set_silence(frame->extended_data, 0, frame_size_, channels_, enc_ctx->sample_fmt);
+
+    /* the last packet is the one of a silent frame following other silent ones, as in the silent stretches */
+    for (int i = 0; i < silent_frames; i++) {
+        frame->pts = static_cast<int64_t>(i) * frame_size_;
+        bool encoder_received = false;
+        while (!encoder_received) {
+            encoder_received = encoder.sendFrame(frame.get());
+
+            while (true) {
+                auto packet = encoder.getPacket();
+                if (!packet) break;
+                silent_packet_ = std::move(packet);
+            }
+        }
+    }
+    if (!silent_packet_) throw std::runtime_error(errMsg("failed to encode the silent packet"));
+}
+
+bool SilenceDetector::process(const AVFrame *frame) {
+    stats_.frames++;
+    if (next_pts_ == AV_NOPTS_VALUE) next_pts_ = frame->pts - delay_;
+
+    sample_levels::Levels levels;
+    if (planar_) {
+        for (int c = 0; c < channels_; c++) {
+            sample_levels::accumulate(reinterpret_cast<const float *>(frame->extended_data[c]),
+                                      static_cast<size_t>(frame->nb_samples), levels);
+        }
+    } else {
+        sample_levels::accumulate(reinterpret_cast<const float *>(frame->extended_data[0]),
+                                  static_cast<size_t>(frame->nb_samples) * channels_, levels);
+    }
+
+    const auto n = static_cast<float>(frame->nb_samples) * static_cast<float>(channels_);
+    if (levels.peak >= peak_threshold_ || levels.sum_squares >= threshold_squared_ * n) {
+        quiet_samples_ = 0;
+        return false;
+    }
+    quiet_samples_ += frame->nb_samples;
+    /* the frames of the hold time are still encoded, as well as a shorter last frame */
+    if (quiet_samples_ <= hold_samples_ || frame->nb_samples != frame_size_) return false;
+    stats_.silent_frames++;
+    return true;
+}
+
+av::PacketUPtr SilenceDetector::getSilentPacket() {
+    av::PacketUPtr packet(av_packet_clone(silent_packet_.get()));
+    if (!packet) throw std::runtime_error(errMsg("failed to reference the silent packet"));
+    packet->pts = next_pts_;
+    packet->dts = next_pts_;
+    packet->duration = frame_size_;
+    next_pts_ += frame_size_;
+    return packet;
+}
+
+void SilenceDetector::setTimestamps(AVPacket *packet) {
+    if (next_pts_ == AV_NOPTS_VALUE) return;
+    packet->pts = next_pts_;
+    packet->dts = next_pts_;
+    next_pts_ += packet->duration > 0 ? packet->duration : frame_size_;
+}
+
+void SilenceDetector::reset() {
+    quiet_samples_ = 0;
+    next_pts_ = AV_NOPTS_VALUE;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/common.h"
+#include "process/encoder.h"
+
+/*
+ * Detector of the silent stretches of an audio stream, whose frames don't need to be encoded: once the level of
+ * the frames (RMS and peak) stays below the threshold for the hold time, the frames are replaced by a silent packet
+ * encoded in advance, until a frame is above the threshold again. All the packets of the stream (the encoded and
+ * the silent ones) are timestamped by the detector, one encoder frame after the other, so that the timestamps stay
+ * continuous even if the encoder holds some frames back when it stops being fed
+ */
+class SilenceDetector {
+public:
+    struct Stats {
+        int64_t frames = 0;
+        int64_t silent_frames = 0;
+    };
+
+private:
+    /* the squared RMS and the peak below which a frame is silent */
+    float threshold_squared_;
+    float peak_threshold_;
+    int64_t hold_samples_;
+    int frame_size_;
+    int64_t delay_;
+    bool planar_;
+    int channels_;
+
+    /* The samples below the threshold since the last frame above it */
+    int64_t quiet_samples_{};
+    av::PacketUPtr silent_packet_;
+    /* The timestamp of the next packet of the stream (AV_NOPTS_VALUE until the first frame) */
+    int64_t next_pts_ = AV_NOPTS_VALUE;
+
+    Stats stats_;
+
+public:
+    /**
+     * Create a new detector, encoding the silent packet with an encoder with the same settings as the stream one
+     * @param encoder   a new encoder (consumed), with the settings of the encoder of the stream (its frames must be
+     * of fixed size, with float samples)
+     * @param threshold the level below which the frames are silent, in dBFS (e.g. -60)
+     * @param hold_time how long the frames must be below the threshold before being replaced, in AV_TIME_BASE units
+     */
+    SilenceDetector(Encoder encoder, float threshold, int64_t hold_time);
+
+    /**
+     * Measure the level of a frame
+     * @param frame the frame, in the format of the encoder
+     * @return true if the frame is part of a silent stretch, and must be replaced by getSilentPacket()
+     */
+    bool process(const AVFrame *frame);
+
+    /**
+     * Get the silent packet replacing the last frame processed
+     * @return a new reference to the silent packet, with the timestamp of the frame
+     */
+    av::PacketUPtr getSilentPacket();
+
+    /**
+     * Set the timestamps of a packet of the encoder of the stream, following the previous packets
+     * @param packet the encoded packet
+     */
+    void setTimestamps(AVPacket *packet);
+
+    /* Restart the detection, e.g. when the encoder of the stream has been reset */
+    void reset();
+
+    [[nodiscard]] const Stats &getStats() const { return stats_; }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_DIFFERENCE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BLOCK_DIFFERENCE_NEON
+#endif
+
+/*
+ * Differences between blocks of 8 bit samples (e.g. the luma planes of two consecutive frames),
+ * vectorized for the 16 samples wide rows of the H.264 macroblocks
+ */
+
+namespace block_difference {
+
+/**
+ * Compute the sum of absolute differences between two blocks
+ * @param a         the first row of the first block
+ * @param a_stride  the distance between two rows of the first block, in bytes
+ * @param b         the first row of the second block
+ * @param b_stride  the distance between two rows of the second block, in bytes
+ * @param width     the width of the blocks
+ * @param height    the height of the blocks
+ * @return the sum of absolute differences
+ */
+inline uint32_t sad(const uint8_t *a, ptrdiff_t a_stride, const uint8_t *b, ptrdiff_t b_stride, int width,
+                    int height) {
+    uint32_t sum = 0;
+    int x = 0;
+#if defined(BLOCK_DIFFERENCE_SSE2)
+    if (width >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        for (; x + 16 <= width; x += 16) {
+            for (int y = 0; y < height; y++) {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + y * a_stride + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + y * b_stride + x));
+                /* two 16 bit partial sums, in the low halves of the 64 bit lanes */
+                acc = _mm_add_epi32(acc, _mm_sad_epu8(va, vb));
+            }
+        }
+        sum = static_cast<uint32_t>(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+    }
+#elif defined(BLOCK_DIFFERENCE_NEON)
+    if (width >= 16) {
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (; x + 16 <= width; x += 16) {
+            for (int y = 0; y < height; y++) {
+                uint8x16_t diff = vabdq_u8(vld1q_u8(a + y * a_stride + x), vld1q_u8(b + y * b_stride + x));
+                acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+            }
+        }
+        uint64x2_t acc64 = vpaddlq_u32(acc);
+        sum = static_cast<uint32_t>(vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1));
+    }
+#endif
+    for (int y = 0; y < height; y++) {
+        for (int i = x; i < width; i++) sum += std::abs(a[y * a_stride + i] - b[y * b_stride + i]);
+    }
+    return sum;
+}
+
+}  // namespace block_difference
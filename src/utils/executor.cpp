@@ -0,0 +1,220 @@
+#include "executor.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "flow_tracer.h"
+#include "thread_priority.h"
+
+Executor::Executor(unsigned num_workers) {
+    if (!num_workers) num_workers = std::thread::hardware_concurrency();
+    if (!num_workers) num_workers = 1;
+
+    for (unsigned i = 0; i < num_workers; i++) queues_.push_back(std::make_unique<WorkerQueue>());
+    try {
+        for (unsigned i = 0; i < num_workers; i++) workers_.emplace_back([this, i]() { work(i); });
+    } catch (...) {
+        {
+            std::lock_guard lg(m_);
+            stopped_ = true;
+            cv_.notify_all();
+        }
+        for (auto &w : workers_) w.join();
+        throw;
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard lg(m_);
+        stopped_ = true;
+        cv_.notify_all();
+    }
+    for (auto &w : workers_) w.join();
+}
+
+Executor &Executor::shared() {
+    static Executor executor;
+    return executor;
+}
+
+/* index of the worker running on the current thread, and the executor it belongs to */
+static thread_local const Executor *current_executor = nullptr;
+static thread_local unsigned current_index = 0;
+
+void Executor::submit(Task task, const Priority priority) {
+    assert(task);
+
+    /* counted before being published, so that a worker taking it right away can't make the counter underflow */
+    if (priority == High) {
+        std::lock_guard lg(m_);
+        pending_++;
+        high_priority_tasks_.push_back(std::move(task));
+    } else {
+        {
+            std::lock_guard lg(m_);
+            pending_++;
+        }
+        unsigned index = (current_executor == this) ? current_index : (next_queue_++ % queues_.size());
+        std::lock_guard lg(queues_[index]->m);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void Executor::parallelFor(const size_t n, const std::function<void(size_t)> &fn, const Priority priority) {
+    struct State {
+        std::atomic<size_t> next{};
+        std::mutex m;
+        std::condition_variable cv;
+        size_t running{};  // number of helpers which may still call fn
+        std::exception_ptr e_ptr;
+    };
+    auto state = std::make_shared<State>();
+
+    auto run = [n, &fn](State &s) {
+        try {
+            for (size_t i = s.next++; i < n; i = s.next++) fn(i);
+        } catch (...) {
+            std::lock_guard lg(s.m);
+            if (!s.e_ptr) s.e_ptr = std::current_exception();
+            s.next = n;
+        }
+    };
+
+    /* the helpers starting once all the indices have been taken return without touching fn, which may be gone */
+    size_t num_helpers = std::min(n, queues_.size() + 1) - 1;
+    for (size_t h = 0; h < num_helpers; h++) {
+        submit(
+            [state, run, n]() {
+                {
+                    std::lock_guard lg(state->m);
+                    if (state->next >= n) return;
+                    state->running++;
+                }
+                run(*state);
+                std::lock_guard lg(state->m);
+                state->running--;
+                state->cv.notify_all();
+            },
+            priority);
+    }
+
+    run(*state);
+
+    std::unique_lock ul(state->m);
+    state->cv.wait(ul, [&state]() { return !state->running; });
+    if (state->e_ptr) std::rethrow_exception(state->e_ptr);
+}
+
+Executor::Task Executor::takeTask(const unsigned index) {
+    Task task;
+
+    {
+        std::lock_guard lg(m_);
+        if (!high_priority_tasks_.empty()) {
+            task = std::move(high_priority_tasks_.front());
+            high_priority_tasks_.pop_front();
+        }
+    }
+
+    if (!task) {
+        std::lock_guard lg(queues_[index]->m);
+        auto &tasks = queues_[index]->tasks;
+        if (!tasks.empty()) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        }
+    }
+
+    for (size_t i = 1; !task && i < queues_.size(); i++) {
+        auto &victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard lg(victim.m);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (task) {
+        std::lock_guard lg(m_);
+        pending_--;
+    }
+    return task;
+}
+
+void Executor::work(const unsigned index) {
+    current_executor = this;
+    current_index = index;
+    FlowTracer::setThreadName("worker " + std::to_string(index));
+
+    while (true) {
+        Task task = takeTask(index);
+        if (task) {
+            task();
+            continue;
+        }
+        std::unique_lock ul(m_);
+        cv_.wait(ul, [this]() { return (pending_ || stopped_); });
+        if (stopped_) break;
+    }
+}
+
+unsigned Executor::getNumWorkers() const { return static_cast<unsigned>(workers_.size()); }
+
+void Executor::setAffinity(const std::vector<int> &cores) {
+    std::vector<int> all_cores;
+    if (cores.empty()) {
+        for (unsigned i = 0; i < std::max(std::thread::hardware_concurrency(), 1u); i++) all_cores.push_back(i);
+    }
+    for (auto &worker : workers_) setThreadAffinity(worker.native_handle(), cores.empty() ? all_cores : cores);
+}
+
+Strand::Strand(Executor &executor, const Executor::Priority priority) : executor_(executor), priority_(priority) {}
+
+Strand::~Strand() { wait(); }
+
+void Strand::post(Executor::Task task) {
+    std::lock_guard lg(m_);
+    tasks_.push_back(std::move(task));
+    if (!running_) {
+        running_ = true;
+        executor_.submit([this]() { runNext(); }, priority_);
+    }
+}
+
+void Strand::runNext() {
+    Executor::Task task;
+    {
+        std::lock_guard lg(m_);
+        assert(running_ && !tasks_.empty());
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+    }
+    dequeued_cv_.notify_all();
+
+    task();
+
+    std::lock_guard lg(m_);
+    if (tasks_.empty()) {
+        running_ = false;
+        idle_cv_.notify_all();
+    } else {  // give the other strands a chance to run before continuing
+        executor_.submit([this]() { runNext(); }, priority_);
+    }
+}
+
+size_t Strand::getQueuedTasks() const {
+    std::lock_guard lg(m_);
+    return tasks_.size();
+}
+
+void Strand::waitQueuedBelow(const size_t max_queued) {
+    std::unique_lock ul(m_);
+    dequeued_cv_.wait(ul, [this, max_queued]() { return tasks_.size() < max_queued; });
+}
+
+void Strand::wait() {
+    std::unique_lock ul(m_);
+    idle_cv_.wait(ul, [this]() { return !running_; });
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A pool of worker threads executing tasks, shared by all the pipelines of the process so that the number of
+ * processing threads stays bounded by the number of cores.
+ * Each worker has its own queue of tasks (tasks submitted by a worker are pushed to its own queue), and idle workers
+ * steal tasks from the queues of the other ones. High-priority tasks are kept in a separate queue, always served
+ * first.
+ * WARNING: the tasks should never block waiting for I/O, since they would prevent other tasks from running
+ */
+class Executor {
+public:
+    enum Priority { Normal, High };
+    using Task = std::function<void()>;
+
+private:
+    struct WorkerQueue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<unsigned> next_queue_{};
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::deque<Task> high_priority_tasks_;
+    size_t pending_{};  // number of submitted tasks not yet taken by a worker
+    bool stopped_{};
+
+    /**
+     * Take the next task to run, giving precedence to the high-priority ones, then to the ones in the worker's
+     * own queue (newest first) and finally stealing from the other queues (oldest first)
+     * @param index the index of the worker looking for a task
+     * @return the task to run, empty if there is none
+     */
+    Task takeTask(unsigned index);
+
+    /**
+     * Main loop of a worker thread
+     * @param index the index of the worker
+     */
+    void work(unsigned index);
+
+public:
+    /**
+     * Create a new executor
+     * @param num_workers the number of worker threads (if 0, the number of available cores)
+     */
+    explicit Executor(unsigned num_workers = 0);
+
+    Executor(const Executor &) = delete;
+
+    ~Executor();
+
+    Executor &operator=(const Executor &) = delete;
+
+    /**
+     * Get the executor shared by the whole process, sized to the number of available cores
+     * @return the shared executor
+     */
+    static Executor &shared();
+
+    /**
+     * Submit a task for execution (the task must not throw exceptions)
+     * @param task      the task to run
+     * @param priority  the priority of the task
+     */
+    void submit(Task task, Priority priority = Normal);
+
+    /**
+     * Call a function for each index in [0, n), distributing the calls among the workers, and wait for all of them
+     * to complete. The calling thread takes part in the execution, so it's safe to call it from a task running on
+     * the executor. If any call throws, the first exception is re-thrown once all the calls have completed
+     * @param n         the number of indices
+     * @param fn        the function to call for each index
+     * @param priority  the priority of the tasks running the calls on the workers
+     */
+    void parallelFor(size_t n, const std::function<void(size_t)> &fn, Priority priority = Normal);
+
+    /**
+     * Get the number of worker threads
+     * @return the number of worker threads
+     */
+    [[nodiscard]] unsigned getNumWorkers() const;
+
+    /**
+     * Restrict the worker threads to the given cores (not supported on macOS)
+     * @param cores the indices of the cores (if empty, all the cores)
+     */
+    void setAffinity(const std::vector<int> &cores);
+};
+
+/**
+ * A serial queue of tasks running on an executor: the tasks posted to the same strand are executed one at a time,
+ * in the same order in which they were posted
+ */
+class Strand {
+    Executor &executor_;
+    const Executor::Priority priority_;
+
+    mutable std::mutex m_;
+    std::condition_variable idle_cv_;
+    std::condition_variable dequeued_cv_;
+    std::deque<Executor::Task> tasks_;
+    bool running_{};
+
+    /* Run the first queued task and re-schedule the strand if there are more */
+    void runNext();
+
+public:
+    /**
+     * Create a new strand
+     * @param executor  the executor on which the tasks will run
+     * @param priority  the priority of the tasks of the strand
+     */
+    explicit Strand(Executor &executor, Executor::Priority priority = Executor::Normal);
+
+    Strand(const Strand &) = delete;
+
+    /* Wait for the queued tasks to complete */
+    ~Strand();
+
+    Strand &operator=(const Strand &) = delete;
+
+    /**
+     * Post a task at the end of the queue (the task must not throw exceptions)
+     * @param task the task to run
+     */
+    void post(Executor::Task task);
+
+    /**
+     * Get the number of tasks waiting to be started
+     * @return the number of queued tasks (excluding the running one)
+     */
+    [[nodiscard]] size_t getQueuedTasks() const;
+
+    /**
+     * Wait until fewer than max_queued tasks are waiting to be started (e.g. to throttle a producer)
+     * @param max_queued the number of queued tasks to stay below
+     */
+    void waitQueuedBelow(size_t max_queued);
+
+    /**
+     * Wait until all the posted tasks have been completed
+     */
+    void wait();
+};
@@ -0,0 +1,179 @@
+#include "flow_tracer.h"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+static std::string errMsg(const std::string &msg) { return ("FlowTracer: " + msg); }
+
+namespace {
+
+struct Event {
+    const char *name;
+    const char *category;
+    int64_t start;
+    int64_t duration;
+    int64_t stream;
+    int64_t pts;
+    int64_t bytes;
+};
+
+/* The number of events each thread can record in a tracing session */
+constexpr size_t buffer_capacity = 1 << 15;
+
+/*
+ * The events of a thread, written only by the thread itself. The size is published with release semantics after
+ * writing each event, so that a dump can read the events completed so far while the thread keeps recording
+ */
+struct ThreadBuffer {
+    int tid = 0;
+    std::string name;  // guarded by registry_m
+    std::unique_ptr<Event[]> events{new Event[buffer_capacity]};
+    std::atomic<size_t> size{0};
+    std::atomic<size_t> dropped{0};
+    /* the tracing session the events belong to: the buffer is reset by its thread when a new one starts */
+    std::atomic<uint64_t> session{0};
+    /* whether the thread is still running (otherwise the buffer can be taken over by a new thread) */
+    std::atomic<bool> alive{true};
+};
+
+std::mutex registry_m;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+std::atomic<uint64_t> current_session{0};
+std::atomic<int64_t> session_start{0};
+
+/* The buffer of the current thread, assigned at its first event */
+struct ThreadHandle {
+    ThreadBuffer *buffer = nullptr;
+    std::string name;
+
+    ~ThreadHandle() {
+        if (buffer) buffer->alive.store(false, std::memory_order_release);
+    }
+};
+thread_local ThreadHandle thread_handle;
+
+ThreadBuffer *getThreadBuffer() {
+    if (thread_handle.buffer) return thread_handle.buffer;
+
+    std::lock_guard lg(registry_m);
+    const uint64_t session = current_session.load(std::memory_order_acquire);
+    ThreadBuffer *buffer = nullptr;
+    /* reuse the buffer of a terminated thread, unless its events are still part of the current trace */
+    for (auto &candidate : buffers) {
+        if (!candidate->alive.load(std::memory_order_acquire) && candidate->session.load() != session) {
+            buffer = candidate.get();
+            buffer->alive.store(true);
+            break;
+        }
+    }
+    if (!buffer) {
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->tid = static_cast<int>(buffers.size());
+    }
+    buffer->name = thread_handle.name.empty() ? "thread " + std::to_string(buffer->tid) : thread_handle.name;
+    thread_handle.buffer = buffer;
+    return buffer;
+}
+
+void writeEscaped(std::ostream &os, const std::string &str) {
+    for (char c : str) {
+        if (c == '"' || c == '\\') os << '\\';
+        os << c;
+    }
+}
+
+}  // namespace
+
+int64_t FlowTracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void FlowTracer::record(const char *name, const char *category, const int64_t start, const int64_t duration,
+                        const int64_t stream, const int64_t pts, const int64_t bytes) {
+    ThreadBuffer *buffer = getThreadBuffer();
+
+    const uint64_t session = current_session.load(std::memory_order_acquire);
+    if (buffer->session.load(std::memory_order_relaxed) != session) {
+        buffer->size.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->session.store(session, std::memory_order_release);
+    }
+
+    const size_t size = buffer->size.load(std::memory_order_relaxed);
+    if (size == buffer_capacity) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[size] = {name, category, start, duration, stream, pts, bytes};
+    buffer->size.store(size + 1, std::memory_order_release);
+}
+
+void FlowTracer::start() {
+    session_start.store(now(), std::memory_order_relaxed);
+    current_session.fetch_add(1, std::memory_order_acq_rel);
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void FlowTracer::stop() { enabled_.store(false, std::memory_order_relaxed); }
+
+void FlowTracer::setThreadName(const std::string &name) {
+    thread_handle.name = name;
+    if (thread_handle.buffer) {
+        std::lock_guard lg(registry_m);
+        thread_handle.buffer->name = name;
+    }
+}
+
+void FlowTracer::dump(const std::string &file) {
+    std::ofstream os(file);
+    if (!os) throw std::runtime_error(errMsg("failed to open file '" + file + "'"));
+
+    std::lock_guard lg(registry_m);
+    const uint64_t session = current_session.load(std::memory_order_acquire);
+    const int64_t origin = session_start.load(std::memory_order_relaxed);
+    size_t dropped = 0;
+    bool first = true;
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (auto &buffer : buffers) {
+        if (buffer->session.load(std::memory_order_acquire) != session) continue;
+        const size_t size = buffer->size.load(std::memory_order_acquire);
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+
+        os << (first ? "\n" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->tid
+           << R"(,"args":{"name":")";
+        writeEscaped(os, buffer->name);
+        os << "\"}}";
+        first = false;
+
+        for (size_t i = 0; i < size; i++) {
+            const Event &event = buffer->events[i];
+            /* the scopes begun before start() (e.g. by the workers still busy with the previous session) */
+            if (event.start < origin) continue;
+            /* the Trace Event Format timestamps are in microseconds */
+            os << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.category ? event.category : "other")
+               << R"(","ph":"X","pid":1,"tid":)" << buffer->tid << ",\"ts\":" << (event.start - origin) / 1000
+               << "." << (event.start - origin) % 1000 / 100 << ",\"dur\":" << event.duration / 1000 << "."
+               << event.duration % 1000 / 100 << ",\"args\":{";
+            const char *separator = "";
+            if (event.stream != unknown) {
+                os << "\"stream\":" << event.stream;
+                separator = ",";
+            }
+            if (event.pts != unknown) {
+                os << separator << "\"pts\":" << event.pts;
+                separator = ",";
+            }
+            if (event.bytes != unknown) os << separator << "\"bytes\":" << event.bytes;
+            os << "}}";
+        }
+    }
+    os << "\n],\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+    if (!os) throw std::runtime_error(errMsg("failed to write file '" + file + "'"));
+}
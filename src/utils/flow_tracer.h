@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+/**
+ * Process-wide tracing of the flow of the packets and frames through the processing stages, exported as a
+ * Chrome/Perfetto trace (https://ui.perfetto.dev or chrome://tracing).
+ * Each thread records its events into its own fixed-size buffer without any locking, and the events exceeding its
+ * capacity are dropped. While tracing is disabled, a traced scope costs a single branch.
+ */
+class FlowTracer {
+public:
+    /* Value of the event fields which aren't known (parenthesized against the min macro of <windows.h>) */
+    static constexpr int64_t unknown = (std::numeric_limits<int64_t>::min)();
+
+    /**
+     * A traced scope, recorded as a complete event (begin and duration) when it's destroyed
+     */
+    class Scope {
+        const char *name_;
+        const char *category_ = nullptr;
+        int64_t start_ = -1;
+        int64_t stream_ = unknown;
+        int64_t pts_ = unknown;
+        int64_t bytes_ = unknown;
+
+    public:
+        /**
+         * Begin a traced scope (only if tracing is enabled)
+         * @param name the name of the event, which must be a string literal
+         */
+        explicit Scope(const char *name) : name_(name) {
+            if (enabled()) start_ = now();
+        }
+
+        Scope(const Scope &) = delete;
+
+        ~Scope() {
+            if (start_ >= 0) record(name_, category_, start_, now() - start_, stream_, pts_, bytes_);
+        }
+
+        Scope &operator=(const Scope &) = delete;
+
+        /**
+         * Describe the data processed in the scope
+         * @param category  the media type of the data ("video" or "audio"), which must be a string literal
+         * @param stream    the index of the stream of the data (unknown if not known)
+         * @param pts       the timestamp of the data, in the time-base of its stream (unknown if not known)
+         * @param bytes     the size of the data (unknown if not known)
+         */
+        void setData(const char *category, int64_t stream, int64_t pts, int64_t bytes) {
+            if (start_ < 0) return;
+            category_ = category;
+            stream_ = stream;
+            pts_ = pts;
+            bytes_ = bytes;
+        }
+
+        /* Don't record the scope (e.g. because there was no data to process) */
+        void cancel() { start_ = -1; }
+    };
+
+private:
+    inline static std::atomic<bool> enabled_{false};
+
+    /* Get the time since the start of the tracing, in nanoseconds */
+    static int64_t now();
+
+    static void record(const char *name, const char *category, int64_t start, int64_t duration, int64_t stream,
+                       int64_t pts, int64_t bytes);
+
+public:
+    /**
+     * Whether tracing is enabled
+     * @return true if the traced scopes are being recorded
+     */
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * Discard the events recorded so far and start recording
+     */
+    static void start();
+
+    /**
+     * Stop recording (the events recorded so far can still be dumped)
+     */
+    static void stop();
+
+    /**
+     * Set the name of the current thread in the trace
+     * @param name the name of the thread
+     */
+    static void setThreadName(const std::string &name);
+
+    /**
+     * Write the events recorded since the last call to start() to a JSON file in the Trace Event Format. It can be
+     * called while recording, in which case the events completed so far are written
+     * @param file the name of the file
+     */
+    static void dump(const std::string &file);
+};
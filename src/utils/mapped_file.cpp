@@ -0,0 +1,67 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#if defined(WINDOWS)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::string errMsg(const std::string &msg) { return ("MappedFile: " + msg); }
+
+MappedFile::MappedFile(const std::string &filename) {
+#if defined(WINDOWS)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw std::runtime_error(errMsg("failed to open " + filename));
+    file_ = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        unmap();
+        throw std::runtime_error(errMsg("failed to get the size of " + filename));
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (!size_) return;
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_) data_ = static_cast<const uint8_t *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+        unmap();
+        throw std::runtime_error(errMsg("failed to map " + filename));
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error(errMsg("failed to open " + filename));
+    struct stat st {};
+    if (fstat(fd, &st)) {
+        close(fd);
+        throw std::runtime_error(errMsg("failed to get the size of " + filename));
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_) {
+        void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            data_ = static_cast<const uint8_t *>(data);
+            /* the file is (mostly) read once, from the beginning to the end */
+            madvise(data, size_, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);  // the mapping keeps the file referenced
+    if (size_ && !data_) throw std::runtime_error(errMsg("failed to map " + filename));
+#endif
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+void MappedFile::unmap() {
+#if defined(WINDOWS)
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+#else
+    if (data_) munmap(const_cast<uint8_t *>(data_), size_);
+#endif
+}
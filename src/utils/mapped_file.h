@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * A read-only file mapped in memory, so that its content can be accessed without copying it through the
+ * buffers of the standard library (the pages are loaded by the OS on demand)
+ */
+class MappedFile {
+    const uint8_t *data_{};
+    size_t size_{};
+#if defined(WINDOWS)
+    /* the handles of the file and of its mapping (the platform headers are kept out of this header) */
+    void *file_{};
+    void *mapping_{};
+#endif
+
+    void unmap();
+
+public:
+    /**
+     * Map a file in memory
+     * @param filename the name of the file to map
+     */
+    explicit MappedFile(const std::string &filename);
+
+    MappedFile(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    [[nodiscard]] const uint8_t *data() const { return data_; }
+
+    [[nodiscard]] size_t size() const { return size_; }
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * Lock-free ring buffer with a single producer and a single consumer thread, which can write/read blocks of
+ * elements without ever blocking each other.
+ * The capacity is rounded up to a power of two, so that the positions can be wrapped with a mask
+ */
+template <typename T>
+class RingBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "the elements of a RingBuffer must be trivially copyable");
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<T[]> data_;
+    /* the positions grow indefinitely (they are wrapped when accessing the data), on separate cache lines */
+    alignas(64) std::atomic<size_t> read_pos_{};
+    alignas(64) std::atomic<size_t> write_pos_{};
+
+    static size_t roundCapacity(size_t min_capacity) {
+        if (!min_capacity) throw std::invalid_argument("RingBuffer: the capacity must be positive");
+        size_t capacity = 1;
+        while (capacity < min_capacity) capacity <<= 1;
+        return capacity;
+    }
+
+    /* Call fn(offset, pos, count) on the (at most two) contiguous regions of n elements starting at pos */
+    template <typename Fn>
+    void forEachRegion(size_t pos, size_t n, Fn fn) const {
+        size_t start = pos & mask_;
+        size_t first = std::min(n, capacity_ - start);
+        fn(0, start, first);
+        if (first < n) fn(first, 0, n - first);
+    }
+
+public:
+    /**
+     * Create a new ring buffer
+     * @param min_capacity the minimum number of elements the buffer must be able to hold
+     */
+    explicit RingBuffer(size_t min_capacity)
+        : capacity_(roundCapacity(min_capacity)), mask_(capacity_ - 1), data_(new T[capacity_]) {}
+
+    RingBuffer(const RingBuffer &) = delete;
+
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    [[nodiscard]] size_t getCapacity() const { return capacity_; }
+
+    /**
+     * Get the number of elements available for reading (exact only if called by the consumer)
+     * @return the number of elements which can be read
+     */
+    [[nodiscard]] size_t size() const {
+        return write_pos_.load(std::memory_order_acquire) - read_pos_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Get the space available for writing (exact only if called by the producer)
+     * @return the number of elements which can be written
+     */
+    [[nodiscard]] size_t getFreeSpace() const { return capacity_ - size(); }
+
+    /**
+     * Write a block of elements (producer only)
+     * @param src   the elements to write, or nullptr to write value-initialized elements (e.g. zeros)
+     * @param n     the number of elements to write
+     * @return the number of elements written (less than n if there wasn't enough space)
+     */
+    size_t write(const T *src, size_t n) {
+        const size_t pos = write_pos_.load(std::memory_order_relaxed);
+        n = std::min(n, capacity_ - (pos - read_pos_.load(std::memory_order_acquire)));
+        forEachRegion(pos, n, [this, src](size_t offset, size_t start, size_t count) {
+            if (src) {
+                std::memcpy(data_.get() + start, src + offset, count * sizeof(T));
+            } else {
+                std::fill_n(data_.get() + start, count, T{});
+            }
+        });
+        write_pos_.store(pos + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Read a block of elements (consumer only)
+     * @param dst   where to copy the elements read, or nullptr to just discard them
+     * @param n     the number of elements to read
+     * @return the number of elements read (less than n if there weren't enough elements)
+     */
+    size_t read(T *dst, size_t n) {
+        const size_t pos = read_pos_.load(std::memory_order_relaxed);
+        n = std::min(n, write_pos_.load(std::memory_order_acquire) - pos);
+        if (dst) {
+            forEachRegion(pos, n, [this, dst](size_t offset, size_t start, size_t count) {
+                std::memcpy(dst + offset, data_.get() + start, count * sizeof(T));
+            });
+        }
+        read_pos_.store(pos + n, std::memory_order_release);
+        return n;
+    }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SAMPLE_CONVERSION_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SAMPLE_CONVERSION_NEON
+#endif
+
+/*
+ * Conversions of interleaved audio samples, vectorized for the common mono and stereo cases.
+ * The 16 bit integer samples are mapped to [-1.0, 1.0) dividing them by 32768, as done by libswresample
+ */
+
+namespace sample_conversion {
+
+constexpr float s16_scale = 1.0f / 32768.0f;
+
+/**
+ * Convert interleaved 16 bit integer samples to interleaved float samples (or mono to mono)
+ * @param src   the source samples
+ * @param dst   the destination samples
+ * @param n     the total number of samples (for all the channels)
+ */
+inline void s16ToFlt(const int16_t *src, float *dst, size_t n) {
+    size_t i = 0;
+#if defined(SAMPLE_CONVERSION_SSE2)
+    const __m128 scale = _mm_set1_ps(s16_scale);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        /* sign-extend to 32 bits by placing the samples in the high halves and shifting them back */
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(SAMPLE_CONVERSION_NEON)
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), s16_scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), s16_scale));
+    }
+#endif
+    for (; i < n; i++) dst[i] = static_cast<float>(src[i]) * s16_scale;
+}
+
+/**
+ * Convert interleaved 16 bit integer samples to planar float samples
+ * @param src           the source samples
+ * @param dst           the destination planes, one for each channel
+ * @param channels      the number of channels
+ * @param nb_samples    the number of samples per channel
+ */
+inline void s16ToFltp(const int16_t *src, float *const *dst, int channels, size_t nb_samples) {
+    if (channels == 1) {
+        s16ToFlt(src, dst[0], nb_samples);
+        return;
+    }
+
+    size_t i = 0;
+    if (channels == 2) {
+        float *left = dst[0];
+        float *right = dst[1];
+#if defined(SAMPLE_CONVERSION_SSE2)
+        const __m128 scale = _mm_set1_ps(s16_scale);
+        for (; i + 4 <= nb_samples; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));
+            __m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale);
+            __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale);
+            _mm_storeu_ps(left + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined(SAMPLE_CONVERSION_NEON)
+        for (; i + 4 <= nb_samples; i += 4) {
+            int16x4x2_t v = vld2_s16(src + 2 * i);
+            vst1q_f32(left + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(v.val[0])), s16_scale));
+            vst1q_f32(right + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(v.val[1])), s16_scale));
+        }
+#endif
+    }
+
+    for (; i < nb_samples; i++) {
+        for (int c = 0; c < channels; c++) dst[c][i] = static_cast<float>(src[i * channels + c]) * s16_scale;
+    }
+}
+
+/**
+ * Convert interleaved float samples to planar float samples
+ * @param src           the source samples
+ * @param dst           the destination planes, one for each channel
+ * @param channels      the number of channels
+ * @param nb_samples    the number of samples per channel
+ */
+inline void fltToFltp(const float *src, float *const *dst, int channels, size_t nb_samples) {
+    size_t i = 0;
+    if (channels == 2) {
+        float *left = dst[0];
+        float *right = dst[1];
+#if defined(SAMPLE_CONVERSION_SSE2)
+        for (; i + 4 <= nb_samples; i += 4) {
+            __m128 lo = _mm_loadu_ps(src + 2 * i);
+            __m128 hi = _mm_loadu_ps(src + 2 * i + 4);
+            _mm_storeu_ps(left + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined(SAMPLE_CONVERSION_NEON)
+        for (; i + 4 <= nb_samples; i += 4) {
+            float32x4x2_t v = vld2q_f32(src + 2 * i);
+            vst1q_f32(left + i, v.val[0]);
+            vst1q_f32(right + i, v.val[1]);
+        }
+#endif
+    }
+
+    for (; i < nb_samples; i++) {
+        for (int c = 0; c < channels; c++) dst[c][i] = src[i * channels + c];
+    }
+}
+
+}  // namespace sample_conversion
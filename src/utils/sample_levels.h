@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SAMPLE_LEVELS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SAMPLE_LEVELS_NEON
+#endif
+
+/*
+ * Levels of float audio samples (a plane of a planar frame, or all the channels of a packed one),
+ * vectorized 4 samples at a time
+ */
+
+namespace sample_levels {
+
+/* The peak and the energy of a block of samples */
+struct Levels {
+    float peak = 0;
+    float sum_squares = 0;
+};
+
+/**
+ * Accumulate the levels of a block of samples
+ * @param samples   the samples
+ * @param n         the number of samples
+ * @param levels    updated with the maximum absolute value and the sum of the squares of the samples
+ */
+inline void accumulate(const float *samples, const size_t n, Levels &levels) {
+    size_t i = 0;
+#if defined(SAMPLE_LEVELS_SSE2)
+    /* the absolute value clears the sign bit */
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_setzero_ps();
+    __m128 sum = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(samples + i);
+        peak = _mm_max_ps(peak, _mm_and_ps(v, abs_mask));
+        sum = _mm_add_ps(sum, _mm_mul_ps(v, v));
+    }
+    alignas(16) float peaks[4];
+    alignas(16) float sums[4];
+    _mm_store_ps(peaks, peak);
+    _mm_store_ps(sums, sum);
+    for (int k = 0; k < 4; k++) {
+        levels.peak = std::fmax(levels.peak, peaks[k]);
+        levels.sum_squares += sums[k];
+    }
+#elif defined(SAMPLE_LEVELS_NEON)
+    float32x4_t peak = vdupq_n_f32(0);
+    float32x4_t sum = vdupq_n_f32(0);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(samples + i);
+        peak = vmaxq_f32(peak, vabsq_f32(v));
+        sum = vmlaq_f32(sum, v, v);
+    }
+    for (int k = 0; k < 4; k++) {
+        levels.peak = std::fmax(levels.peak, vgetq_lane_f32(peak, 0));
+        levels.sum_squares += vgetq_lane_f32(sum, 0);
+        peak = vextq_f32(peak, peak, 1);
+        sum = vextq_f32(sum, sum, 1);
+    }
+#endif
+    for (; i < n; i++) {
+        levels.peak = std::fmax(levels.peak, std::fabs(samples[i]));
+        levels.sum_squares += samples[i] * samples[i];
+    }
+}
+
+}  // namespace sample_levels
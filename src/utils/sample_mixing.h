@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SAMPLE_MIXING_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SAMPLE_MIXING_NEON
+#endif
+
+/*
+ * Mixing of float audio samples (a single plane of a planar frame), vectorized 4 samples at a time.
+ * The samples are in [-1.0, 1.0], as produced by libswresample
+ */
+
+namespace sample_mixing {
+
+/**
+ * Add the samples of a source, multiplied by its gain, to the mixed ones
+ * @param src   the source samples
+ * @param dst   the mixed samples
+ * @param gain  the gain of the source
+ * @param n     the number of samples
+ */
+inline void mixAdd(const float *src, float *dst, const float gain, const size_t n) {
+    size_t i = 0;
+#if defined(SAMPLE_MIXING_SSE2)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+#elif defined(SAMPLE_MIXING_NEON)
+    for (; i + 4 <= n; i += 4) vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+#endif
+    for (; i < n; i++) dst[i] += src[i] * gain;
+}
+
+/**
+ * Clamp the mixed samples to [-1.0, 1.0], so that the encoder never receives out-of-range samples
+ * @param samples   the samples to clamp
+ * @param n         the number of samples
+ * @return the number of samples which were out of range
+ */
+inline size_t clip(float *samples, const size_t n) {
+    size_t clipped = 0;
+    size_t i = 0;
+#if defined(SAMPLE_MIXING_SSE2)
+    const __m128 max = _mm_set1_ps(1.0f);
+    const __m128 min = _mm_set1_ps(-1.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(samples + i);
+        __m128 out = _mm_or_ps(_mm_cmpgt_ps(v, max), _mm_cmplt_ps(v, min));
+        int mask = _mm_movemask_ps(out);
+        if (mask) {
+            clipped += static_cast<size_t>((mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + (mask >> 3));
+            _mm_storeu_ps(samples + i, _mm_max_ps(_mm_min_ps(v, max), min));
+        }
+    }
+#elif defined(SAMPLE_MIXING_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(samples + i);
+        /* |v| > 1, as 1 for each lane out of range */
+        uint64x2_t out = vpaddlq_u32(vshrq_n_u32(vcagtq_f32(v, vdupq_n_f32(1.0f)), 31));
+        uint64_t count = vgetq_lane_u64(out, 0) + vgetq_lane_u64(out, 1);
+        if (count) {
+            clipped += count;
+            vst1q_f32(samples + i, vmaxq_f32(vminq_f32(v, vdupq_n_f32(1.0f)), vdupq_n_f32(-1.0f)));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (samples[i] > 1.0f) {
+            samples[i] = 1.0f;
+            clipped++;
+        } else if (samples[i] < -1.0f) {
+            samples[i] = -1.0f;
+            clipped++;
+        }
+    }
+    return clipped;
+}
+
+}  // namespace sample_mixing
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#if defined(WINDOWS)
+/* the min and max macros of <windows.h> would break std::min and std::max in the including files */
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#if defined(__MINGW32__)
+#include <pthread.h>
+#endif
+#elif defined(LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else  // macOS
+#include <pthread.h>
+#endif
+
+/**
+ * Lower the scheduling priority of the calling thread as much as possible, so that it will
+ * (mostly) run on otherwise idle CPU time
+ */
+inline void setIdlePriority() {
+#if defined(WINDOWS)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#elif defined(LINUX)
+    /* on Linux the nice value is a per-thread attribute */
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#else  // macOS
+    pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+#endif
+}
+
+/**
+ * Raise the scheduling priority of the calling thread, so that it isn't starved by the other threads of the
+ * system. This usually requires some privileges (e.g. CAP_SYS_NICE on Linux)
+ * @param real_time true to use the real-time (FIFO) scheduling, false to only lower the nice value
+ * @return true if the priority has been changed
+ */
+inline bool setHighPriority(const bool real_time) {
+#if defined(WINDOWS)
+    return SetThreadPriority(GetCurrentThread(), real_time ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST);
+#elif defined(LINUX)
+    if (real_time) {
+        /* a low real-time priority is enough to preempt all the normal threads */
+        sched_param param{};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+        return !pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+    return !setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), -10);
+#else  // macOS: no real-time scheduling without a thread time constraint policy, use the highest QoS class
+    return !pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+#endif
+}
+
+#if defined(WINDOWS)
+using CpuSet = DWORD_PTR;
+#elif defined(LINUX)
+using CpuSet = cpu_set_t;
+#else  // macOS: the affinity can't be set
+using CpuSet = int;
+#endif
+
+/**
+ * Build the set of CPUs with the given indices
+ * @param cores the indices of the cores
+ * @return the set of CPUs
+ */
+inline CpuSet makeCpuSet(const std::vector<int> &cores) {
+    CpuSet set{};
+#if defined(WINDOWS)
+    for (int core : cores) {
+        if (core >= 0 && core < static_cast<int>(8 * sizeof(DWORD_PTR))) set |= static_cast<DWORD_PTR>(1) << core;
+    }
+#elif defined(LINUX)
+    CPU_ZERO(&set);
+    for (int core : cores) {
+        if (core >= 0 && core < CPU_SETSIZE) CPU_SET(core, &set);
+    }
+#endif
+    return set;
+}
+
+#if defined(WINDOWS)
+/**
+ * Restrict a Win32 thread to run on the given cores
+ * @param thread    the Win32 handle of the thread
+ * @param cores     the indices of the cores on which the thread may run
+ * @return true if the affinity has been changed
+ */
+inline bool setWin32ThreadAffinity(HANDLE thread, const std::vector<int> &cores) {
+    if (cores.empty()) return false;
+    CpuSet set = makeCpuSet(cores);
+    return set && SetThreadAffinityMask(thread, set);
+}
+#endif
+
+/**
+ * Restrict a thread to run on the given cores (not supported on macOS)
+ * @param thread    the native handle of the thread
+ * @param cores     the indices of the cores on which the thread may run
+ * @return true if the affinity has been changed
+ */
+inline bool setThreadAffinity(std::thread::native_handle_type thread, const std::vector<int> &cores) {
+#if defined(WINDOWS) && defined(__MINGW32__)
+    /* the MinGW threads are winpthreads ones, their native handle is not a Win32 handle */
+    return setWin32ThreadAffinity(pthread_gethandle(thread), cores);
+#elif defined(WINDOWS)
+    return setWin32ThreadAffinity(reinterpret_cast<HANDLE>(thread), cores);
+#elif defined(LINUX)
+    if (cores.empty()) return false;
+    CpuSet set = makeCpuSet(cores);
+    return CPU_COUNT(&set) && !pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+    return false;
+#endif
+}
+
+/**
+ * Restrict the calling thread to run on the given cores (not supported on macOS)
+ * @param cores the indices of the cores on which the thread may run
+ * @return true if the affinity has been changed
+ */
+inline bool setThreadAffinity(const std::vector<int> &cores) {
+#if defined(WINDOWS)
+    return setWin32ThreadAffinity(GetCurrentThread(), cores);
+#else
+    return setThreadAffinity(pthread_self(), cores);
+#endif
+}
+
+/**
+ * Restrict the calling thread to the given cores for the lifetime of the object, restoring its original affinity
+ * afterwards. The threads started meanwhile (e.g. the ones of a codec being opened) inherit the restricted
+ * affinity
+ */
+class ScopedThreadAffinity {
+    bool changed_{};
+    CpuSet original_{};
+
+public:
+    /**
+     * Restrict the affinity of the calling thread
+     * @param cores the indices of the cores (if empty, the affinity isn't changed)
+     */
+    explicit ScopedThreadAffinity(const std::vector<int> &cores) {
+        if (cores.empty()) return;
+#if defined(WINDOWS)
+        CpuSet set = makeCpuSet(cores);
+        if (set) original_ = SetThreadAffinityMask(GetCurrentThread(), set);
+        changed_ = original_;
+#elif defined(LINUX)
+        if (pthread_getaffinity_np(pthread_self(), sizeof(original_), &original_)) return;
+        changed_ = setThreadAffinity(cores);
+#endif
+    }
+
+    ScopedThreadAffinity(const ScopedThreadAffinity &) = delete;
+
+    ~ScopedThreadAffinity() {
+        if (!changed_) return;
+#if defined(WINDOWS)
+        SetThreadAffinityMask(GetCurrentThread(), original_);
+#elif defined(LINUX)
+        pthread_setaffinity_np(pthread_self(), sizeof(original_), &original_);
+#endif
+    }
+
+    ScopedThreadAffinity &operator=(const ScopedThreadAffinity &) = delete;
+};
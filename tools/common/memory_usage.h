@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/* The resident memory of the process, in KiB (Linux only, 0 elsewhere) */
+struct MemoryUsage {
+    int64_t rss = 0;
+    /* the peak since the start of the process or the last call to resetPeakMemoryUsage() */
+    int64_t peak_rss = 0;
+};
+
+/**
+ * Read the resident memory of the process from /proc/self/status
+ * @return the current and peak resident memory
+ */
+inline MemoryUsage getMemoryUsage() {
+    MemoryUsage usage;
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) usage.rss = std::stoll(line.substr(6));
+        if (line.rfind("VmHWM:", 0) == 0) usage.peak_rss = std::stoll(line.substr(6));
+    }
+    return usage;
+}
+
+/**
+ * Reset the peak resident memory to the current one (Linux 4.0+)
+ * @return true if it has been reset, false otherwise
+ */
+inline bool resetPeakMemoryUsage() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    return static_cast<bool>(clear_refs.flush());
+}
+
+/**
+ * Get the memory allocated on the heap and still in use (including the allocations of the libav libraries and of
+ * the codecs), which unlike the resident memory isn't affected by the fragmentation
+ * @return the heap memory in use in KiB, -1 if unknown (glibc only)
+ */
+inline int64_t getHeapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    const struct mallinfo2 info = mallinfo2();
+    return static_cast<int64_t>((info.uordblks + info.hblkhd) / 1024);
+#elif defined(__GLIBC__)
+    const struct mallinfo info = mallinfo();
+    return (static_cast<int64_t>(static_cast<unsigned>(info.uordblks)) + static_cast<unsigned>(info.hblkhd)) / 1024;
+#else
+    return -1;
+#endif
+}
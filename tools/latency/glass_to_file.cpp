@@ -0,0 +1,326 @@
+/*
+ * Glass-to-file latency harness (Linux only, meant to be run under Xvfb):
+ *
+ *     xvfb-run -s "-screen 0 640x480x24" ./glass_to_file -d 20 -r 30
+ *
+ * A window in the top-left corner of the display shows a frame counter encoded as black/white cells, changed at
+ * known times while the area is recorded through Capturer. The recorded file is then decoded, and the counter read
+ * back from each frame, to get the latency of each displayed frame across the stages of the recording:
+ *  - glass -> capture: from the counter being drawn to the capture timestamp of the first frame showing it
+ *  - capture -> file:  from the capture timestamp to the packet being written to the output file (decoding,
+ *                      conversion, encoding and interleaving)
+ *  - glass -> file:    the sum of the two
+ */
+
+#include <libcapture/capturer.h>
+#include <libcapture/video_parameters.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "format/demuxer.h"
+#include "process/decoder.h"
+
+/* included last, since Xlib defines macros (e.g. None) clashing with the library names */
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+/* The counter is drawn as a row of cells, one per bit (white = 1), above a row with the complementary pattern */
+constexpr int counter_bits = 16;
+constexpr int cell_size = 32;
+constexpr int pattern_width = counter_bits * cell_size;
+constexpr int pattern_height = 2 * cell_size;
+
+struct Options {
+    int duration = 10;
+    int framerate = 30;
+    /* How many times per second the counter is changed (lower than the framerate, so that each value is grabbed) */
+    int draw_rate = 10;
+    std::string output_file = "glass_to_file.mp4";
+    std::string csv_file;
+    bool verbose = false;
+};
+
+/* The stages of a recorded frame, as microseconds since the epoch (the clock of the X11 grabber timestamps) */
+struct FrameTimes {
+    int64_t drawn;
+    int64_t captured;
+    int64_t written;
+};
+
+static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+static Options parseArgs(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-v") {
+            options.verbose = true;
+            continue;
+        }
+        if (i + 1 == argc) throw std::runtime_error("Wrong arguments");
+        std::string value(argv[++i]);
+        if (arg == "-d") {
+            options.duration = std::stoi(value);
+        } else if (arg == "-r") {
+            options.framerate = std::stoi(value);
+        } else if (arg == "-u") {
+            options.draw_rate = std::stoi(value);
+        } else if (arg == "-o") {
+            options.output_file = value;
+        } else if (arg == "-c") {
+            options.csv_file = value;
+        } else {
+            throw std::runtime_error("Unknown arg: " + arg);
+        }
+    }
+    if (options.duration <= 0 || options.framerate <= 0 || options.draw_rate <= 0)
+        throw std::runtime_error("Wrong arguments");
+    if (options.draw_rate > options.framerate) throw std::runtime_error("The draw rate can't exceed the framerate");
+    return options;
+}
+
+/* A borderless window showing the counter pattern at the origin of the display */
+class PatternWindow {
+    Display *display_;
+    Window window_;
+    GC gc_;
+
+public:
+    PatternWindow() {
+        display_ = XOpenDisplay(nullptr);
+        if (!display_) throw std::runtime_error("Cannot open the display (is DISPLAY set to an Xvfb server?)");
+
+        const int screen = DefaultScreen(display_);
+        XSetWindowAttributes attributes;
+        attributes.override_redirect = True;  // placed exactly at the origin, even with a window manager
+        attributes.background_pixel = BlackPixel(display_, screen);
+        window_ = XCreateWindow(display_, RootWindow(display_, screen), 0, 0, pattern_width, pattern_height, 0,
+                                CopyFromParent, InputOutput, CopyFromParent, CWOverrideRedirect | CWBackPixel,
+                                &attributes);
+        gc_ = XCreateGC(display_, window_, 0, nullptr);
+        XMapRaised(display_, window_);
+        XSync(display_, False);
+    }
+
+    PatternWindow(const PatternWindow &) = delete;
+
+    ~PatternWindow() {
+        XFreeGC(display_, gc_);
+        XDestroyWindow(display_, window_);
+        XCloseDisplay(display_);
+    }
+
+    PatternWindow &operator=(const PatternWindow &) = delete;
+
+    [[nodiscard]] std::string getDeviceName() const { return DisplayString(display_); }
+
+    /**
+     * Draw a counter value, returning only once the X server has executed the drawing
+     * @param counter the value to draw
+     * @return the time at which the value is on screen
+     */
+    int64_t draw(const unsigned counter) {
+        const int screen = DefaultScreen(display_);
+        for (int bit = 0; bit < counter_bits; bit++) {
+            const bool set = counter & (1u << bit);
+            XSetForeground(display_, gc_, set ? WhitePixel(display_, screen) : BlackPixel(display_, screen));
+            XFillRectangle(display_, window_, gc_, bit * cell_size, 0, cell_size, cell_size);
+            XSetForeground(display_, gc_, set ? BlackPixel(display_, screen) : WhitePixel(display_, screen));
+            XFillRectangle(display_, window_, gc_, bit * cell_size, cell_size, cell_size, cell_size);
+        }
+        XSync(display_, False);
+        return now();
+    }
+};
+
+/**
+ * Read the counter drawn in a decoded frame
+ * @param frame the frame, in a planar YUV format (as encoded by the recorder)
+ * @return the counter, -1 if the pattern is not readable (e.g. the frame was grabbed while drawing it)
+ */
+static int readCounter(const AVFrame *frame) {
+    if (frame->width < pattern_width || frame->height < pattern_height) return -1;
+
+    const uint8_t *top_row = frame->data[0] + (cell_size / 2) * frame->linesize[0];
+    const uint8_t *bottom_row = frame->data[0] + (cell_size + cell_size / 2) * frame->linesize[0];
+    int counter = 0;
+    for (int bit = 0; bit < counter_bits; bit++) {
+        const int x = bit * cell_size + cell_size / 2;
+        /* the two rows must be clearly complementary */
+        if (std::abs(top_row[x] - bottom_row[x]) < 96) return -1;
+        if (top_row[x] > bottom_row[x]) counter |= 1 << bit;
+    }
+    return counter;
+}
+
+/* Decode the recorded video and read the counter from each frame, in presentation order */
+static std::vector<int> readCounters(const std::string &file) {
+    Demuxer demuxer(file);
+    demuxer.openInput();
+    if (!demuxer.hasStream(av::MediaType::Video)) throw std::runtime_error("The recording has no video stream");
+    Decoder decoder(demuxer.getStreamParams(av::MediaType::Video));
+
+    std::map<int64_t, int> counters;  // by presentation timestamp
+    auto receiveFrames = [&]() {
+        while (auto frame = decoder.getFrame()) counters[frame->best_effort_timestamp] = readCounter(frame.get());
+    };
+    while (true) {
+        auto [packet, packet_type] = demuxer.readPacket();
+        if (!packet) {
+            if (demuxer.reachedEof()) break;
+            continue;
+        }
+        if (packet_type != av::MediaType::Video) continue;
+        while (!decoder.sendPacket(packet.get())) receiveFrames();
+        receiveFrames();
+    }
+    decoder.sendPacket(nullptr);
+    receiveFrames();
+
+    std::vector<int> result;
+    for (auto &[pts, counter] : counters) result.push_back(counter);
+    return result;
+}
+
+static void printDistribution(const std::string &name, std::vector<double> values) {
+    if (values.empty()) return;
+    std::sort(values.begin(), values.end());
+    auto percentile = [&values](const double p) {
+        return values[std::min(values.size() - 1, static_cast<size_t>(p * static_cast<double>(values.size())))];
+    };
+    double mean = 0;
+    for (double value : values) mean += value / static_cast<double>(values.size());
+    std::cout << name << " [ms]: min " << values.front() << ", p50 " << percentile(0.5) << ", p90 "
+              << percentile(0.9) << ", p99 " << percentile(0.99) << ", max " << values.back() << ", mean " << mean
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parseArgs(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << std::endl;
+        std::cerr << "\t[-d <duration_s>]" << std::endl;
+        std::cerr << "\t[-r <framerate>]" << std::endl;
+        std::cerr << "\t[-u <counter_updates_per_s>]" << std::endl;
+        std::cerr << "\t[-o <output_file>]" << std::endl;
+        std::cerr << "\t[-c <per_frame_csv_file>]" << std::endl;
+        std::cerr << "\t[-v]" << std::endl;
+        return 1;
+    }
+
+    try {
+        PatternWindow window;
+
+        /* the capture timestamps of the written video packets, with their write time */
+        std::mutex m;
+        std::vector<std::pair<int64_t, int64_t>> written;
+        Capturer capturer(options.verbose);
+        capturer.setWriteCallback([&m, &written](const bool video, const int64_t timestamp) {
+            if (!video) return;
+            const int64_t time = now();
+            std::lock_guard lg(m);
+            written.emplace_back(timestamp, time);
+        });
+
+        VideoParameters video_params;
+        video_params.setVideoSize(pattern_width, pattern_height);
+        video_params.setVideoOffset(0, 0);
+        video_params.setFramerate(options.framerate);
+
+        std::vector<int64_t> drawn;  // the time each counter value appeared on screen
+        drawn.push_back(window.draw(0));
+        auto future = capturer.start(window.getDeviceName(), "", options.output_file, video_params);
+
+        const auto period = std::chrono::microseconds(1000000 / options.draw_rate);
+        auto next = std::chrono::steady_clock::now() + period;
+        const int updates = options.duration * options.draw_rate;
+        for (int i = 1; i <= updates && i < (1 << counter_bits); i++) {
+            std::this_thread::sleep_until(next);
+            next += period;
+            drawn.push_back(window.draw(i));
+        }
+        /* leave the last value on screen long enough to be grabbed */
+        std::this_thread::sleep_until(next);
+        capturer.stop();
+        future.get();
+
+        std::vector<int> counters = readCounters(options.output_file);
+        std::sort(written.begin(), written.end());
+        if (counters.size() != written.size()) {
+            std::cerr << "WARNING: " << counters.size() << " frames decoded, " << written.size()
+                      << " packets written" << std::endl;
+        }
+
+        std::ofstream csv;
+        if (!options.csv_file.empty()) {
+            csv.open(options.csv_file);
+            csv << "counter,drawn_us,captured_us,written_us" << std::endl;
+        }
+        std::vector<FrameTimes> frames;
+        int last_counter = -1;
+        int unreadable = 0;
+        for (size_t i = 0; i < std::min(counters.size(), written.size()); i++) {
+            const int counter = counters[i];
+            if (counter < 0) {
+                unreadable++;
+                continue;
+            }
+            /* only the first frame showing a value measures its latency, the next ones just repeat it */
+            if (counter == last_counter || counter >= static_cast<int>(drawn.size())) continue;
+            last_counter = counter;
+            frames.push_back({drawn[counter], written[i].first, written[i].second});
+            if (csv.is_open()) {
+                csv << counter << "," << drawn[counter] << "," << written[i].first << "," << written[i].second
+                    << std::endl;
+            }
+        }
+
+        /* a value can't be grabbed before being drawn, nor written before being grabbed (up to the clock jitter) */
+        const auto insane = std::count_if(frames.begin(), frames.end(), [](const FrameTimes &frame) {
+            return frame.captured < frame.drawn - 1000 || frame.written < frame.captured - 1000 ||
+                   frame.written - frame.drawn > 10000000;
+        });
+        if (insane) {
+            std::cerr << "WARNING: " << insane << " of " << frames.size()
+                      << " frames with timestamps out of order (is the grabber timestamping on the system clock?)"
+                      << std::endl;
+        }
+
+        std::vector<double> to_capture;
+        std::vector<double> to_file;
+        std::vector<double> total;
+        for (auto &frame : frames) {
+            to_capture.push_back(static_cast<double>(frame.captured - frame.drawn) / 1000);
+            to_file.push_back(static_cast<double>(frame.written - frame.captured) / 1000);
+            total.push_back(static_cast<double>(frame.written - frame.drawn) / 1000);
+        }
+        std::cout << frames.size() << " of " << drawn.size() << " counter values measured (" << counters.size()
+                  << " frames, " << unreadable << " unreadable)" << std::endl;
+        printDistribution("glass -> capture", to_capture);
+        printDistribution("capture -> file", to_file);
+        printDistribution("glass -> file", total);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * Performance regression gate: pushes fixed synthetic workloads (lavfi test pattern plus a sine tone) through
+ * Pipeline as fast as possible, and compares the throughput, the frame latency and the peak memory with the
+ * thresholds stored for the machine. It needs neither a display nor audio devices:
+ *
+ *     ./perf_gate -o results.json
+ *
+ * Exit status: 0 if all the workloads are within the thresholds, 1 if any regressed, 2 on errors, 3 if there are
+ * no thresholds for the machine (reported as skipped by ctest).
+ * The thresholds are read from tools/perf/thresholds.txt unless another file is given with -t. Run it with -u on
+ * the reference machine to store its thresholds (the measured values with a margin).
+ */
+
+#include <libcapture/encoder_parameters.h>
+#include <libcapture/video_parameters.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../common/memory_usage.h"
+#include "format/demuxer.h"
+#include "pipeline/encoder_options.h"
+#include "pipeline/pipeline.h"
+
+struct Workload {
+    std::string name;
+    int width;
+    int height;
+    int framerate;
+};
+
+const std::vector<Workload> workloads = {{"1080p60", 1920, 1080, 60}, {"4k30", 3840, 2160, 30}};
+
+struct Thresholds {
+    double min_fps;
+    double max_p99_latency_ms;
+    double max_peak_rss_mb;
+};
+
+struct Result {
+    std::string workload;
+    int64_t frames = 0;
+    double seconds = 0;
+    double fps = 0;
+    double p50_latency_ms = 0;
+    double p99_latency_ms = 0;
+    double peak_rss_mb = 0;
+    bool passed = true;
+};
+
+struct Options {
+    int duration = 10;
+    /* the packets queued for each stream ahead of the processing */
+    size_t read_ahead = 2;
+    std::string thresholds_file = PERF_GATE_THRESHOLDS;
+    std::string results_file = "perf_results.json";
+    std::string workload;
+    bool update_thresholds = false;
+};
+
+/* The exit status when the thresholds file doesn't exist, i.e. the gate hasn't been set up on the machine */
+constexpr int no_thresholds_status = 3;
+
+/* The margin applied to the measured values when storing them as thresholds */
+constexpr double threshold_margin = 0.2;
+
+static Options parseArgs(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-u") {
+            options.update_thresholds = true;
+            continue;
+        }
+        if (i + 1 == argc) throw std::runtime_error("Wrong arguments");
+        std::string value(argv[++i]);
+        if (arg == "-d") {
+            options.duration = std::stoi(value);
+        } else if (arg == "-q") {
+            options.read_ahead = std::stoul(value);
+        } else if (arg == "-t") {
+            options.thresholds_file = value;
+        } else if (arg == "-o") {
+            options.results_file = value;
+        } else if (arg == "-w") {
+            options.workload = value;
+        } else {
+            throw std::runtime_error("Unknown arg: " + arg);
+        }
+    }
+    if (options.duration <= 0 || !options.read_ahead) throw std::runtime_error("Wrong arguments");
+    return options;
+}
+
+/* Read the thresholds, one workload per line: <name> <min_fps> <max_p99_latency_ms> <max_peak_rss_mb> */
+static std::map<std::string, Thresholds> readThresholds(const std::string &file) {
+    std::ifstream is(file);
+    if (!is) throw std::runtime_error("Cannot open the thresholds file '" + file + "'");
+    std::map<std::string, Thresholds> thresholds;
+    std::string line;
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::string name;
+        Thresholds t{};
+        if (!(ss >> name >> t.min_fps >> t.max_p99_latency_ms >> t.max_peak_rss_mb))
+            throw std::runtime_error("Wrong line in the thresholds file: " + line);
+        thresholds[name] = t;
+    }
+    return thresholds;
+}
+
+static void writeThresholds(const std::string &file, const std::vector<Result> &results) {
+    std::ofstream os(file);
+    if (!os) throw std::runtime_error("Cannot write the thresholds file '" + file + "'");
+    os << "# <workload> <min_fps> <max_p99_latency_ms> <max_peak_rss_mb>" << std::endl;
+    for (auto &result : results) {
+        os << result.workload << " " << result.fps * (1 - threshold_margin) << " "
+           << result.p99_latency_ms * (1 + threshold_margin) << " " << result.peak_rss_mb * (1 + threshold_margin)
+           << std::endl;
+    }
+}
+
+static void writeResults(const std::string &file, const std::vector<Result> &results) {
+    std::ofstream os(file);
+    if (!os) throw std::runtime_error("Cannot write the results file '" + file + "'");
+    os << "{\"timestamp\":" << std::time(nullptr) << ",\"results\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        os << (i ? ",\n" : "\n") << "{\"workload\":\"" << r.workload << "\",\"frames\":" << r.frames
+           << ",\"seconds\":" << r.seconds << ",\"fps\":" << r.fps << ",\"p50_latency_ms\":" << r.p50_latency_ms
+           << ",\"p99_latency_ms\":" << r.p99_latency_ms << ",\"peak_rss_mb\":" << r.peak_rss_mb
+           << ",\"passed\":" << (r.passed ? "true" : "false") << "}";
+    }
+    os << "\n]}" << std::endl;
+}
+
+static double percentile(std::vector<double> values, const double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * static_cast<double>(values.size())))];
+}
+
+static Result run(const Workload &workload, const Options &options) {
+    const std::string duration = std::to_string(options.duration);
+    std::ostringstream graph;
+    graph << "testsrc2=size=" << workload.width << "x" << workload.height << ":rate=" << workload.framerate
+          << ":duration=" << duration << "[out0];sine=frequency=1000:sample_rate=48000:duration=" << duration
+          << "[out1]";
+    Demuxer demuxer("lavfi", graph.str(), {});
+    demuxer.openInput();
+
+    const std::string output_file =
+        (std::filesystem::temp_directory_path() / ("perf_gate_" + workload.name + ".mp4")).string();
+    resetPeakMemoryUsage();
+
+    /* the same encoding as while recording, on the shared executor as for the real-time pipelines */
+    Pipeline pipeline(output_file, true);
+    pipeline.setBackpressure(options.read_ahead);
+    std::map<std::string, std::string> enc_options = getH264EncoderOptions(EncoderParameters());
+    enc_options.insert({"preset", "ultrafast"});
+    const int video_stream =
+        pipeline.initVideo(demuxer, AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P, VideoParameters(), enc_options);
+    const int audio_stream = pipeline.initAudio(demuxer, AV_CODEC_ID_AAC, std::map<std::string, std::string>());
+
+    /* the time each video frame was fed and written, by timestamp */
+    using Clock = std::chrono::steady_clock;
+    std::mutex m;
+    std::map<int64_t, Clock::time_point> fed;
+    std::vector<double> latencies;
+    const int64_t frame_duration = AV_TIME_BASE / workload.framerate;
+    pipeline.setWriteCallback([&](const av::MediaType type, const int64_t pts) {
+        if (type != av::MediaType::Video) return;
+        const auto now = Clock::now();
+        std::lock_guard lg(m);
+        /* the encoder may round the timestamps differently, hence look for the closest fed frame */
+        auto it = fed.lower_bound(pts - frame_duration / 2);
+        if (it == fed.end() || it->first > pts + frame_duration / 2) return;
+        latencies.push_back(std::chrono::duration<double, std::milli>(now - it->second).count());
+        fed.erase(it);
+    });
+    pipeline.initOutput();
+
+    const AVRational video_time_base = demuxer.getStreamTimeBase(av::MediaType::Video);
+    const auto start = Clock::now();
+    while (true) {
+        auto [packet, packet_type] = demuxer.readPacket();
+        if (!packet) {
+            if (demuxer.reachedEof()) break;
+            continue;
+        }
+        if (packet_type == av::MediaType::Video) {
+            const int64_t pts = av_rescale_q(packet->pts, video_time_base, AV_TIME_BASE_Q);
+            std::lock_guard lg(m);
+            fed[pts] = Clock::now();
+        }
+        pipeline.feed(std::move(packet), packet_type == av::MediaType::Video ? video_stream : audio_stream);
+    }
+    pipeline.terminate();
+
+    Result result;
+    result.workload = workload.name;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.frames = pipeline.getDecodedFrames(video_stream);
+    result.fps = static_cast<double>(result.frames) / result.seconds;
+    result.p50_latency_ms = percentile(latencies, 0.5);
+    result.p99_latency_ms = percentile(latencies, 0.99);
+    result.peak_rss_mb = static_cast<double>(getMemoryUsage().peak_rss) / 1024;
+    std::filesystem::remove(output_file);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parseArgs(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << std::endl;
+        std::cerr << "\t[-d <duration_s>]" << std::endl;
+        std::cerr << "\t[-q <read_ahead_packets>]" << std::endl;
+        std::cerr << "\t[-w <workload>]" << std::endl;
+        std::cerr << "\t[-t <thresholds_file>]" << std::endl;
+        std::cerr << "\t[-o <results_file>]" << std::endl;
+        std::cerr << "\t[-u]  (store the thresholds from this run)" << std::endl;
+        return 2;
+    }
+
+    try {
+        avdevice_register_all();
+        av_log_set_level(AV_LOG_ERROR);
+
+        std::map<std::string, Thresholds> thresholds;
+        if (!options.update_thresholds) {
+            if (!std::filesystem::exists(options.thresholds_file)) {
+                std::cerr << "No thresholds file '" << options.thresholds_file
+                          << "': store the ones of the reference machine with -u" << std::endl;
+                return no_thresholds_status;
+            }
+            thresholds = readThresholds(options.thresholds_file);
+        }
+
+        std::vector<Result> results;
+        bool passed = true;
+        for (auto &workload : workloads) {
+            if (!options.workload.empty() && workload.name != options.workload) continue;
+            Result result = run(workload, options);
+
+            auto it = thresholds.find(workload.name);
+            if (it != thresholds.end()) {
+                const Thresholds &t = it->second;
+                result.passed = result.fps >= t.min_fps && result.p99_latency_ms <= t.max_p99_latency_ms &&
+                                result.peak_rss_mb <= t.max_peak_rss_mb;
+            }
+            passed = passed && result.passed;
+            std::cout << workload.name << ": " << result.fps << " fps, latency p50 " << result.p50_latency_ms
+                      << " ms, p99 " << result.p99_latency_ms << " ms, peak RSS " << result.peak_rss_mb << " MB"
+                      << (it == thresholds.end() ? " (no thresholds)" : result.passed ? " OK" : " REGRESSED")
+                      << std::endl;
+            results.push_back(std::move(result));
+        }
+        if (results.empty()) throw std::runtime_error("Unknown workload '" + options.workload + "'");
+
+        writeResults(options.results_file, results);
+        if (options.update_thresholds) writeThresholds(options.thresholds_file, results);
+        return passed ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,296 @@
+/*
+ * Long-run soak harness, tracking the memory growth of the recorder over hours of recording:
+ *
+ *     ./soak -h 8 -c samples.csv                          (pipeline mode, time-compressed, headless)
+ *     xvfb-run -s "-screen 0 1280x720x24" ./soak -x -h 1  (capturer mode, in real time)
+ *
+ * In pipeline mode a synthetic source (lavfi test pattern plus a sine tone) is pushed through Pipeline as fast as
+ * possible, re-opening the source as Capturer does on pause()/resume(), and terminating and restarting the
+ * pipeline on a new file as in the start/stop cycles of a session. In capturer mode the screen of the (virtual)
+ * display is recorded through Capturer, with real pause()/resume() and stop()/restart() cycles.
+ *
+ * The resident memory, the heap in use and the depth of the interleaving queue are sampled at regular intervals
+ * of recorded time, and their growth per recorded hour is estimated with a least-squares fit. The exit status is 1
+ * if the resident memory grew faster than the given limit (-g), 2 on errors.
+ */
+
+#include <libcapture/capturer.h>
+#include <libcapture/encoder_parameters.h>
+#include <libcapture/video_parameters.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/memory_usage.h"
+#include "format/demuxer.h"
+#include "pipeline/encoder_options.h"
+#include "pipeline/pipeline.h"
+
+struct Options {
+    double hours = 1;
+    /* the recorded time between two pause()/resume() and between two start/stop cycles, in seconds */
+    int pause_interval = 60;
+    int cycle_interval = 600;
+    /* the recorded time between two samples, in seconds */
+    int sample_interval = 30;
+    /* the maximum growth of the resident memory, in MiB per recorded hour (0 to disable the check) */
+    double max_growth = 0;
+    bool capturer = false;
+    std::string csv_file;
+};
+
+struct Sample {
+    double hours;  // recorded time
+    double wall_seconds;
+    int64_t rss;
+    int64_t heap;
+    int64_t queued_bytes;  // -1 if not available
+};
+
+static Options parseArgs(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-x") {
+            options.capturer = true;
+            continue;
+        }
+        if (i + 1 == argc) throw std::runtime_error("Wrong arguments");
+        std::string value(argv[++i]);
+        if (arg == "-h") {
+            options.hours = std::stod(value);
+        } else if (arg == "-p") {
+            options.pause_interval = std::stoi(value);
+        } else if (arg == "-r") {
+            options.cycle_interval = std::stoi(value);
+        } else if (arg == "-s") {
+            options.sample_interval = std::stoi(value);
+        } else if (arg == "-g") {
+            options.max_growth = std::stod(value);
+        } else if (arg == "-c") {
+            options.csv_file = value;
+        } else {
+            throw std::runtime_error("Unknown arg: " + arg);
+        }
+    }
+    if (options.hours <= 0 || options.pause_interval <= 0 || options.cycle_interval <= 0 ||
+        options.sample_interval <= 0)
+        throw std::runtime_error("Wrong arguments");
+    return options;
+}
+
+class Sampler {
+    std::vector<Sample> samples_;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    std::ofstream csv_;
+
+public:
+    explicit Sampler(const std::string &csv_file) {
+        if (csv_file.empty()) return;
+        csv_.open(csv_file);
+        if (!csv_) throw std::runtime_error("Cannot write the samples file '" + csv_file + "'");
+        csv_ << "recorded_hours,wall_seconds,rss_kib,heap_kib,interleave_queue_bytes" << std::endl;
+    }
+
+    void sample(const double hours, const int64_t queued_bytes) {
+        const Sample s{hours, std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count(),
+                       getMemoryUsage().rss, getHeapInUse(), queued_bytes};
+        samples_.push_back(s);
+        if (csv_.is_open()) {
+            csv_ << s.hours << "," << s.wall_seconds << "," << s.rss << "," << s.heap << "," << s.queued_bytes
+                 << std::endl;
+        }
+    }
+
+    /**
+     * Estimate the growth of a quantity per recorded hour, with a least-squares fit of its samples (the first
+     * ones are skipped, since they include the allocations of the warm-up)
+     * @param value the quantity of a sample
+     * @return the growth per hour
+     */
+    template <typename F>
+    [[nodiscard]] double getGrowthPerHour(F value) const {
+        const size_t first = samples_.size() / 10;
+        const auto n = static_cast<double>(samples_.size() - first);
+        if (n < 2) return 0;
+        double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+        for (size_t i = first; i < samples_.size(); i++) {
+            const double x = samples_[i].hours;
+            const auto y = static_cast<double>(value(samples_[i]));
+            sum_x += x;
+            sum_y += y;
+            sum_xx += x * x;
+            sum_xy += x * y;
+        }
+        const double den = n * sum_xx - sum_x * sum_x;
+        return den > 0 ? (n * sum_xy - sum_x * sum_y) / den : 0;
+    }
+
+    [[nodiscard]] const std::vector<Sample> &getSamples() const { return samples_; }
+};
+
+static std::string getOutputFile(const int cycle) {
+    return (std::filesystem::temp_directory_path() / ("soak_" + std::to_string(cycle % 2) + ".mp4")).string();
+}
+
+/* Push a synthetic source through a pipeline as fast as possible, for the given recorded time */
+static void runPipeline(const Options &options, Sampler &sampler) {
+    avdevice_register_all();
+    Demuxer demuxer("lavfi", "testsrc2=size=1280x720:rate=30[out0];sine=frequency=1000:sample_rate=48000[out1]", {});
+    demuxer.openInput();
+
+    int cycle = 0;
+    Pipeline pipeline(getOutputFile(cycle), true);
+    pipeline.setBackpressure(4);
+    std::map<std::string, std::string> enc_options = getH264EncoderOptions(EncoderParameters());
+    enc_options.insert({"preset", "ultrafast"});
+    const int video_stream =
+        pipeline.initVideo(demuxer, AV_CODEC_ID_H264, AV_PIX_FMT_YUV420P, VideoParameters(), enc_options);
+    const int audio_stream = pipeline.initAudio(demuxer, AV_CODEC_ID_AAC, std::map<std::string, std::string>());
+    pipeline.initOutput();
+
+    const AVRational time_base = demuxer.getStreamTimeBase(av::MediaType::Video);
+    const auto seconds = [time_base](const int64_t pts) { return static_cast<double>(pts) * av_q2d(time_base); };
+    /* the re-opened source starts again from 0, hence its timestamps are shifted to continue the previous ones */
+    std::array<int64_t, av::MediaType::NumTypes> offsets{};
+    std::array<int64_t, av::MediaType::NumTypes> last_pts{};
+    double recorded = 0;
+    double next_pause = options.pause_interval;
+    double next_cycle = options.cycle_interval;
+    double next_sample = 0;
+
+    while (recorded < options.hours * 3600) {
+        auto [packet, packet_type] = demuxer.readPacket();
+        if (!packet) continue;
+        packet->pts += offsets[packet_type];
+        packet->dts += offsets[packet_type];
+        last_pts[packet_type] = packet->pts + std::max<int64_t>(packet->duration, 1);
+        pipeline.feed(std::move(packet), packet_type == av::MediaType::Video ? video_stream : audio_stream);
+        if (packet_type != av::MediaType::Video) continue;
+
+        recorded = seconds(last_pts[av::MediaType::Video]);
+        if (recorded >= next_sample) {
+            sampler.sample(recorded / 3600, static_cast<int64_t>(pipeline.getInterleaverStats().queued_bytes));
+            next_sample += options.sample_interval;
+        }
+        if (recorded >= next_pause) {
+            demuxer.closeInput();
+            demuxer.openInput();
+            offsets = last_pts;
+            next_pause += options.pause_interval;
+        }
+        if (recorded >= next_cycle) {
+            pipeline.terminate();
+            pipeline.restart(getOutputFile(++cycle));
+            next_cycle += options.cycle_interval;
+        }
+    }
+    pipeline.terminate();
+    for (int i = 0; i < 2; i++) std::filesystem::remove(getOutputFile(i));
+}
+
+/* Record the screen through a capturer in real time, pausing, resuming, stopping and restarting it */
+static void runCapturer(const Options &options, Sampler &sampler) {
+    const char *display = std::getenv("DISPLAY");
+    if (!display) throw std::runtime_error("DISPLAY is not set (run it under Xvfb)");
+
+    Capturer capturer(false);
+    capturer.setSessionMode(true);
+    VideoParameters video_params;
+    video_params.setFramerate(30);
+
+    int cycle = 0;
+    auto future = capturer.start(display, "", getOutputFile(cycle), video_params);
+    const auto start = std::chrono::steady_clock::now();
+    int next_pause = options.pause_interval;
+    int next_cycle = options.cycle_interval;
+    int next_sample = 0;
+    for (int elapsed = 0; elapsed < options.hours * 3600; elapsed++) {
+        std::this_thread::sleep_until(start + std::chrono::seconds(elapsed));
+        if (elapsed >= next_sample) {
+            sampler.sample(elapsed / 3600.0, -1);
+            next_sample += options.sample_interval;
+        }
+        if (elapsed >= next_pause) {
+            capturer.pause();
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            capturer.resume();
+            next_pause += options.pause_interval;
+        }
+        if (elapsed >= next_cycle) {
+            capturer.stop();
+            future.get();
+            future = capturer.restart(getOutputFile(++cycle));
+            next_cycle += options.cycle_interval;
+        }
+    }
+    capturer.stop();
+    future.get();
+    capturer.closeSession();
+    for (int i = 0; i < 2; i++) std::filesystem::remove(getOutputFile(i));
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parseArgs(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << std::endl;
+        std::cerr << "\t[-x]  (record the screen through Capturer, in real time)" << std::endl;
+        std::cerr << "\t[-h <recorded_hours>]" << std::endl;
+        std::cerr << "\t[-p <pause_interval_s>]" << std::endl;
+        std::cerr << "\t[-r <restart_interval_s>]" << std::endl;
+        std::cerr << "\t[-s <sample_interval_s>]" << std::endl;
+        std::cerr << "\t[-g <max_rss_growth_mib_per_hour>]" << std::endl;
+        std::cerr << "\t[-c <samples_csv_file>]" << std::endl;
+        return 2;
+    }
+
+    try {
+        av_log_set_level(AV_LOG_ERROR);
+        Sampler sampler(options.csv_file);
+        if (options.capturer) {
+            runCapturer(options, sampler);
+        } else {
+            runPipeline(options, sampler);
+        }
+
+        const auto &samples = sampler.getSamples();
+        if (samples.empty()) throw std::runtime_error("No samples collected");
+        const double rss_growth = sampler.getGrowthPerHour([](const Sample &s) { return s.rss; }) / 1024;
+        const double heap_growth = sampler.getGrowthPerHour([](const Sample &s) { return s.heap; }) / 1024;
+        const double queue_growth = sampler.getGrowthPerHour([](const Sample &s) { return s.queued_bytes; }) / 1024;
+        std::cout << "Recorded " << samples.back().hours << " h in " << samples.back().wall_seconds / 3600 << " h"
+                  << std::endl;
+        std::cout << "Resident memory: " << samples.front().rss / 1024 << " -> " << samples.back().rss / 1024
+                  << " MiB, " << rss_growth << " MiB/h" << std::endl;
+        if (samples.back().heap >= 0) {
+            std::cout << "Heap in use: " << samples.front().heap / 1024 << " -> " << samples.back().heap / 1024
+                      << " MiB, " << heap_growth << " MiB/h" << std::endl;
+        }
+        if (samples.back().queued_bytes >= 0) {
+            std::cout << "Interleave queue: " << samples.back().queued_bytes / 1024 << " KiB, " << queue_growth
+                      << " KiB/h" << std::endl;
+        }
+
+        if (options.max_growth > 0 && rss_growth > options.max_growth) {
+            std::cout << "The resident memory grew faster than " << options.max_growth << " MiB/h" << std::endl;
+            return 1;
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 2;
+    }
+}